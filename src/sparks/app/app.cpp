@@ -193,10 +193,17 @@ void App::OnInit() {
   nearest_sampler_ = std::make_unique<vulkan::Sampler>(
       core_->GetDevice(), VK_FILTER_NEAREST, VK_SAMPLER_ADDRESS_MODE_REPEAT);
 
-  primitive_cdf_buffer_ =
-      std::make_unique<vulkan::framework::StaticBuffer<float>>(core_.get(), 1);
-  envmap_cdf_buffer_ =
-      std::make_unique<vulkan::framework::StaticBuffer<float>>(core_.get(), 1);
+  primitive_alias_buffer_ =
+      std::make_unique<vulkan::framework::StaticBuffer<AliasEntry>>(core_.get(),
+                                                                    1);
+  envmap_alias_buffer_ =
+      std::make_unique<vulkan::framework::StaticBuffer<AliasEntry>>(core_.get(),
+                                                                    1);
+  light_bvh_node_buffer_ =
+      std::make_unique<vulkan::framework::StaticBuffer<LightBvhNode>>(
+          core_.get(), 1);
+  light_bvh_leaf_buffer_ =
+      std::make_unique<vulkan::framework::StaticBuffer<int>>(core_.get(), 1);
 
   if (app_settings_.hardware_renderer) {
     auto sobol_table =
@@ -228,8 +235,10 @@ void App::OnUpdate(uint32_t ms) {
       envmap_require_configure_ = false;
     });
     if (app_settings_.hardware_renderer) {
-      envmap_cdf_buffer_->Resize(renderer_->GetScene().GetEnvmapCdf().size());
-      envmap_cdf_buffer_->Upload(renderer_->GetScene().GetEnvmapCdf().data());
+      auto &envmap_alias =
+          renderer_->GetScene().GetEnvmapSampler().GetEntries();
+      envmap_alias_buffer_->Resize(envmap_alias.size());
+      envmap_alias_buffer_->Upload(envmap_alias.data());
       if (ray_tracing_render_node_) {
         ray_tracing_render_node_->UpdateDescriptorSetBinding(11);
       }
@@ -271,8 +280,8 @@ void App::OnRender() {
                             envmap_index_buffer_.get(),
                             envmap_index_buffer_->Size(), 0);
   preview_render_node_far_->BeginDraw();
-  for (int i = 0; i < entity_device_assets_.size(); i++) {
-    auto &entity_asset = entity_device_assets_[i];
+  for (int i = 0; i < entity_device_asset_ids_.size(); i++) {
+    auto &entity_asset = entity_device_assets_[entity_device_asset_ids_[i]];
     preview_render_node_far_->DrawDirect(entity_asset.vertex_buffer.get(),
                                          entity_asset.index_buffer.get(),
                                          entity_asset.index_buffer->Size(), i);
@@ -280,8 +289,8 @@ void App::OnRender() {
   preview_render_node_far_->EndDraw();
   depth_buffer_->ClearDepth({1.0f, 0});
   preview_render_node_->BeginDraw();
-  for (int i = 0; i < entity_device_assets_.size(); i++) {
-    auto &entity_asset = entity_device_assets_[i];
+  for (int i = 0; i < entity_device_asset_ids_.size(); i++) {
+    auto &entity_asset = entity_device_assets_[entity_device_asset_ids_[i]];
     preview_render_node_->DrawDirect(entity_asset.vertex_buffer.get(),
                                      entity_asset.index_buffer.get(),
                                      entity_asset.index_buffer->Size(), i);
@@ -488,6 +497,23 @@ void App::UpdateImGui() {
         ImGui::Checkbox("Enable MIS", &renderer_settings.enable_mis);
     reset_accumulation_ |=
         ImGui::Checkbox("Alpha Shadow", &renderer_settings.enable_alpha_shadow);
+    // The light BVH is only built while it is enabled.
+    if (ImGui::Checkbox("Light BVH", &renderer_settings.enable_light_bvh)) {
+      reset_accumulation_ = true;
+      rebuild_object_infos_ = true;
+    }
+    if (!app_settings_.hardware_renderer) {
+      reset_accumulation_ |= ImGui::Checkbox(
+          "Path Guiding", &renderer_settings.enable_path_guiding);
+      std::vector<const char *> texture_filters = {"None", "Trilinear",
+                                                   "Anisotropic"};
+      reset_accumulation_ |= ImGui::Combo(
+          "Texture Filter",
+          reinterpret_cast<int *>(&renderer_settings.texture_filter),
+          texture_filters.data(), texture_filters.size());
+      reset_accumulation_ |= ImGui::Checkbox(
+          "Envmap Cube Map", &renderer_settings.enable_envmap_cubemap);
+    }
 
     scene.EntityCombo("Selected Entity", &selected_entity_id_);
 
@@ -767,6 +793,8 @@ void App::UpdateDynamicBuffer() {
       renderer_->GetRendererSettings().enable_mis;
   global_uniform_object.enable_alpha_shadow =
       renderer_->GetRendererSettings().enable_alpha_shadow;
+  global_uniform_object.enable_light_bvh =
+      renderer_->GetRendererSettings().enable_light_bvh;
   global_uniform_object.total_power = total_power_;
   global_uniform_object.total_envmap_power =
       renderer_->GetScene().GetEnvmapTotalPower();
@@ -825,31 +853,52 @@ void App::UpdateDeviceAssets() {
   auto &entities = renderer_->GetScene().GetEntities();
   bool rebuild_rt_assets = false;
   for (int i = num_loaded_device_assets_; i < entities.size(); i++) {
-    auto &entity = entities[i];
-    auto vertices = entity.GetModel()->GetVertices();
-    auto indices = entity.GetModel()->GetIndices();
+    auto model = entities[i].GetModel();
+    if (app_settings_.hardware_renderer) {
+      rebuild_rt_assets = true;
+    }
+    auto it = model_device_asset_ids_.find(model);
+    if (it != model_device_asset_ids_.end()) {
+      entity_device_asset_ids_.push_back(it->second);
+      if (app_settings_.hardware_renderer) {
+        object_info_data_.push_back(
+            entity_device_assets_[it->second].object_info);
+      }
+      continue;
+    }
+    int asset_id = int(entity_device_assets_.size());
+    model_device_asset_ids_[model] = asset_id;
+    entity_device_asset_ids_.push_back(asset_id);
+    // Compact meshes decode their vertices only for the upload.
+    auto vertices = model->GetVertices();
+    auto indices = model->GetIndexView();
+    // The preview rasterizes its own triangle order, the ray tracing data
+    // below keeps the primitive ids of the index view.
+    auto preview_indices = model->GetPreviewIndexView();
     EntityDeviceAsset device_asset{
         std::make_unique<vulkan::framework::StaticBuffer<Vertex>>(
             core_.get(), vertices.size()),
         std::make_unique<vulkan::framework::StaticBuffer<uint32_t>>(
-            core_.get(), indices.size())};
+            core_.get(), preview_indices.size())};
     device_asset.vertex_buffer->Upload(vertices.data());
-    device_asset.index_buffer->Upload(indices.data());
-    entity_device_assets_.push_back(std::move(device_asset));
+    device_asset.index_buffer->Upload(preview_indices.data());
 
     if (app_settings_.hardware_renderer) {
-      rebuild_rt_assets = true;
       bottom_level_acceleration_structures_.push_back(
           std::make_unique<
               vulkan::raytracing::BottomLevelAccelerationStructure>(
-              core_->GetDevice(), core_->GetCommandPool(), vertices, indices));
-      object_info_data_.push_back({uint32_t(ray_tracing_vertex_data_.size()),
-                                   uint32_t(ray_tracing_index_data_.size())});
+              core_->GetDevice(), core_->GetCommandPool(),
+              std::vector<Vertex>(vertices.begin(), vertices.end()),
+              std::vector<uint32_t>(indices.begin(), indices.end())));
+      device_asset.object_info = {uint32_t(ray_tracing_vertex_data_.size()),
+                                  uint32_t(ray_tracing_index_data_.size())};
+      object_info_data_.push_back(device_asset.object_info);
       ray_tracing_vertex_data_.insert(ray_tracing_vertex_data_.end(),
                                       vertices.begin(), vertices.end());
       ray_tracing_index_data_.insert(ray_tracing_index_data_.end(),
                                      indices.begin(), indices.end());
     }
+    entity_device_assets_.push_back(std::move(device_asset));
   }
   num_loaded_device_assets_ = int(entities.size());
 
@@ -860,7 +909,8 @@ void App::UpdateDeviceAssets() {
     for (int i = 0; i < entities.size(); i++) {
       auto &entity = entities[i];
       object_instances.emplace_back(
-          bottom_level_acceleration_structures_[i].get(),
+          bottom_level_acceleration_structures_[entity_device_asset_ids_[i]]
+              .get(),
           entity.GetTransformMatrix());
     }
     top_level_acceleration_structure_ =
@@ -889,6 +939,7 @@ void App::UpdateDeviceAssets() {
       VkFilter filter{VK_FILTER_LINEAR};
       switch (texture.GetSampleType()) {
         case SAMPLE_TYPE_LINEAR:
+        case SAMPLE_TYPE_STOCHASTIC:
           filter = VK_FILTER_LINEAR;
           break;
         case SAMPLE_TYPE_NEAREST:
@@ -908,7 +959,7 @@ void App::UpdateDeviceAssets() {
               VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
               VK_MEMORY_PROPERTY_HOST_COHERENT_BIT |
                   VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
-      std::memcpy(texture_image_buffer->Map(), &texture.operator()(0, 0),
+      std::memcpy(texture_image_buffer->Map(), texture.GetBuffer().data(),
                   texture.GetWidth() * texture.GetHeight() * sizeof(glm::vec4));
       vulkan::UploadImage(core_->GetCommandPool(),
                           device_texture_sampler.first->GetImage(),
@@ -1215,7 +1266,8 @@ void App::UpdateTopLevelAccelerationStructure() {
   for (int i = 0; i < entities.size(); i++) {
     auto &entity = entities[i];
     object_instances.emplace_back(
-        bottom_level_acceleration_structures_[i].get(),
+        bottom_level_acceleration_structures_[entity_device_asset_ids_[i]]
+            .get(),
         entity.GetTransformMatrix());
   }
   top_level_acceleration_structure_->UpdateAccelerationStructure(
@@ -1255,12 +1307,16 @@ void App::BuildRayTracingPipeline() {
                                              VK_SHADER_STAGE_RAYGEN_BIT_KHR);
   ray_tracing_render_node_->AddUniformBinding(binding_texture_samplers_,
                                               VK_SHADER_STAGE_RAYGEN_BIT_KHR);
-  ray_tracing_render_node_->AddBufferBinding(primitive_cdf_buffer_.get(),
+  ray_tracing_render_node_->AddBufferBinding(primitive_alias_buffer_.get(),
                                              VK_SHADER_STAGE_RAYGEN_BIT_KHR);
-  ray_tracing_render_node_->AddBufferBinding(envmap_cdf_buffer_.get(),
+  ray_tracing_render_node_->AddBufferBinding(envmap_alias_buffer_.get(),
                                              VK_SHADER_STAGE_RAYGEN_BIT_KHR);
   ray_tracing_render_node_->AddBufferBinding(sobol_table_buffer_.get(),
                                              VK_SHADER_STAGE_RAYGEN_BIT_KHR);
+  ray_tracing_render_node_->AddBufferBinding(light_bvh_node_buffer_.get(),
+                                             VK_SHADER_STAGE_RAYGEN_BIT_KHR);
+  ray_tracing_render_node_->AddBufferBinding(light_bvh_leaf_buffer_.get(),
+                                             VK_SHADER_STAGE_RAYGEN_BIT_KHR);
   ray_tracing_render_node_->SetShaders("../../shaders/path_tracing.rgen.spv",
                                        "../../shaders/path_tracing.rmiss.spv",
                                        "../../shaders/path_tracing.rchit.spv");
@@ -1343,6 +1399,8 @@ void App::OpenFile(const std::string &path) {
     num_loaded_device_assets_ = 0;
     device_texture_samplers_.clear();
     entity_device_assets_.clear();
+    model_device_asset_ids_.clear();
+    entity_device_asset_ids_.clear();
     selected_entity_id_ = -1;
     envmap_require_configure_ = true;
     rebuild_object_infos_ = true;
@@ -1359,76 +1417,60 @@ void App::OpenFile(const std::string &path) {
 
 void App::UpdateObjectInfo() {
   if (rebuild_object_infos_) {
-    std::vector<EntityUniformObject> object_sampler_infos;
-    std::vector<float> primitive_cdf;
-    auto &entities = renderer_->GetScene().GetEntities();
+    auto &scene = renderer_->GetScene();
+    bool enable_light_bvh = renderer_->GetRendererSettings().enable_light_bvh;
+    renderer_->SafeOperation<void>([&scene, enable_light_bvh]() {
+      scene.UpdateInstanceBvh();
+      scene.UpdateLightSampler(enable_light_bvh);
+    });
+    auto &light_sampler = scene.GetLightSampler();
+    auto &entity_lights = light_sampler.GetEntityLights();
+    auto &entity_alias = light_sampler.GetEntityTable().GetEntries();
+    auto &entities = scene.GetEntities();
 
-    float total_power = 0.0f;
-    for (auto &entity : entities) {
+    std::vector<EntityUniformObject> object_sampler_infos;
+    std::vector<AliasEntry> primitive_alias;
+    float total_power = light_sampler.GetTotalPower();
+    for (size_t i = 0; i < entities.size(); i++) {
+      auto &entity_light = entity_lights[i];
+      // The shaders sample the triangles, not the patches of analytic models.
+      auto &triangle_table = light_sampler.GetTriangleTable(int(i));
       EntityUniformObject object_sampler_info{};
-
-      auto mat = entity.GetMaterial();
-      auto transform = entity.GetTransformMatrix();
-      object_sampler_info.object_to_world = transform;
-      object_sampler_info.num_primitives = 0;
-      object_sampler_info.primitive_offset = primitive_cdf.size();
-      object_sampler_info.power = 0.0f;
-      if (mat.emission_strength > 1e-4f) {
-        auto vertices = entity.GetModel()->GetVertices();
-        auto indices = entity.GetModel()->GetIndices();
-        object_sampler_info.num_primitives = indices.size() / 3;
-
-        if (object_sampler_info.num_primitives) {
-          std::vector<float> object_primitive_cdf;
-          for (auto &vertex : vertices) {
-            vertex.position = transform * glm::vec4{vertex.position, 1.0f};
-          }
-          auto total_area = 0.0f;
-          object_primitive_cdf.push_back(0.0f);
-          for (int i = 0; i < object_sampler_info.num_primitives; i++) {
-            auto v0 = vertices[indices[i * 3]];
-            auto v1 = vertices[indices[i * 3 + 1]];
-            auto v2 = vertices[indices[i * 3 + 2]];
-            auto area =
-                0.5f * glm::length(glm::cross(v1.position - v0.position,
-                                              v2.position - v0.position));
-            total_area += area;
-            object_primitive_cdf.push_back(total_area);
-          }
-          object_sampler_info.power = total_area * mat.emission_strength;
-          object_sampler_info.area = total_area;
-          for (auto &cdf : object_primitive_cdf) {
-            cdf /= total_area;
-          }
-          object_primitive_cdf.push_back(1.0f);
-          primitive_cdf.insert(primitive_cdf.end(),
-                               object_primitive_cdf.begin(),
-                               object_primitive_cdf.end());
-        }
+      object_sampler_info.object_to_world = entities[i].GetTransformMatrix();
+      object_sampler_info.alias_prob = entity_alias[i].prob;
+      object_sampler_info.alias = entity_alias[i].alias;
+      object_sampler_info.primitive_offset = int(primitive_alias.size());
+      object_sampler_info.num_primitives = triangle_table.GetSize();
+      object_sampler_info.power = entity_light.power;
+      object_sampler_info.area = entity_light.area;
+      if (total_power > 0.0f) {
+        object_sampler_info.pdf = entity_light.power / total_power;
       }
-      total_power += object_sampler_info.power;
-      object_sampler_info.cdf = total_power;
-      object_sampler_infos.emplace_back(object_sampler_info);
-    }
-
-    if (total_power > 0.0f) {
-      for (auto &object_sampler_info : object_sampler_infos) {
-        object_sampler_info.pdf = object_sampler_info.power / total_power;
-        object_sampler_info.cdf /= total_power;
-        if (object_sampler_info.area) {
-          object_sampler_info.sample_density =
-              object_sampler_info.pdf / object_sampler_info.area;
-        } else {
-          object_sampler_info.sample_density = 0.0;
-        }
+      float triangle_area = triangle_table.GetTotalWeight();
+      if (triangle_area > 0.0f) {
+        object_sampler_info.sample_density =
+            object_sampler_info.pdf / triangle_area;
       }
+      auto &entries = triangle_table.GetEntries();
+      primitive_alias.insert(primitive_alias.end(), entries.begin(),
+                             entries.end());
+      object_sampler_infos.emplace_back(object_sampler_info);
     }
 
     object_sampler_infos.emplace_back();
     total_power_ = total_power;
 
-    if (primitive_cdf.empty()) {
-      primitive_cdf.emplace_back();
+    if (primitive_alias.empty()) {
+      primitive_alias.emplace_back();
+    }
+
+    auto light_bvh_nodes = light_sampler.GetLightBvh().GetNodes();
+    auto light_bvh_leaves = light_sampler.GetLightBvh().GetLeafIndices();
+    if (light_bvh_nodes.empty()) {
+      light_bvh_nodes.emplace_back();
+    }
+    if (light_bvh_leaves.empty()) {
+      light_bvh_leaves.push_back(-1);
     }
 
     std::vector<Material> materials;
@@ -1439,7 +1481,9 @@ void App::UpdateObjectInfo() {
     {
       material_uniform_buffer_->Resize(entities.size());
       entity_uniform_buffer_->Resize(object_sampler_infos.size());
-      primitive_cdf_buffer_->Resize(primitive_cdf.size());
+      primitive_alias_buffer_->Resize(primitive_alias.size());
+      light_bvh_node_buffer_->Resize(light_bvh_nodes.size());
+      light_bvh_leaf_buffer_->Resize(light_bvh_leaves.size());
 
       if (preview_render_node_) {
         preview_render_node_->UpdateDescriptorSetBinding(1);
@@ -1454,11 +1498,15 @@ void App::UpdateObjectInfo() {
         ray_tracing_render_node_->UpdateDescriptorSetBinding(4);
         ray_tracing_render_node_->UpdateDescriptorSetBinding(5);
         ray_tracing_render_node_->UpdateDescriptorSetBinding(10);
+        ray_tracing_render_node_->UpdateDescriptorSetBinding(13);
+        ray_tracing_render_node_->UpdateDescriptorSetBinding(14);
       }
     }
 
     entity_uniform_buffer_->Upload(object_sampler_infos.data());
-    primitive_cdf_buffer_->Upload(primitive_cdf.data());
+    primitive_alias_buffer_->Upload(primitive_alias.data());
+    light_bvh_node_buffer_->Upload(light_bvh_nodes.data());
+    light_bvh_leaf_buffer_->Upload(light_bvh_leaves.data());
     material_uniform_buffer_->Upload(materials.data());
 
     rebuild_object_infos_ = false;
@@ -95,7 +95,11 @@ class App {
   std::vector<Vertex> ray_tracing_vertex_data_;
   std::vector<uint32_t> ray_tracing_index_data_;
 
+  // One device asset, and bottom level acceleration structure, per distinct
+  // model. Entities instancing the same model share it.
   std::vector<EntityDeviceAsset> entity_device_assets_;
+  std::unordered_map<const Model *, int> model_device_asset_ids_;
+  std::vector<int> entity_device_asset_ids_;
   int num_loaded_device_assets_{0};
 
   std::vector<std::pair<std::unique_ptr<vulkan::framework::TextureImage>,
@@ -120,8 +124,13 @@ class App {
 
   bool rebuild_render_nodes_{true};
   bool rebuild_object_infos_{true};
-  std::unique_ptr<vulkan::framework::StaticBuffer<float>> primitive_cdf_buffer_;
-  std::unique_ptr<vulkan::framework::StaticBuffer<float>> envmap_cdf_buffer_;
+  std::unique_ptr<vulkan::framework::StaticBuffer<AliasEntry>>
+      primitive_alias_buffer_;
+  std::unique_ptr<vulkan::framework::StaticBuffer<AliasEntry>>
+      envmap_alias_buffer_;
+  std::unique_ptr<vulkan::framework::StaticBuffer<LightBvhNode>>
+      light_bvh_node_buffer_;
+  std::unique_ptr<vulkan::framework::StaticBuffer<int>> light_bvh_leaf_buffer_;
   float total_power_{0.0f};
 
   std::unique_ptr<vulkan::framework::StaticBuffer<uint32_t>>
@@ -1,5 +1,6 @@
 #pragma once
 #include "grassland/grassland.h"
+#include "sparks/app/object_info.h"
 #include "sparks/assets/vertex.h"
 
 namespace sparks {
@@ -7,5 +8,7 @@ using namespace grassland;
 struct EntityDeviceAsset {
   std::unique_ptr<vulkan::framework::StaticBuffer<Vertex>> vertex_buffer;
   std::unique_ptr<vulkan::framework::StaticBuffer<uint32_t>> index_buffer;
+  // Offsets of the geometry in the ray tracing buffers.
+  ObjectInfo object_info{};
 };
 }  // namespace sparks
@@ -4,13 +4,13 @@
 namespace sparks {
 struct EntityUniformObject {
   glm::mat4 object_to_world{1.0f};
-  float cdf{1.0f};
+  float alias_prob{1.0f};
   float pdf{0.0f};
   int primitive_offset{0};
   int num_primitives{1};
   float power{0.0f};
   float area{0.0f};
   float sample_density{};
-  float reserve{};
+  int alias{0};
 };
 }  // namespace sparks
@@ -28,5 +28,6 @@ struct GlobalUniformObject {
   int enable_alpha_shadow{true};
   int output_selection{0};
   float envmap_scale{1.0};
+  int enable_light_bvh{true};
 };
 }  // namespace sparks
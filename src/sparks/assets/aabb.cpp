@@ -28,40 +28,23 @@ AxisAlignedBoundingBox::AxisAlignedBoundingBox(const glm::vec3 &position) {
   z_high = position.z;
 }
 
-bool AxisAlignedBoundingBox::IsIntersect(const glm::vec3 &origin,
-                                         const glm::vec3 &direction,
-                                         float t_min,
-                                         float t_max) const {
-  if (x_low <= origin.x && origin.x <= x_high && y_low <= origin.y &&
-      origin.y <= y_high && z_low <= origin.z && origin.z <= z_high) {
-    return true;
+bool AxisAlignedBoundingBox::IsIntersect(const Ray &ray) const {
+  // The sign bits pick the near and far plane of each slab, so no per axis
+  // swap is needed. An origin on a plane parallel to the ray gives 0 * inf,
+  // the NaN loses every comparison and the slab leaves the range untouched.
+  const float bounds[2][3] = {{x_low, y_low, z_low}, {x_high, y_high, z_high}};
+  float t_near = ray.t_min;
+  float t_far = ray.t_max;
+  for (int i = 0; i < 3; i++) {
+    float t0 = (bounds[ray.sign[i]][i] - ray.origin[i]) * ray.inv_direction[i];
+    float t1 =
+        (bounds[1 - ray.sign[i]][i] - ray.origin[i]) * ray.inv_direction[i];
+    t_near = t0 > t_near ? t0 : t_near;
+    t_far = t1 < t_far ? t1 : t_far;
   }
-  float intersection_range_low = t_max * (1.0f + t_min);
-  float intersection_range_high = 0.0f;
-  float t;
-  glm::vec3 intersection;
-#define TestIntersection(x, y, z)                                     \
-  if (std::abs(direction.x) > 1e-5) {                                 \
-    float inv_d = 1.0f / direction.x;                                 \
-    t = (x##_low - origin.x) * inv_d;                                 \
-    intersection = origin + direction * t;                            \
-    if (y##_low <= intersection.y && intersection.y <= y##_high &&    \
-        z##_low <= intersection.z && intersection.z <= z##_high) {    \
-      intersection_range_low = std::min(intersection_range_low, t);   \
-      intersection_range_high = std::max(intersection_range_high, t); \
-    }                                                                 \
-    t = (x##_high - origin.x) * inv_d;                                \
-    intersection = origin + direction * t;                            \
-    if (y##_low <= intersection.y && intersection.y <= y##_high &&    \
-        z##_low <= intersection.z && intersection.z <= z##_high) {    \
-      intersection_range_low = std::min(intersection_range_low, t);   \
-      intersection_range_high = std::max(intersection_range_high, t); \
-    }                                                                 \
-  }
-  TestIntersection(x, y, z);
-  TestIntersection(z, x, y);
-  TestIntersection(y, z, x);
-  return intersection_range_high >= t_min && intersection_range_low <= t_max;
+  // Widened by the rounding error of the slab distances, which would
+  // otherwise miss grazing rays on box faces.
+  return t_near <= t_far * 1.0000004f;
 }
 
 AxisAlignedBoundingBox AxisAlignedBoundingBox::operator&(
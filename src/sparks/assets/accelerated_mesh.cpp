@@ -1,28 +1,428 @@
 #include "sparks/assets/accelerated_mesh.h"
 
 #include "algorithm"
+#include "limits"
+#include "sparks/assets/vertex_cache.h"
+#include "sparks/util/thread_pool.h"
+#include "sparks/util/util.h"
 
 namespace sparks {
+
+namespace {
+constexpr int kTrianglesPerBlock = 1 << 14;
+constexpr int kRadixBits = 8;
+constexpr int kRadixSize = 1 << kRadixBits;
+constexpr int kMortonBits = 30;
+constexpr int kMaxRotationPasses = 16;
+constexpr int kMaxRotationsPerNode = 8;
+// Relative to the cost before, the passes stop below it.
+constexpr float kMinRotationPassGain = 1e-3f;
+// Relative to the area of the node, rounding noise is ignored.
+constexpr float kMinRotationGain = 1e-5f;
+
+float SurfaceArea(const AxisAlignedBoundingBox &aabb) {
+  float x = aabb.x_high - aabb.x_low;
+  float y = aabb.y_high - aabb.y_low;
+  float z = aabb.z_high - aabb.z_low;
+  return 2.0f * (x * y + y * z + z * x);
+}
+
+// Spreads the lower 10 bits of value to every third bit.
+uint32_t ExpandBits(uint32_t value) {
+  value = (value * 0x00010001u) & 0xFF0000FFu;
+  value = (value * 0x00000101u) & 0x0F00F00Fu;
+  value = (value * 0x00000011u) & 0xC30C30C3u;
+  value = (value * 0x00000005u) & 0x49249249u;
+  return value;
+}
+
+// position is relative to the bounds, within [0, 1] on each axis.
+uint32_t MortonCode(const glm::vec3 &position) {
+  auto quantized = glm::clamp(position * 1024.0f, 0.0f, 1023.0f);
+  return (ExpandBits(uint32_t(quantized.x)) << 2) |
+         (ExpandBits(uint32_t(quantized.y)) << 1) |
+         ExpandBits(uint32_t(quantized.z));
+}
+
+// Stable least significant digit radix sort of the keys by their upper 32
+// bits, blocks are counted and scattered in parallel.
+void RadixSortUpperBits(std::vector<uint64_t> &keys, int num_bits) {
+  int num_keys = int(keys.size());
+  int num_blocks = (num_keys + kTrianglesPerBlock - 1) / kTrianglesPerBlock;
+  std::vector<uint64_t> sorted(keys.size());
+  std::vector<uint32_t> offsets(size_t(num_blocks) * kRadixSize);
+  // Digit major, so that the offsets of a digit follow the block order.
+  auto block_offset = [&](int block, int digit) -> uint32_t & {
+    return offsets[size_t(digit) * num_blocks + block];
+  };
+  for (int shift = 32; shift < 32 + num_bits; shift += kRadixBits) {
+    std::fill(offsets.begin(), offsets.end(), 0);
+    ParallelFor(0, num_blocks, [&](int block) {
+      int end = std::min((block + 1) * kTrianglesPerBlock, num_keys);
+      for (int i = block * kTrianglesPerBlock; i < end; i++) {
+        block_offset(block, int(keys[i] >> shift) & (kRadixSize - 1))++;
+      }
+    });
+    uint32_t offset = 0;
+    for (auto &count : offsets) {
+      auto block_count = count;
+      count = offset;
+      offset += block_count;
+    }
+    ParallelFor(0, num_blocks, [&](int block) {
+      int end = std::min((block + 1) * kTrianglesPerBlock, num_keys);
+      for (int i = block * kTrianglesPerBlock; i < end; i++) {
+        auto &key_offset =
+            block_offset(block, int(keys[i] >> shift) & (kRadixSize - 1));
+        sorted[key_offset++] = keys[i];
+      }
+    });
+    keys.swap(sorted);
+  }
+}
+}  // namespace
+
+BvhBuildQuality StringToBvhBuildQuality(const std::string &name) {
+  if (name == "fast") {
+    return BVH_BUILD_QUALITY_FAST;
+  } else if (name == "optimized") {
+    return BVH_BUILD_QUALITY_OPTIMIZED;
+  }
+  return BVH_BUILD_QUALITY_HIGH;
+}
+
+AcceleratedMesh::AcceleratedMesh(const AcceleratedMesh &mesh) {
+  *this = mesh;
+}
+
 AcceleratedMesh::AcceleratedMesh(const Mesh &mesh) : Mesh(mesh) {
   BuildAccelerationStructure();
 }
 
-AcceleratedMesh::AcceleratedMesh(const std::vector<Vertex> &vertices,
-                                 const std::vector<uint32_t> &indices)
-    : Mesh(vertices, indices) {
+AcceleratedMesh::AcceleratedMesh(Mesh &&mesh) : Mesh(std::move(mesh)) {
   BuildAccelerationStructure();
 }
 
-void AcceleratedMesh::BuildAccelerationStructure() {
-  std::vector<std::pair<int, glm::vec3>> triangle_indices;
-  for (int i = 0; i * 3 + 2 < indices_.size(); i++) {
-    triangle_indices.emplace_back(i, (vertices_[indices_[i * 3]].position +
-                                      vertices_[indices_[i * 3 + 1]].position +
-                                      vertices_[indices_[i * 3 + 2]].position) /
-                                         3.0f);
+AcceleratedMesh::AcceleratedMesh(std::vector<Vertex> vertices,
+                                 std::vector<uint32_t> indices)
+    : Mesh(std::move(vertices), std::move(indices)) {
+  BuildAccelerationStructure();
+}
+
+AcceleratedMesh &AcceleratedMesh::operator=(const AcceleratedMesh &mesh) {
+  Mesh::operator=(mesh);
+  root_ = mesh.root_;
+  tree_node_ = mesh.tree_node_;
+  bvh_quality_ = mesh.bvh_quality_;
+  triangle_positions_ = mesh.triangle_positions_;
+  preview_indices_ = mesh.preview_indices_;
+  compact_vertices_ = mesh.compact_vertices_;
+  cache_file_ = mesh.cache_file_;
+  vertex_view_ = mesh.vertex_view_;
+  index_view_ = mesh.index_view_;
+  tree_node_view_ = mesh.tree_node_view_;
+  triangle_position_view_ = mesh.triangle_position_view_;
+  preview_index_view_ = mesh.preview_index_view_;
+  // Views of the members of mesh move over to the copies.
+  UpdateViews();
+  return *this;
+}
+
+void AcceleratedMesh::BuildAccelerationStructure(BvhBuildQuality quality) {
+  DetachCacheFile();
+  if (quality == BVH_BUILD_QUALITY_FAST) {
+    BuildLinearTree();
+  } else {
+    std::vector<std::pair<int, glm::vec3>> triangle_indices;
+    for (int i = 0; i * 3 + 2 < indices_.size(); i++) {
+      triangle_indices.emplace_back(
+          i, (vertices_[indices_[i * 3]].position +
+              vertices_[indices_[i * 3 + 1]].position +
+              vertices_[indices_[i * 3 + 2]].position) /
+                 3.0f);
+    }
+    tree_node_.resize(triangle_indices.size());
+    BuildTree(root_, triangle_indices.data(), 0,
+              int(triangle_indices.size()), 0);
+  }
+  bvh_quality_ = quality;
+  if (quality == BVH_BUILD_QUALITY_OPTIMIZED) {
+    OptimizeAccelerationStructure();
+  } else {
+    FinishTree();
+  }
+}
+
+void AcceleratedMesh::OptimizeAccelerationStructure() {
+  if (root_ == -1) {
+    return;
+  }
+  DetachCacheFile();
+  // Quantized meshes rotate the bounds of their decoded positions, like
+  // RefitTree.
+  std::vector<AxisAlignedBoundingBox> triangle_aabbs(tree_node_.size());
+  for (size_t i = 0; i < triangle_aabbs.size(); i++) {
+    for (int j = 0; j < 3; j++) {
+      auto aabb = AxisAlignedBoundingBox(GetPosition(indices_[i * 3 + j]));
+      triangle_aabbs[i] = j ? triangle_aabbs[i] | aabb : aabb;
+    }
+  }
+  auto tree_cost = [this]() {
+    double cost = 0.0;
+    for (auto &node : tree_node_) {
+      cost += SurfaceArea(node.aabb);
+    }
+    return cost;
+  };
+
+  // Below split_depth the subtrees are rotated in parallel, a few per
+  // thread, the levels above afterwards.
+  int split_depth = 0;
+  size_t num_subtrees = size_t(ThreadPool::GetInstance().GetNumThreads()) * 4;
+  while ((size_t(1) << split_depth) < num_subtrees &&
+         (tree_node_.size() >> split_depth) > kTrianglesPerBlock) {
+    split_depth++;
+  }
+  double cost = tree_cost();
+  for (int pass = 0; pass < kMaxRotationPasses; pass++) {
+    std::vector<int *> subtree_roots;
+    std::vector<std::pair<int *, int>> stack{{&root_, 0}};
+    while (!stack.empty()) {
+      auto slot = stack.back();
+      stack.pop_back();
+      if (*slot.first == -1) {
+        continue;
+      }
+      if (slot.second == split_depth) {
+        subtree_roots.push_back(slot.first);
+        continue;
+      }
+      for (auto &child : tree_node_[*slot.first].child) {
+        stack.emplace_back(&child, slot.second + 1);
+      }
+    }
+    ParallelFor(0, int(subtree_roots.size()), [&](int i) {
+      *subtree_roots[i] = RotateSubtree(*subtree_roots[i], -1, triangle_aabbs);
+    });
+    root_ = RotateSubtree(root_, split_depth, triangle_aabbs);
+
+    double new_cost = tree_cost();
+    bool converged = new_cost > cost * (1.0 - kMinRotationPassGain);
+    cost = new_cost;
+    if (converged) {
+      break;
+    }
+  }
+  bvh_quality_ = BVH_BUILD_QUALITY_OPTIMIZED;
+  FinishTree();
+}
+
+BvhBuildQuality AcceleratedMesh::GetBvhQuality() const {
+  return bvh_quality_;
+}
+
+int AcceleratedMesh::RotateSubtree(
+    int x,
+    int depth_limit,
+    const std::vector<AxisAlignedBoundingBox> &triangle_aabbs) {
+  if (x == -1 || !depth_limit) {
+    return x;
+  }
+  for (auto &child : tree_node_[x].child) {
+    child = RotateSubtree(child, depth_limit - 1, triangle_aabbs);
+  }
+  auto merge = [this](int y, AxisAlignedBoundingBox aabb) {
+    if (y != -1) {
+      aabb |= tree_node_[y].aabb;
+    }
+    return aabb;
+  };
+  // Every move keeps the triangles below x, so only the bounds of the nodes
+  // below it change. Moves 0 and 1 swap the sibling of the child with that
+  // grandchild, move 2 swaps x with the child and moves 3 to 6 swap a
+  // grandchild on each side.
+  for (int round = 0; round < kMaxRotationsPerNode; round++) {
+    auto &node = tree_node_[x];
+    float best_gain = SurfaceArea(node.aabb) * kMinRotationGain;
+    int best_side = -1;
+    int best_move = -1;
+    for (int side = 0; side < 2; side++) {
+      int c = node.child[side];
+      int sibling = node.child[side ^ 1];
+      if (c == -1) {
+        continue;
+      }
+      auto &child = tree_node_[c];
+      float area = SurfaceArea(child.aabb);
+      for (int move = 0; move < 2; move++) {
+        if (sibling == -1 && child.child[move] == -1) {
+          continue;
+        }
+        auto aabb = merge(child.child[move ^ 1], triangle_aabbs[c]);
+        float gain = area - SurfaceArea(merge(sibling, aabb));
+        if (gain > best_gain) {
+          best_gain = gain;
+          best_side = side;
+          best_move = move;
+        }
+      }
+      auto aabb = merge(child.child[1], triangle_aabbs[x]);
+      float gain = area - SurfaceArea(merge(child.child[0], aabb));
+      if (gain > best_gain) {
+        best_gain = gain;
+        best_side = side;
+        best_move = 2;
+      }
+    }
+    if (node.child[0] != -1 && node.child[1] != -1) {
+      int c[2] = {node.child[0], node.child[1]};
+      float area = SurfaceArea(tree_node_[c[0]].aabb) +
+                   SurfaceArea(tree_node_[c[1]].aabb);
+      for (int move = 0; move < 4; move++) {
+        int g[2] = {tree_node_[c[0]].child[move >> 1],
+                    tree_node_[c[1]].child[move & 1]};
+        if (g[0] == -1 && g[1] == -1) {
+          continue;
+        }
+        // Each child keeps its other grandchild and takes the one opposite.
+        int kept[2] = {tree_node_[c[0]].child[(move >> 1) ^ 1],
+                       tree_node_[c[1]].child[(move & 1) ^ 1]};
+        float gain = area;
+        for (int i = 0; i < 2; i++) {
+          gain -= SurfaceArea(
+              merge(g[i ^ 1], merge(kept[i], triangle_aabbs[c[i]])));
+        }
+        if (gain > best_gain) {
+          best_gain = gain;
+          best_side = 0;
+          best_move = 3 + move;
+        }
+      }
+    }
+    if (best_side == -1) {
+      break;
+    }
+    if (best_move >= 3) {
+      auto &left = tree_node_[node.child[0]];
+      auto &right = tree_node_[node.child[1]];
+      std::swap(left.child[(best_move - 3) >> 1],
+                right.child[(best_move - 3) & 1]);
+      left.aabb = merge(left.child[0],
+                        merge(left.child[1], triangle_aabbs[node.child[0]]));
+      right.aabb = merge(right.child[0],
+                         merge(right.child[1], triangle_aabbs[node.child[1]]));
+      continue;
+    }
+    int c = node.child[best_side];
+    auto &child = tree_node_[c];
+    if (best_move < 2) {
+      std::swap(node.child[best_side ^ 1], child.child[best_move]);
+      child.aabb =
+          merge(child.child[0], merge(child.child[1], triangle_aabbs[c]));
+    } else {
+      int grandchild[2] = {child.child[0], child.child[1]};
+      child.child[best_side] = x;
+      child.child[best_side ^ 1] = node.child[best_side ^ 1];
+      child.aabb = node.aabb;
+      node.child[0] = grandchild[0];
+      node.child[1] = grandchild[1];
+      node.aabb =
+          merge(grandchild[0], merge(grandchild[1], triangle_aabbs[x]));
+      x = c;
+    }
+  }
+  return x;
+}
+
+void AcceleratedMesh::FinishTree() {
+  ReorderToTree();
+  if (!compact_vertices_) {
+    BuildTrianglePositions();
+  }
+  auto vertex_count = compact_vertices_ ? compact_vertices_->GetVertexCount()
+                                        : vertices_.size();
+  preview_indices_ = OptimizeVertexCache(indices_, vertex_count);
+  UpdateViews();
+}
+
+void AcceleratedMesh::ReorderToTree() {
+  // Each node holds the triangle of its index, so the preorder of the nodes
+  // is the order of the triangles as well.
+  std::vector<int> order;
+  order.reserve(tree_node_.size());
+  std::vector<int> stack;
+  if (root_ != -1) {
+    stack.push_back(root_);
+  }
+  while (!stack.empty()) {
+    int x = stack.back();
+    stack.pop_back();
+    order.push_back(x);
+    for (int i = 1; i >= 0; i--) {
+      if (tree_node_[x].child[i] != -1) {
+        stack.push_back(tree_node_[x].child[i]);
+      }
+    }
+  }
+  if (order.size() != tree_node_.size()) {
+    return;
+  }
+
+  std::vector<int> new_node_id(order.size());
+  for (int i = 0; i < order.size(); i++) {
+    new_node_id[order[i]] = i;
+  }
+  std::vector<detail::TreeNode> tree_node(order.size());
+  std::vector<uint32_t> indices(order.size() * 3);
+  for (int i = 0; i < order.size(); i++) {
+    tree_node[i] = tree_node_[order[i]];
+    for (auto &child : tree_node[i].child) {
+      if (child != -1) {
+        child = new_node_id[child];
+      }
+    }
+    for (int j = 0; j < 3; j++) {
+      indices[i * 3 + j] = indices_[order[i] * 3 + j];
+    }
+  }
+
+  tree_node_ = std::move(tree_node);
+  indices_ = std::move(indices);
+  root_ = tree_node_.empty() ? -1 : 0;
+  // Compact vertices are shared between copies and keep their order.
+  if (compact_vertices_) {
+    return;
+  }
+
+  // Vertices no triangle refers to keep their relative order at the end.
+  const auto kUnused = std::numeric_limits<uint32_t>::max();
+  std::vector<uint32_t> new_vertex_id(vertices_.size(), kUnused);
+  std::vector<Vertex> vertices;
+  vertices.reserve(vertices_.size());
+  for (auto &index : indices_) {
+    if (new_vertex_id[index] == kUnused) {
+      new_vertex_id[index] = uint32_t(vertices.size());
+      vertices.push_back(vertices_[index]);
+    }
+    index = new_vertex_id[index];
+  }
+  for (size_t i = 0; i < vertices_.size(); i++) {
+    if (new_vertex_id[i] == kUnused) {
+      vertices.push_back(vertices_[i]);
+    }
+  }
+
+  vertices_ = std::move(vertices);
+}
+
+void AcceleratedMesh::BuildTrianglePositions() {
+  triangle_positions_.resize(indices_.size() / 3);
+  for (size_t i = 0; i < triangle_positions_.size(); i++) {
+    auto &p0 = vertices_[indices_[i * 3]].position;
+    auto &p1 = vertices_[indices_[i * 3 + 1]].position;
+    auto &p2 = vertices_[indices_[i * 3 + 2]].position;
+    triangle_positions_[i] = {p0, p1 - p0, p2 - p0};
   }
-  tree_node_.resize(triangle_indices.size());
-  BuildTree(root_, triangle_indices.data(), 0, int(triangle_indices.size()), 0);
 }
 
 void AcceleratedMesh::BuildTree(int &x,
@@ -57,87 +457,283 @@ void AcceleratedMesh::BuildTree(int &x,
   }
 }
 
-float AcceleratedMesh::TraceRay(const glm::vec3 &origin,
-                                const glm::vec3 &direction,
-                                float t_min,
-                                HitRecord *hit_record) const {
-  float t = -1.0f;
-  int trace_cnt = 0;
-  TraceRay(root_, origin, direction, t_min, &t, hit_record, &trace_cnt);
-  return t;
+void AcceleratedMesh::BuildLinearTree() {
+  int num_triangles = int(indices_.size() / 3);
+  tree_node_.assign(num_triangles, detail::TreeNode{});
+  root_ = -1;
+  if (!num_triangles) {
+    return;
+  }
+  int num_blocks =
+      (num_triangles + kTrianglesPerBlock - 1) / kTrianglesPerBlock;
+  std::vector<AxisAlignedBoundingBox> block_bounds(num_blocks);
+  std::vector<glm::vec3> centroids(num_triangles);
+  ParallelFor(0, num_blocks, [&](int block) {
+    int end = std::min((block + 1) * kTrianglesPerBlock, num_triangles);
+    for (int i = block * kTrianglesPerBlock; i < end; i++) {
+      auto &p0 = vertices_[indices_[i * 3]].position;
+      auto &p1 = vertices_[indices_[i * 3 + 1]].position;
+      auto &p2 = vertices_[indices_[i * 3 + 2]].position;
+      tree_node_[i].aabb = AxisAlignedBoundingBox(p0) |
+                           AxisAlignedBoundingBox(p1) |
+                           AxisAlignedBoundingBox(p2);
+      centroids[i] = (p0 + p1 + p2) / 3.0f;
+      if (i == block * kTrianglesPerBlock) {
+        block_bounds[block] = AxisAlignedBoundingBox(centroids[i]);
+      } else {
+        block_bounds[block] |= AxisAlignedBoundingBox(centroids[i]);
+      }
+    }
+  });
+  auto bounds = block_bounds[0];
+  for (auto &block_bound : block_bounds) {
+    bounds |= block_bound;
+  }
+  glm::vec3 low{bounds.x_low, bounds.y_low, bounds.z_low};
+  glm::vec3 extent =
+      glm::vec3{bounds.x_high, bounds.y_high, bounds.z_high} - low;
+  auto inv_extent = glm::vec3{extent.x > 0.0f ? 1.0f / extent.x : 0.0f,
+                              extent.y > 0.0f ? 1.0f / extent.y : 0.0f,
+                              extent.z > 0.0f ? 1.0f / extent.z : 0.0f};
+
+  // The Morton code in the upper half, the triangle in the lower half.
+  std::vector<uint64_t> keys(num_triangles);
+  ParallelFor(0, num_blocks, [&](int block) {
+    int end = std::min((block + 1) * kTrianglesPerBlock, num_triangles);
+    for (int i = block * kTrianglesPerBlock; i < end; i++) {
+      keys[i] = uint64_t(MortonCode((centroids[i] - low) * inv_extent)) << 32 |
+                uint32_t(i);
+    }
+  });
+  RadixSortUpperBits(keys, kMortonBits);
+
+  // The subtrees below the top levels are linked and bounded in parallel,
+  // then the top levels propagate their bounds up to the root.
+  int parallel_depth = 0;
+  while ((num_triangles >> parallel_depth) > kTrianglesPerBlock &&
+         parallel_depth < 10) {
+    parallel_depth++;
+  }
+  std::vector<std::pair<int, int>> subtrees;
+  LinkLinearTree(keys, 0, num_triangles, parallel_depth, &subtrees);
+  ParallelFor(0, int(subtrees.size()), [&](int i) {
+    LinkLinearTree(keys, subtrees[i].first, subtrees[i].second, -1, nullptr);
+  });
+  root_ = LinkLinearTree(keys, 0, num_triangles, parallel_depth, nullptr);
 }
 
-void AcceleratedMesh::TraceRay(int x,
-                               const glm::vec3 &origin,
-                               const glm::vec3 &direction,
-                               float t_min,
-                               float *result,
-                               HitRecord *hit_record,
-                               int *trace_cnt) const {
-  if (trace_cnt) {
-    (*trace_cnt)++;
+int AcceleratedMesh::LinkLinearTree(
+    const std::vector<uint64_t> &keys,
+    int begin,
+    int end,
+    int parallel_depth,
+    std::vector<std::pair<int, int>> *subtrees) {
+  if (begin >= end) {
+    return -1;
   }
-  if (x == -1) {
+  // Splits where the highest bit differing within the range turns to one,
+  // so that each side covers half of the cell along one axis. Ranges of
+  // equal codes split at their median.
+  int mid = (begin + end) >> 1;
+  uint32_t first_code = uint32_t(keys[begin] >> 32);
+  uint32_t last_code = uint32_t(keys[end - 1] >> 32);
+  if (first_code != last_code) {
+    uint32_t bit = 1u << (kMortonBits - 1);
+    while (!((first_code ^ last_code) & bit)) {
+      bit >>= 1;
+    }
+    mid = int(std::partition_point(keys.begin() + begin,
+                                   keys.begin() + end,
+                                   [bit](uint64_t key) {
+                                     return !(uint32_t(key >> 32) & bit);
+                                   }) -
+              keys.begin());
+  }
+  int x = int(uint32_t(keys[mid]));
+  if (!parallel_depth) {
+    if (subtrees) {
+      subtrees->emplace_back(begin, end);
+    }
+    return x;
+  }
+  auto &node = tree_node_[x];
+  node.child[0] =
+      LinkLinearTree(keys, begin, mid, parallel_depth - 1, subtrees);
+  node.child[1] =
+      LinkLinearTree(keys, mid + 1, end, parallel_depth - 1, subtrees);
+  if (!subtrees) {
+    for (int child : node.child) {
+      if (child != -1) {
+        node.aabb |= tree_node_[child].aabb;
+      }
+    }
+  }
+  return x;
+}
+
+bool AcceleratedMesh::Intersect(const Ray &ray, RayHit *hit) const {
+  Ray local_ray = ray;
+  bool found = false;
+  Intersect(root_, local_ray, hit, &found);
+  return found;
+}
+
+void AcceleratedMesh::Intersect(int x,
+                                Ray &ray,
+                                RayHit *hit,
+                                bool *found) const {
+  if (x == -1 || !tree_node_view_[x].aabb.IsIntersect(ray)) {
     return;
   }
-  float t_max = *result;
-  if (t_max < t_min) {
-    t_max = 1e10;
+  bool intersect;
+  if (compact_vertices_) {
+    auto p0 = compact_vertices_->GetPosition(index_view_[x * 3]);
+    auto p1 = compact_vertices_->GetPosition(index_view_[x * 3 + 1]);
+    auto p2 = compact_vertices_->GetPosition(index_view_[x * 3 + 2]);
+    intersect = IntersectTriangle(p0, p1 - p0, p2 - p0, x, ray, hit);
+  } else {
+    auto &triangle = triangle_position_view_[x];
+    intersect = IntersectTriangle(triangle.p0, triangle.edge1, triangle.edge2,
+                                  x, ray, hit);
   }
-  if (!tree_node_[x].aabb.IsIntersect(origin, direction, t_min, t_max)) {
+  if (intersect) {
+    ray.t_max = hit->t;
+    *found = true;
+  }
+  Intersect(tree_node_view_[x].child[0], ray, hit, found);
+  Intersect(tree_node_view_[x].child[1], ray, hit, found);
+}
+
+void AcceleratedMesh::EvaluateHit(const Ray &ray,
+                                  const RayHit &hit,
+                                  HitRecord *hit_record) const {
+  auto indices = index_view_.subspan(hit.primitive_id * 3, 3);
+  if (!compact_vertices_) {
+    EvaluateTriangleHit(vertex_view_[indices[0]], vertex_view_[indices[1]],
+                        vertex_view_[indices[2]], ray, hit, hit_record);
     return;
   }
-  do {
-    const auto &v0 = vertices_[indices_[x * 3]];
-    const auto &v1 = vertices_[indices_[x * 3 + 1]];
-    const auto &v2 = vertices_[indices_[x * 3 + 2]];
+  EvaluateTriangleHit(compact_vertices_->GetVertex(indices[0]),
+                      compact_vertices_->GetVertex(indices[1]),
+                      compact_vertices_->GetVertex(indices[2]), ray, hit,
+                      hit_record);
+}
 
-    glm::mat3 A = glm::mat3(v1.position - v0.position,
-                            v2.position - v0.position, -direction);
-    if (std::abs(glm::determinant(A)) < 1e-9f) {
-      break;
-    }
-    A = glm::inverse(A);
-    auto uvt = A * (origin - v0.position);
-    auto &t = uvt.z;
-    if (t < t_min || (*result > 0.0f && t > *result)) {
-      break;
-    }
-    auto &u = uvt.x;
-    auto &v = uvt.y;
-    auto w = 1.0f - u - v;
-    auto position = origin + t * direction;
-    if (u >= 0.0f && v >= 0.0f && u + v <= 1.0f) {
-      *result = t;
-      if (hit_record) {
-        auto geometry_normal = glm::normalize(
-            glm::cross(v1.position - v0.position, v2.position - v0.position));
-        if (glm::dot(geometry_normal, direction) < 0.0f) {
-          hit_record->position = position;
-          hit_record->geometry_normal = geometry_normal;
-          hit_record->normal = v0.normal * w + v1.normal * u + v2.normal * v;
-          hit_record->tangent =
-              v0.tangent * w + v1.tangent * u + v2.tangent * v;
-          hit_record->tex_coord =
-              v0.tex_coord * w + v1.tex_coord * u + v2.tex_coord * v;
-          hit_record->front_face = true;
-        } else {
-          hit_record->position = position;
-          hit_record->geometry_normal = -geometry_normal;
-          hit_record->normal = -(v0.normal * w + v1.normal * u + v2.normal * v);
-          hit_record->tangent =
-              -(v0.tangent * w + v1.tangent * u + v2.tangent * v);
-          hit_record->tex_coord =
-              v0.tex_coord * w + v1.tex_coord * u + v2.tex_coord * v;
-          hit_record->front_face = false;
-        }
-      }
+AxisAlignedBoundingBox AcceleratedMesh::GetAABB(
+    const glm::mat4 &transform) const {
+  auto vertex_count = uint32_t(compact_vertices_
+                                   ? compact_vertices_->GetVertexCount()
+                                   : vertex_view_.size());
+  if (!vertex_count) {
+    return {};
+  }
+  auto transformed_position = [&](uint32_t index) {
+    return glm::vec3{transform * glm::vec4{GetPosition(index), 1.0f}};
+  };
+  AxisAlignedBoundingBox result(transformed_position(0));
+  for (uint32_t i = 1; i < vertex_count; i++) {
+    result |= {transformed_position(i)};
+  }
+  return result;
+}
+
+Span<const uint32_t> AcceleratedMesh::GetPreviewIndexView() const {
+  if (preview_index_view_.empty()) {
+    return index_view_;
+  }
+  return preview_index_view_;
+}
+
+Span<const Vertex> AcceleratedMesh::GetVertexView() const {
+  return vertex_view_;
+}
+
+Span<const uint32_t> AcceleratedMesh::GetIndexView() const {
+  return index_view_;
+}
+
+std::vector<Vertex> AcceleratedMesh::GetVertices() const {
+  if (compact_vertices_) {
+    return compact_vertices_->GetVertices();
+  }
+  return Mesh::GetVertices();
+}
+
+void AcceleratedMesh::SetVertexFormat(VertexFormat format) {
+  if (format == GetVertexFormat()) {
+    return;
+  }
+  if (compact_vertices_) {
+    DetachCacheFile();
+    vertices_ = compact_vertices_->GetVertices();
+    compact_vertices_.reset();
+    UpdateViews();
+  }
+  if (format == VERTEX_FORMAT_FULL) {
+    BuildTrianglePositions();
+    UpdateViews();
+    return;
+  }
+  compact_vertices_ = std::make_shared<CompactVertices>(vertex_view_, format);
+  std::vector<Vertex>().swap(vertices_);
+  std::vector<detail::TrianglePositions>().swap(triangle_positions_);
+  vertex_view_ = {};
+  triangle_position_view_ = {};
+  if (format == VERTEX_FORMAT_QUANTIZED) {
+    DetachCacheFile();
+    RefitTree(root_);
+  }
+}
+
+VertexFormat AcceleratedMesh::GetVertexFormat() const {
+  return compact_vertices_ ? compact_vertices_->GetFormat()
+                           : VERTEX_FORMAT_FULL;
+}
+
+void AcceleratedMesh::RefitTree(int x) {
+  if (x == -1) {
+    return;
+  }
+  auto &node = tree_node_[x];
+  for (int i = 0; i < 3; i++) {
+    node.aabb |= {GetPosition(indices_[x * 3 + i])};
+  }
+  for (int child : node.child) {
+    if (child != -1) {
+      RefitTree(child);
+      node.aabb |= tree_node_[child].aabb;
     }
-  } while (false);
-  TraceRay(tree_node_[x].child[0], origin, direction, t_min, result, hit_record,
-           trace_cnt);
-  TraceRay(tree_node_[x].child[1], origin, direction, t_min, result, hit_record,
-           trace_cnt);
+  }
+}
+
+glm::vec3 AcceleratedMesh::GetPosition(uint32_t index) const {
+  return compact_vertices_ ? compact_vertices_->GetPosition(index)
+                           : vertex_view_[index].position;
+}
+
+void AcceleratedMesh::UpdateViews() {
+  if (cache_file_) {
+    return;
+  }
+  vertex_view_ = vertices_;
+  index_view_ = indices_;
+  tree_node_view_ = tree_node_;
+  triangle_position_view_ = triangle_positions_;
+  preview_index_view_ = preview_indices_;
+}
+
+void AcceleratedMesh::DetachCacheFile() {
+  if (cache_file_) {
+    vertices_.assign(vertex_view_.begin(), vertex_view_.end());
+    indices_.assign(index_view_.begin(), index_view_.end());
+    tree_node_.assign(tree_node_view_.begin(), tree_node_view_.end());
+    triangle_positions_.assign(triangle_position_view_.begin(),
+                               triangle_position_view_.end());
+    preview_indices_.assign(preview_index_view_.begin(),
+                            preview_index_view_.end());
+    cache_file_.reset();
+  }
+  UpdateViews();
 }
 
 }  // namespace sparks
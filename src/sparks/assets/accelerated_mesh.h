@@ -1,42 +1,145 @@
 #pragma once
+#include "memory"
 #include "sparks/assets/aabb.h"
+#include "sparks/assets/compact_vertex.h"
 #include "sparks/assets/mesh.h"
+#include "sparks/util/mapped_file.h"
 
 namespace sparks {
 
-namespace {
+// Storage types of AcceleratedMesh, shared with the MeshCache layout.
+namespace detail {
 struct TreeNode {
   AxisAlignedBoundingBox aabb{};
   int child[2]{-1, -1};
 };
-}  // namespace
 
+// Corner and edges of a triangle, all the triangle test reads.
+struct TrianglePositions {
+  glm::vec3 p0{};
+  glm::vec3 edge1{};
+  glm::vec3 edge2{};
+};
+}  // namespace detail
+
+// Ordered from the fastest build to the fastest traversal.
+enum BvhBuildQuality {
+  // Linear BVH of Lauterbach et al., "Fast BVH Construction on GPUs": the
+  // triangles are radix sorted by the Morton code of their centroid in
+  // parallel and split at the bits of the codes, for interactive loads.
+  BVH_BUILD_QUALITY_FAST = 0,
+  // Median splits along alternating axes, sorting every range on the way.
+  BVH_BUILD_QUALITY_HIGH = 1,
+  // The high quality tree improved by OptimizeAccelerationStructure, for
+  // assets rendered long enough to pay for it.
+  BVH_BUILD_QUALITY_OPTIMIZED = 2
+};
+
+// Parses "fast", "high" or "optimized", anything else is high.
+BvhBuildQuality StringToBvhBuildQuality(const std::string &name);
+
+// A mesh loaded by MeshCache reads its arrays straight out of the mapped
+// cache file, its vertices_ and indices_ stay empty until an edit copies the
+// arrays out. The Mesh functions editing or writing vertices_ need a mesh
+// built in memory.
 class AcceleratedMesh : public Mesh {
  public:
   AcceleratedMesh() = default;
+  AcceleratedMesh(const AcceleratedMesh &mesh);
+  AcceleratedMesh(AcceleratedMesh &&mesh) noexcept = default;
   explicit AcceleratedMesh(const Mesh &mesh);
-  AcceleratedMesh(const std::vector<Vertex> &vertices,
-                  const std::vector<uint32_t> &indices);
-  float TraceRay(const glm::vec3 &origin,
-                 const glm::vec3 &direction,
-                 float t_min,
-                 HitRecord *hit_record) const override;
-  void BuildAccelerationStructure();
+  explicit AcceleratedMesh(Mesh &&mesh);
+  AcceleratedMesh(std::vector<Vertex> vertices, std::vector<uint32_t> indices);
+  AcceleratedMesh &operator=(const AcceleratedMesh &mesh);
+  AcceleratedMesh &operator=(AcceleratedMesh &&mesh) noexcept = default;
+  [[nodiscard]] bool Intersect(const Ray &ray, RayHit *hit) const override;
+  void EvaluateHit(const Ray &ray,
+                   const RayHit &hit,
+                   HitRecord *hit_record) const override;
+  [[nodiscard]] AxisAlignedBoundingBox GetAABB(
+      const glm::mat4 &transform) const override;
+  // Empty unless the vertex format is full.
+  [[nodiscard]] Span<const Vertex> GetVertexView() const override;
+  [[nodiscard]] Span<const uint32_t> GetIndexView() const override;
+  [[nodiscard]] Span<const uint32_t> GetPreviewIndexView() const override;
+  [[nodiscard]] std::vector<Vertex> GetVertices() const override;
+  // Builds the tree, then renumbers the triangles in the depth first order
+  // of the traversal and the vertices in the order of first use, so that
+  // both are read mostly sequentially. Primitive ids change.
+  void BuildAccelerationStructure(
+      BvhBuildQuality quality = BVH_BUILD_QUALITY_HIGH);
+  // Lowers the surface area heuristic cost of the built tree with the tree
+  // rotations of Kensler, "Tree Rotations for Improving Bounding Volume
+  // Hierarchies", swapping subtrees with their cousins and nodes with their
+  // children. Disjoint subtrees are rotated on the ThreadPool. Renumbers
+  // like BuildAccelerationStructure, the vertices only in the full format.
+  void OptimizeAccelerationStructure();
+  [[nodiscard]] BvhBuildQuality GetBvhQuality() const;
+
+  // Converts the vertices to the format after the acceleration structure is
+  // built. The compact formats drop vertices_ and the packed triangle
+  // positions, traversal then gathers the positions through the indices and
+  // hits decode their vertices. The Mesh functions editing or writing
+  // vertices_ need the full format.
+  void SetVertexFormat(VertexFormat format);
+  [[nodiscard]] VertexFormat GetVertexFormat() const;
 
  private:
+  friend class MeshCache;
+
   void BuildTree(int &x,
                  std::pair<int, glm::vec3> *triangle_list,
                  int L,
                  int R,
                  int cut = 0);
-  void TraceRay(int x,
-                const glm::vec3 &origin,
-                const glm::vec3 &direction,
-                float t_min,
-                float *t,
-                HitRecord *hit_record,
-                int *trace_cnt) const;
+  void BuildLinearTree();
+  // Links the nodes of the triangles keys[begin, end), sorted by Morton
+  // code, and returns the root of the range. Ranges deeper than
+  // parallel_depth are collected into subtrees instead, their roots are
+  // linked but not built.
+  int LinkLinearTree(const std::vector<uint64_t> &keys,
+                     int begin,
+                     int end,
+                     int parallel_depth,
+                     std::vector<std::pair<int, int>> *subtrees);
+  // Rotates the subtree of x bottom up and returns its new root, which has
+  // the same bounds. Nodes depth_limit levels down are left as they are,
+  // a negative limit rotates the whole subtree.
+  int RotateSubtree(int x,
+                    int depth_limit,
+                    const std::vector<AxisAlignedBoundingBox> &triangle_aabbs);
+  // Renumbers the built tree and derives the traversal and preview data.
+  void FinishTree();
+  // Shrinks ray.t_max to each hit found so far.
+  void Intersect(int x, Ray &ray, RayHit *hit, bool *found) const;
+  void ReorderToTree();
+  void BuildTrianglePositions();
+  // Grows the bounds of the subtree of x to its triangles as decoded.
+  void RefitTree(int x);
+  [[nodiscard]] glm::vec3 GetPosition(uint32_t index) const;
+  // Points the views at the members unless they are mapped.
+  void UpdateViews();
+  // Copies the mapped arrays into the members before they are edited, the
+  // views point at the members afterwards.
+  void DetachCacheFile();
   int root_{-1};
-  std::vector<TreeNode> tree_node_;
+  std::vector<detail::TreeNode> tree_node_;
+  BvhBuildQuality bvh_quality_{BVH_BUILD_QUALITY_HIGH};
+  // Packed copy of the triangle positions for traversal, which would
+  // otherwise gather them through indices_ out of the full vertices_.
+  std::vector<detail::TrianglePositions> triangle_positions_;
+  // Optimized for the vertex cache of the rasterizer.
+  std::vector<uint32_t> preview_indices_;
+  // Holds the vertices unless the format is full, shared between copies.
+  std::shared_ptr<const CompactVertices> compact_vertices_;
+
+  // The arrays all reads go through, either the members above or the
+  // mapping of the cache file, which copies share.
+  std::shared_ptr<const MappedFile> cache_file_;
+  Span<const Vertex> vertex_view_;
+  Span<const uint32_t> index_view_;
+  Span<const detail::TreeNode> tree_node_view_;
+  Span<const detail::TrianglePositions> triangle_position_view_;
+  Span<const uint32_t> preview_index_view_;
 };
 }  // namespace sparks
@@ -0,0 +1,127 @@
+#include "sparks/assets/alias_table.h"
+
+#include "algorithm"
+
+namespace sparks {
+
+AliasTable::AliasTable(const std::vector<float> &weights) {
+  Build(weights);
+}
+
+void AliasTable::Build(const std::vector<float> &weights) {
+  entries_.resize(weights.size());
+  pdf_.resize(weights.size());
+  total_weight_ = BuildEntries(weights.data(), weights.size(), entries_.data());
+  float inv_total_weight =
+      total_weight_ > 0.0f ? 1.0f / total_weight_ : 0.0f;
+  for (size_t i = 0; i < weights.size(); i++) {
+    pdf_[i] = weights[i] * inv_total_weight;
+  }
+}
+
+int AliasTable::Sample(float r, float *remapped_r) const {
+  return SampleEntries(entries_.data(), entries_.size(), r, remapped_r);
+}
+
+float AliasTable::GetPdf(int index) const {
+  return pdf_[index];
+}
+
+float AliasTable::GetTotalWeight() const {
+  return total_weight_;
+}
+
+int AliasTable::GetSize() const {
+  return int(entries_.size());
+}
+
+bool AliasTable::Empty() const {
+  return entries_.empty();
+}
+
+const std::vector<AliasEntry> &AliasTable::GetEntries() const {
+  return entries_;
+}
+
+float AliasTable::BuildEntries(const float *weights,
+                               size_t n,
+                               AliasEntry *entries) {
+  double total_weight = 0.0;
+  for (size_t i = 0; i < n; i++) {
+    total_weight += std::max(weights[i], 0.0f);
+  }
+  if (total_weight <= 0.0) {
+    for (size_t i = 0; i < n; i++) {
+      entries[i] = {1.0f, int(i)};
+    }
+    return 0.0f;
+  }
+
+  std::vector<double> scaled(n);
+  std::vector<size_t> small;
+  std::vector<size_t> large;
+  double scale = double(n) / total_weight;
+  size_t any_positive = 0;
+  for (size_t i = 0; i < n; i++) {
+    scaled[i] = double(std::max(weights[i], 0.0f)) * scale;
+    if (scaled[i] > 0.0) {
+      any_positive = i;
+    }
+    if (scaled[i] < 1.0) {
+      small.push_back(i);
+    } else {
+      large.push_back(i);
+    }
+  }
+
+  while (!small.empty() && !large.empty()) {
+    auto s = small.back();
+    small.pop_back();
+    auto l = large.back();
+    large.pop_back();
+    entries[s] = {float(scaled[s]), int(l)};
+    scaled[l] = (scaled[l] + scaled[s]) - 1.0;
+    if (scaled[l] < 1.0) {
+      small.push_back(l);
+    } else {
+      large.push_back(l);
+    }
+  }
+
+  // Whatever is left only misses 1.0 by rounding error, except for
+  // zero-weight entries which must stay unreachable.
+  for (auto l : large) {
+    entries[l] = {1.0f, int(l)};
+  }
+  for (auto s : small) {
+    if (scaled[s] > 0.0) {
+      entries[s] = {1.0f, int(s)};
+    } else {
+      entries[s] = {0.0f, int(any_positive)};
+    }
+  }
+  return float(total_weight);
+}
+
+int AliasTable::SampleEntries(const AliasEntry *entries,
+                              size_t n,
+                              float r,
+                              float *remapped_r) {
+  float x = r * float(n);
+  int index = std::min(int(x), int(n) - 1);
+  float u = std::min(x - float(index), 0.99999994f);
+  const auto &entry = entries[index];
+  if (u < entry.prob) {
+    if (remapped_r) {
+      *remapped_r = u / entry.prob;
+    }
+    return index;
+  }
+  if (remapped_r) {
+    *remapped_r =
+        std::min((u - entry.prob) / (1.0f - entry.prob), 0.99999994f);
+  }
+  return entry.alias;
+}
+
+}  // namespace sparks
@@ -0,0 +1,41 @@
+#pragma once
+#include "cstddef"
+#include "vector"
+
+namespace sparks {
+
+struct AliasEntry {
+  float prob{1.0f};
+  int alias{0};
+};
+
+class AliasTable {
+ public:
+  AliasTable() = default;
+  explicit AliasTable(const std::vector<float> &weights);
+  void Build(const std::vector<float> &weights);
+  [[nodiscard]] int Sample(float r, float *remapped_r = nullptr) const;
+  [[nodiscard]] float GetPdf(int index) const;
+  [[nodiscard]] float GetTotalWeight() const;
+  [[nodiscard]] int GetSize() const;
+  [[nodiscard]] bool Empty() const;
+  [[nodiscard]] const std::vector<AliasEntry> &GetEntries() const;
+
+  // Builds Walker's alias table for weights[0..n) into entries[0..n) with
+  // Vose's method, returns the total weight. Zero-weight entries are never
+  // selected. This form allows the tables to be packed into flat arrays.
+  static float BuildEntries(const float *weights,
+                            size_t n,
+                            AliasEntry *entries);
+  static int SampleEntries(const AliasEntry *entries,
+                           size_t n,
+                           float r,
+                           float *remapped_r = nullptr);
+
+ private:
+  std::vector<AliasEntry> entries_;
+  std::vector<float> pdf_;
+  float total_weight_{0.0f};
+};
+
+}  // namespace sparks
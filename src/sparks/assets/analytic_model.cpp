@@ -0,0 +1,43 @@
+#include "sparks/assets/analytic_model.h"
+
+namespace sparks {
+
+AnalyticModel::AnalyticModel(const AnalyticModel &model) : Model(model) {
+}
+
+AnalyticModel &AnalyticModel::operator=(const AnalyticModel & /*model*/) {
+  ResetTessellation();
+  return *this;
+}
+
+Span<const Vertex> AnalyticModel::GetVertexView() const {
+  return GetTessellation().vertices;
+}
+
+Span<const uint32_t> AnalyticModel::GetIndexView() const {
+  return GetTessellation().indices;
+}
+
+glm::vec3 AnalyticModel::TransformNormal(const glm::mat3 &linear,
+                                         const glm::vec3 &normal) {
+  return glm::cross(linear[1], linear[2]) * normal.x +
+         glm::cross(linear[2], linear[0]) * normal.y +
+         glm::cross(linear[0], linear[1]) * normal.z;
+}
+
+void AnalyticModel::ResetTessellation() {
+  std::lock_guard<std::mutex> lock(tessellation_mutex_);
+  tessellation_.reset();
+}
+
+const AnalyticModel::Tessellation &AnalyticModel::GetTessellation() const {
+  std::lock_guard<std::mutex> lock(tessellation_mutex_);
+  if (!tessellation_) {
+    auto tessellation = std::make_unique<Tessellation>();
+    Tessellate(tessellation->vertices, tessellation->indices);
+    tessellation_ = std::move(tessellation);
+  }
+  return *tessellation_;
+}
+
+}  // namespace sparks
@@ -0,0 +1,59 @@
+#pragma once
+#include "memory"
+#include "mutex"
+#include "sparks/assets/model.h"
+#include "vector"
+
+namespace sparks {
+
+// Model intersected exactly, whose triangles are only a tessellation built
+// on first request for the raster preview, the hardware renderer and the
+// light BVH. Primitive i of the index view stands for a patch of the exact
+// surface, which is what the light sampler samples for emitters and what
+// TraceRay reports as primitive_id.
+class AnalyticModel : public Model {
+ public:
+  AnalyticModel() = default;
+  AnalyticModel(const AnalyticModel &model);
+  AnalyticModel &operator=(const AnalyticModel &model);
+  ~AnalyticModel() override = default;
+
+  [[nodiscard]] Span<const Vertex> GetVertexView() const override;
+  [[nodiscard]] Span<const uint32_t> GetIndexView() const override;
+
+  // Uniformly samples a model space point and its outward unit normal on the
+  // patch of the primitive.
+  virtual void SamplePatch(int primitive_id,
+                           float r1,
+                           float r2,
+                           glm::vec3 *position,
+                           glm::vec3 *normal) const = 0;
+  // Area of the patch after the linear part of a transform. Curved patches
+  // are scaled at their center, which is exact for similarity transforms.
+  [[nodiscard]] virtual float GetPatchArea(int primitive_id,
+                                           const glm::mat3 &linear) const = 0;
+
+  // Cofactor matrix of linear applied to normal: the direction of the
+  // transformed normal, with a length equal to the area scale of a surface
+  // element perpendicular to it.
+  static glm::vec3 TransformNormal(const glm::mat3 &linear,
+                                   const glm::vec3 &normal);
+
+ protected:
+  virtual void Tessellate(std::vector<Vertex> &vertices,
+                          std::vector<uint32_t> &indices) const = 0;
+
+ private:
+  struct Tessellation {
+    std::vector<Vertex> vertices;
+    std::vector<uint32_t> indices;
+  };
+
+  const Tessellation &GetTessellation() const;
+  void ResetTessellation();
+
+  mutable std::mutex tessellation_mutex_;
+  mutable std::unique_ptr<Tessellation> tessellation_;
+};
+
+}  // namespace sparks
@@ -1,2 +1,3 @@
 #pragma once
+#include "sparks/assets/mesh_cache.h"
 #include "sparks/assets/scene.h"
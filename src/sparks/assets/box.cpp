@@ -0,0 +1,105 @@
+#include "sparks/assets/box.h"
+
+namespace sparks {
+
+Box::Box(const glm::vec3 &center, const glm::vec3 &size) {
+  BuildFaces(center, size);
+}
+
+Box::Box(const tinyxml2::XMLElement *element) {
+  glm::vec3 center{0.0f};
+  glm::vec3 size{2.0f};
+  auto child_element = element->FirstChildElement("center");
+  if (child_element) {
+    center = StringToVec3(child_element->FindAttribute("value")->Value());
+  }
+  child_element = element->FirstChildElement("size");
+  if (child_element) {
+    size = StringToVec3(child_element->FindAttribute("value")->Value());
+  }
+  BuildFaces(center, size);
+}
+
+void Box::BuildFaces(const glm::vec3 &center, const glm::vec3 &size) {
+  auto half_size = size * 0.5f;
+  for (int face = 0; face < 6; face++) {
+    int axis = face / 2;
+    float side = face % 2 ? -1.0f : 1.0f;
+    // edge_u x edge_v points along the outward normal.
+    int u_axis = (axis + 1) % 3;
+    int v_axis = (axis + 2) % 3;
+    if (side < 0.0f) {
+      std::swap(u_axis, v_axis);
+    }
+    glm::vec3 edge_u{0.0f};
+    glm::vec3 edge_v{0.0f};
+    edge_u[u_axis] = size[u_axis];
+    edge_v[v_axis] = size[v_axis];
+    auto corner = center - half_size;
+    corner[axis] = center[axis] + half_size[axis] * side;
+    faces_[face] = Quad(corner, edge_u, edge_v);
+  }
+}
+
+bool Box::Intersect(const Ray &ray, RayHit *hit) const {
+  // Each hit shortens the ray, so the faces behind it are rejected early.
+  Ray face_ray = ray;
+  bool found = false;
+  for (int face = 0; face < 6; face++) {
+    if (faces_[face].Intersect(face_ray, hit)) {
+      hit->primitive_id += face * 2;
+      face_ray.t_max = hit->t;
+      found = true;
+    }
+  }
+  return found;
+}
+
+void Box::EvaluateHit(const Ray &ray,
+                      const RayHit &hit,
+                      HitRecord *hit_record) const {
+  RayHit face_hit = hit;
+  face_hit.primitive_id = hit.primitive_id % 2;
+  faces_[hit.primitive_id / 2].EvaluateHit(ray, face_hit, hit_record);
+  hit_record->primitive_id = hit.primitive_id;
+}
+
+AxisAlignedBoundingBox Box::GetAABB(const glm::mat4 &transform) const {
+  // The +x and -x faces hold all eight corners.
+  return faces_[0].GetAABB(transform) | faces_[1].GetAABB(transform);
+}
+
+const char *Box::GetDefaultEntityName() const {
+  return "Box";
+}
+
+void Box::SamplePatch(int primitive_id,
+                      float r1,
+                      float r2,
+                      glm::vec3 *position,
+                      glm::vec3 *normal) const {
+  faces_[primitive_id / 2].SamplePatch(primitive_id % 2, r1, r2, position,
+                                       normal);
+}
+
+float Box::GetPatchArea(int primitive_id, const glm::mat3 &linear) const {
+  return faces_[primitive_id / 2].GetPatchArea(primitive_id % 2, linear);
+}
+
+void Box::Tessellate(std::vector<Vertex> &vertices,
+                     std::vector<uint32_t> &indices) const {
+  vertices.clear();
+  indices.clear();
+  for (auto &face : faces_) {
+    auto offset = uint32_t(vertices.size());
+    auto face_vertices = face.GetVertexView();
+    auto face_indices = face.GetIndexView();
+    vertices.insert(vertices.end(), face_vertices.begin(),
+                    face_vertices.end());
+    for (auto index : face_indices) {
+      indices.push_back(index + offset);
+    }
+  }
+}
+
+}  // namespace sparks
@@ -0,0 +1,39 @@
+#pragma once
+#include "array"
+#include "sparks/assets/quad.h"
+
+namespace sparks {
+
+// Axis aligned box made of six outward facing quads, ordered +x, -x, +y, -y,
+// +z, -z. Primitive face * 2 + i is primitive i of the face.
+class Box : public AnalyticModel {
+ public:
+  explicit Box(const glm::vec3 &center = glm::vec3{0.0f},
+               const glm::vec3 &size = glm::vec3{2.0f});
+  explicit Box(const tinyxml2::XMLElement *element);
+  [[nodiscard]] bool Intersect(const Ray &ray, RayHit *hit) const override;
+  void EvaluateHit(const Ray &ray,
+                   const RayHit &hit,
+                   HitRecord *hit_record) const override;
+  [[nodiscard]] AxisAlignedBoundingBox GetAABB(
+      const glm::mat4 &transform) const override;
+  const char *GetDefaultEntityName() const override;
+  void SamplePatch(int primitive_id,
+                   float r1,
+                   float r2,
+                   glm::vec3 *position,
+                   glm::vec3 *normal) const override;
+  [[nodiscard]] float GetPatchArea(int primitive_id,
+                                   const glm::mat3 &linear) const override;
+
+ protected:
+  void Tessellate(std::vector<Vertex> &vertices,
+                  std::vector<uint32_t> &indices) const override;
+
+ private:
+  void BuildFaces(const glm::vec3 &center, const glm::vec3 &size);
+
+  std::array<Quad, 6> faces_;
+};
+
+}  // namespace sparks
@@ -13,6 +13,11 @@ glm::mat4 Camera::GetProjectionMatrix(float aspect,
          glm::perspectiveZO(glm::radians(fov_), aspect, t_min, t_max);
 }
 
+float Camera::GetPixelSpreadAngle(int height) const {
+  return std::atan(2.0f * std::tan(glm::radians(fov_ * 0.5f)) /
+                   float(std::max(height, 1)));
+}
+
 bool Camera::ImGuiItems() {
   bool value_changed = false;
   value_changed |= ImGui::SliderFloat("FOV", &fov_, 1.0f, 160.0f, "%.0f", 0);
@@ -17,6 +17,9 @@ class Camera {
                    float rand_v = 0.0f,
                    float rand_w = 0.0f,
                    float rand_r = 0.0f) const;
+  // Angle subtended by a pixel of an image with the given height, the spread
+  // of the ray cones traced from the camera.
+  [[nodiscard]] float GetPixelSpreadAngle(int height) const;
   bool ImGuiItems();
   void UpdateFov(float delta);
   [[nodiscard]] float GetFov() const {
@@ -0,0 +1,139 @@
+#include "sparks/assets/compact_vertex.h"
+
+#include "algorithm"
+
+namespace sparks {
+
+namespace {
+constexpr float kTangentScale = 32767.0f;
+constexpr uint32_t kTangentMask = 0x7fffu;
+constexpr uint32_t kSignalBit = 0x80000000u;
+
+glm::vec2 OctahedralEncode(const glm::vec3 &direction) {
+  float l1 = std::abs(direction.x) + std::abs(direction.y) +
+             std::abs(direction.z);
+  if (l1 <= 0.0f) {
+    return glm::vec2{0.0f};
+  }
+  glm::vec2 p = glm::vec2{direction.x, direction.y} / l1;
+  if (direction.z < 0.0f) {
+    // Folds the lower hemisphere over the diagonals of the square.
+    p = glm::vec2{(1.0f - std::abs(p.y)) * (p.x >= 0.0f ? 1.0f : -1.0f),
+                  (1.0f - std::abs(p.x)) * (p.y >= 0.0f ? 1.0f : -1.0f)};
+  }
+  return p;
+}
+
+glm::vec3 OctahedralDecode(const glm::vec2 &p) {
+  glm::vec3 direction{p.x, p.y, 1.0f - std::abs(p.x) - std::abs(p.y)};
+  float fold = std::max(-direction.z, 0.0f);
+  direction.x += direction.x >= 0.0f ? -fold : fold;
+  direction.y += direction.y >= 0.0f ? -fold : fold;
+  return glm::normalize(direction);
+}
+
+uint32_t PackTangent(const glm::vec3 &tangent, float signal) {
+  auto p = glm::clamp(OctahedralEncode(tangent) * 0.5f + 0.5f, 0.0f, 1.0f);
+  uint32_t x = uint32_t(std::lround(p.x * kTangentScale));
+  uint32_t y = uint32_t(std::lround(p.y * kTangentScale));
+  return x | (y << 15) | (signal < 0.0f ? kSignalBit : 0u);
+}
+
+void UnpackTangent(uint32_t packed, glm::vec3 *tangent, float *signal) {
+  glm::vec2 p{float(packed & kTangentMask),
+              float((packed >> 15) & kTangentMask)};
+  *tangent = OctahedralDecode(p * (2.0f / kTangentScale) - 1.0f);
+  *signal = packed & kSignalBit ? -1.0f : 1.0f;
+}
+}  // namespace
+
+VertexFormat StringToVertexFormat(const std::string &name) {
+  if (name == "compact") {
+    return VERTEX_FORMAT_COMPACT;
+  } else if (name == "quantized") {
+    return VERTEX_FORMAT_QUANTIZED;
+  }
+  return VERTEX_FORMAT_FULL;
+}
+
+CompactVertices::CompactVertices(Span<const Vertex> vertices,
+                                 VertexFormat format)
+    : format_(format) {
+  attributes_.resize(vertices.size());
+  for (size_t i = 0; i < vertices.size(); i++) {
+    auto &vertex = vertices[i];
+    auto &attributes = attributes_[i];
+    attributes.normal = glm::packSnorm2x16(OctahedralEncode(vertex.normal));
+    attributes.tangent = PackTangent(vertex.tangent, vertex.signal);
+    attributes.tex_coord = glm::packHalf2x16(vertex.tex_coord);
+  }
+
+  if (format_ != VERTEX_FORMAT_QUANTIZED) {
+    positions_.resize(vertices.size());
+    for (size_t i = 0; i < vertices.size(); i++) {
+      positions_[i] = vertices[i].position;
+    }
+    return;
+  }
+  if (vertices.empty()) {
+    return;
+  }
+  glm::vec3 low = vertices[0].position;
+  glm::vec3 high = vertices[0].position;
+  for (auto &vertex : vertices) {
+    low = glm::min(low, vertex.position);
+    high = glm::max(high, vertex.position);
+  }
+  quantization_origin_ = low;
+  quantization_scale_ = (high - low) / 65535.0f;
+  quantized_positions_.resize(vertices.size());
+  for (size_t i = 0; i < vertices.size(); i++) {
+    for (int axis = 0; axis < 3; axis++) {
+      float scale = quantization_scale_[axis];
+      float offset = vertices[i].position[axis] - low[axis];
+      quantized_positions_[i].position[axis] =
+          scale > 0.0f
+              ? uint16_t(std::min(std::lround(offset / scale), 65535l))
+              : 0;
+    }
+  }
+}
+
+VertexFormat CompactVertices::GetFormat() const {
+  return format_;
+}
+
+size_t CompactVertices::GetVertexCount() const {
+  return attributes_.size();
+}
+
+glm::vec3 CompactVertices::GetPosition(uint32_t index) const {
+  if (format_ != VERTEX_FORMAT_QUANTIZED) {
+    return positions_[index];
+  }
+  auto &quantized = quantized_positions_[index].position;
+  return quantization_origin_ +
+         glm::vec3{float(quantized[0]), float(quantized[1]),
+                   float(quantized[2])} *
+             quantization_scale_;
+}
+
+Vertex CompactVertices::GetVertex(uint32_t index) const {
+  auto &attributes = attributes_[index];
+  Vertex vertex;
+  vertex.position = GetPosition(index);
+  vertex.normal = OctahedralDecode(glm::unpackSnorm2x16(attributes.normal));
+  UnpackTangent(attributes.tangent, &vertex.tangent, &vertex.signal);
+  vertex.tex_coord = glm::unpackHalf2x16(attributes.tex_coord);
+  return vertex;
+}
+
+std::vector<Vertex> CompactVertices::GetVertices() const {
+  std::vector<Vertex> vertices(GetVertexCount());
+  for (size_t i = 0; i < vertices.size(); i++) {
+    vertices[i] = GetVertex(uint32_t(i));
+  }
+  return vertices;
+}
+
+}  // namespace sparks
@@ -0,0 +1,63 @@
+#pragma once
+#include "sparks/assets/vertex.h"
+#include "sparks/util/span.h"
+#include "string"
+#include "vector"
+
+namespace sparks {
+
+enum VertexFormat {
+  // Vertex as is, 48 bytes.
+  VERTEX_FORMAT_FULL = 0,
+  // Float positions and compact attributes, 24 bytes.
+  VERTEX_FORMAT_COMPACT = 1,
+  // Positions quantized to the bounds of the mesh and compact attributes,
+  // 18 bytes.
+  VERTEX_FORMAT_QUANTIZED = 2
+};
+
+// Parses "full", "compact" or "quantized", anything else is full.
+VertexFormat StringToVertexFormat(const std::string &name);
+
+// The shading attributes of a Vertex in 12 bytes. Unit vectors are stored
+// in the octahedral mapping of Cigolle et al., "A Survey of Efficient
+// Representations for Independent Unit Vectors".
+struct CompactAttributes {
+  // Two 16 bit snorm octahedral coordinates.
+  uint32_t normal{};
+  // Two 15 bit unorm octahedral coordinates, the top bit holds the sign of
+  // Vertex::signal.
+  uint32_t tangent{};
+  // Half floats.
+  uint32_t tex_coord{};
+};
+
+struct QuantizedPosition {
+  uint16_t position[3]{};
+};
+
+// Immutable vertex array stored in a compact format. Positions decode on
+// their own for intersection, whole vertices for hit evaluation.
+class CompactVertices {
+ public:
+  CompactVertices(Span<const Vertex> vertices, VertexFormat format);
+
+  [[nodiscard]] VertexFormat GetFormat() const;
+  [[nodiscard]] size_t GetVertexCount() const;
+  [[nodiscard]] glm::vec3 GetPosition(uint32_t index) const;
+  [[nodiscard]] Vertex GetVertex(uint32_t index) const;
+  // All vertices decoded into a new array the caller owns, nothing is kept
+  // around.
+  [[nodiscard]] std::vector<Vertex> GetVertices() const;
+
+ private:
+  VertexFormat format_;
+  std::vector<CompactAttributes> attributes_;
+  // One of the two holds the positions, depending on the format.
+  std::vector<glm::vec3> positions_;
+  std::vector<QuantizedPosition> quantized_positions_;
+  glm::vec3 quantization_origin_{0.0f};
+  glm::vec3 quantization_scale_{0.0f};
+};
+
+}  // namespace sparks
@@ -0,0 +1,138 @@
+#include "sparks/assets/disk.h"
+
+#include "algorithm"
+
+namespace sparks {
+
+namespace {
+constexpr int kDiskSegments = 32;
+constexpr float kSegmentAngle = 2.0f * PI / float(kDiskSegments);
+}  // namespace
+
+Disk::Disk(const glm::vec3 &center, const glm::vec3 &normal, float radius)
+    : center_(center), normal_(glm::normalize(normal)), radius_(radius) {
+  BuildFrame();
+}
+
+Disk::Disk(const tinyxml2::XMLElement *element) {
+  auto child_element = element->FirstChildElement("center");
+  if (child_element) {
+    center_ = StringToVec3(child_element->FindAttribute("value")->Value());
+  }
+  child_element = element->FirstChildElement("normal");
+  if (child_element) {
+    normal_ = glm::normalize(
+        StringToVec3(child_element->FindAttribute("value")->Value()));
+  }
+  child_element = element->FirstChildElement("radius");
+  if (child_element) {
+    radius_ = std::stof(child_element->FindAttribute("value")->Value());
+  }
+  BuildFrame();
+}
+
+void Disk::BuildFrame() {
+  tangent_ = std::abs(normal_.x) > 0.5f ? glm::vec3{0.0f, 1.0f, 0.0f}
+                                        : glm::vec3{1.0f, 0.0f, 0.0f};
+  tangent_ = glm::normalize(glm::cross(tangent_, normal_));
+  bitangent_ = glm::cross(normal_, tangent_);
+}
+
+bool Disk::Intersect(const Ray &ray, RayHit *hit) const {
+  float cos_direction = glm::dot(ray.direction, normal_);
+  if (std::abs(cos_direction) < 1e-9f) {
+    return false;
+  }
+  float t = glm::dot(center_ - ray.origin, normal_) / cos_direction;
+  if (t < ray.t_min || t > ray.t_max) {
+    return false;
+  }
+  auto offset = ray.At(t) - center_;
+  float x = glm::dot(offset, tangent_);
+  float y = glm::dot(offset, bitangent_);
+  if (x * x + y * y > radius_ * radius_) {
+    return false;
+  }
+  // uv holds the position in the tangent frame, the sector follows from it.
+  hit->t = t;
+  hit->primitive_id = 0;
+  hit->uv = {x, y};
+  return true;
+}
+
+void Disk::EvaluateHit(const Ray &ray,
+                       const RayHit &hit,
+                       HitRecord *hit_record) const {
+  float x = hit.uv.x;
+  float y = hit.uv.y;
+  float phi = std::atan2(y, x);
+  if (phi < 0.0f) {
+    phi += 2.0f * PI;
+  }
+  hit_record->primitive_id =
+      std::min(int(phi / kSegmentAngle), kDiskSegments - 1);
+  hit_record->position = ray.At(hit.t);
+  hit_record->tex_coord = glm::vec2{x, y} * (0.5f / radius_) + 0.5f;
+  hit_record->dpdu = tangent_ * (2.0f * radius_);
+  hit_record->dpdv = bitangent_ * (2.0f * radius_);
+  hit_record->front_face = glm::dot(ray.direction, normal_) < 0.0f;
+  float side = hit_record->front_face ? 1.0f : -1.0f;
+  hit_record->geometry_normal = normal_ * side;
+  hit_record->normal = normal_ * side;
+  hit_record->tangent = tangent_ * side;
+}
+
+AxisAlignedBoundingBox Disk::GetAABB(const glm::mat4 &transform) const {
+  glm::mat3 linear{transform};
+  glm::vec3 center = transform * glm::vec4{center_, 1.0f};
+  auto tangent = linear * tangent_;
+  auto bitangent = linear * bitangent_;
+  auto extent = glm::sqrt(tangent * tangent + bitangent * bitangent) * radius_;
+  return {center.x - extent.x, center.x + extent.x, center.y - extent.y,
+          center.y + extent.y, center.z - extent.z, center.z + extent.z};
+}
+
+const char *Disk::GetDefaultEntityName() const {
+  return "Disk";
+}
+
+void Disk::SamplePatch(int primitive_id,
+                       float r1,
+                       float r2,
+                       glm::vec3 *position,
+                       glm::vec3 *normal) const {
+  float radius = radius_ * std::sqrt(r1);
+  float phi = (float(primitive_id) + r2) * kSegmentAngle;
+  *position =
+      center_ +
+      (tangent_ * std::cos(phi) + bitangent_ * std::sin(phi)) * radius;
+  *normal = normal_;
+}
+
+float Disk::GetPatchArea(int /*primitive_id*/, const glm::mat3 &linear) const {
+  return 0.5f * radius_ * radius_ * kSegmentAngle *
+         glm::length(TransformNormal(linear, normal_));
+}
+
+void Disk::Tessellate(std::vector<Vertex> &vertices,
+                      std::vector<uint32_t> &indices) const {
+  vertices.clear();
+  indices.clear();
+  Vertex center_vertex(center_, normal_, glm::vec2{0.5f});
+  center_vertex.tangent = tangent_;
+  vertices.push_back(center_vertex);
+  for (int i = 0; i < kDiskSegments; i++) {
+    float phi = float(i) * kSegmentAngle;
+    glm::vec2 xy{std::cos(phi), std::sin(phi)};
+    Vertex vertex(center_ + (tangent_ * xy.x + bitangent_ * xy.y) * radius_,
+                  normal_, xy * 0.5f + 0.5f);
+    vertex.tangent = tangent_;
+    vertices.push_back(vertex);
+  }
+  // Primitive i is the sector between the angles of ring vertices i and i+1.
+  for (uint32_t i = 0; i < kDiskSegments; i++) {
+    indices.insert(indices.end(), {0u, i + 1, (i + 1) % kDiskSegments + 1});
+  }
+}
+
+}  // namespace sparks
@@ -0,0 +1,46 @@
+#pragma once
+#include "sparks/assets/analytic_model.h"
+#include "sparks/assets/util.h"
+
+namespace sparks {
+
+// Two-sided disk, textured by its planar projection onto the unit square.
+// The tessellation is a fan whose triangles stand for the sectors of the
+// disk.
+class Disk : public AnalyticModel {
+ public:
+  explicit Disk(const glm::vec3 &center = glm::vec3{0.0f},
+                const glm::vec3 &normal = glm::vec3{0.0f, 1.0f, 0.0f},
+                float radius = 1.0f);
+  explicit Disk(const tinyxml2::XMLElement *element);
+  [[nodiscard]] bool Intersect(const Ray &ray, RayHit *hit) const override;
+  void EvaluateHit(const Ray &ray,
+                   const RayHit &hit,
+                   HitRecord *hit_record) const override;
+  [[nodiscard]] AxisAlignedBoundingBox GetAABB(
+      const glm::mat4 &transform) const override;
+  const char *GetDefaultEntityName() const override;
+  void SamplePatch(int primitive_id,
+                   float r1,
+                   float r2,
+                   glm::vec3 *position,
+                   glm::vec3 *normal) const override;
+  [[nodiscard]] float GetPatchArea(int primitive_id,
+                                   const glm::mat3 &linear) const override;
+
+ protected:
+  void Tessellate(std::vector<Vertex> &vertices,
+                  std::vector<uint32_t> &indices) const override;
+
+ private:
+  void BuildFrame();
+
+  glm::vec3 center_{0.0f};
+  glm::vec3 normal_{0.0f, 1.0f, 0.0f};
+  float radius_{1.0f};
+  // Tangent and bitangent spanning the plane, tangent x bitangent = normal.
+  glm::vec3 tangent_{1.0f, 0.0f, 0.0f};
+  glm::vec3 bitangent_{0.0f, 0.0f, -1.0f};
+};
+
+}  // namespace sparks
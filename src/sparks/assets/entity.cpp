@@ -2,10 +2,24 @@
 
 namespace sparks {
 
+Entity::Entity(std::shared_ptr<const Model> model,
+               const Material &material,
+               const glm::mat4 &transform,
+               const std::string &name) {
+  model_ = std::move(model);
+  material_ = material;
+  transform_ = transform;
+  name_ = name;
+}
+
 const Model *Entity::GetModel() const {
   return model_.get();
 }
 
+const std::shared_ptr<const Model> &Entity::GetSharedModel() const {
+  return model_;
+}
+
 glm::mat4 &Entity::GetTransformMatrix() {
   return transform_;
 }
@@ -3,31 +3,48 @@
 #include "sparks/assets/material.h"
 #include "sparks/assets/mesh.h"
 #include "sparks/assets/model.h"
+#include "type_traits"
 
 namespace sparks {
 class Entity {
  public:
-  template <class ModelType>
-  Entity(const ModelType &model,
+  // Models passed as rvalues are moved into the entity.
+  template <class ModelType,
+            class = std::enable_if_t<
+                std::is_base_of_v<Model, std::decay_t<ModelType>>>>
+  Entity(ModelType &&model,
          const Material &material,
          const glm::mat4 &transform = glm::mat4{1.0f}) {
-    model_ = std::make_unique<ModelType>(model);
+    model_ = std::make_shared<std::decay_t<ModelType>>(
+        std::forward<ModelType>(model));
     material_ = material;
     transform_ = transform;
     name_ = model_->GetDefaultEntityName();
   }
 
-  template <class ModelType>
-  Entity(const ModelType &model,
+  template <class ModelType,
+            class = std::enable_if_t<
+                std::is_base_of_v<Model, std::decay_t<ModelType>>>>
+  Entity(ModelType &&model,
          const Material &material,
          const glm::mat4 &transform,
          const std::string &name) {
-    model_ = std::make_unique<ModelType>(model);
+    model_ = std::make_shared<std::decay_t<ModelType>>(
+        std::forward<ModelType>(model));
     material_ = material;
     transform_ = transform;
     name_ = name;
   }
+
+  // Instances a model shared with other entities, only the material and the
+  // transform belong to the entity.
+  Entity(std::shared_ptr<const Model> model,
+         const Material &material,
+         const glm::mat4 &transform,
+         const std::string &name);
+
   [[nodiscard]] const Model *GetModel() const;
+  [[nodiscard]] const std::shared_ptr<const Model> &GetSharedModel() const;
   [[nodiscard]] glm::mat4 &GetTransformMatrix();
   [[nodiscard]] const glm::mat4 &GetTransformMatrix() const;
   [[nodiscard]] Material &GetMaterial();
@@ -35,7 +52,7 @@ class Entity {
   [[nodiscard]] const std::string &GetName() const;
 
  private:
-  std::unique_ptr<Model> model_;
+  std::shared_ptr<const Model> model_;
   Material material_{};
   glm::mat4 transform_{1.0f};
   std::string name_;
@@ -0,0 +1,85 @@
+#include "sparks/assets/envmap_cubemap.h"
+
+#include "algorithm"
+#include "sparks/util/util.h"
+
+namespace sparks {
+
+void EnvmapCubemap::Build(const Texture &envmap, int face_size) {
+  if (face_size <= 0) {
+    face_size = int(envmap.GetWidth()) / 4;
+  }
+  face_size_ = std::max(face_size, 1);
+  int stride = face_size_ + 2;
+  texels_.resize(size_t(stride) * size_t(stride) * 6);
+  float inv_face_size = 1.0f / float(face_size_);
+  ParallelFor(0, stride * 6, [&](int row) {
+    int face = row / stride;
+    int y = row % stride;
+    int axis = face / 2;
+    glm::vec3 direction;
+    direction[axis] = face & 1 ? -1.0f : 1.0f;
+    direction[(axis + 2) % 3] =
+        (float(y) - 0.5f) * inv_face_size * 2.0f - 1.0f;
+    auto *texels = texels_.data() + size_t(row) * size_t(stride);
+    for (int x = 0; x < stride; x++) {
+      direction[(axis + 1) % 3] =
+          (float(x) - 0.5f) * inv_face_size * 2.0f - 1.0f;
+      auto dir = glm::normalize(direction);
+      float phi = std::atan2(dir.x, -dir.z);
+      if (phi < 0.0f) {
+        phi += 2.0f * PI;
+      }
+      glm::vec2 tex_coord{phi * INV_PI * 0.5f,
+                          std::acos(std::min(std::max(dir.y, -1.0f), 1.0f)) *
+                              INV_PI};
+      texels[x] = glm::vec3{envmap.Sample(tex_coord)};
+    }
+  });
+}
+
+void EnvmapCubemap::Clear() {
+  face_size_ = 0;
+  texels_.clear();
+}
+
+bool EnvmapCubemap::Empty() const {
+  return texels_.empty();
+}
+
+int EnvmapCubemap::GetFaceSize() const {
+  return face_size_;
+}
+
+glm::vec3 EnvmapCubemap::Sample(const glm::vec3 &direction) const {
+  auto abs_direction = glm::abs(direction);
+  int axis = 0;
+  if (abs_direction.y > abs_direction[axis]) {
+    axis = 1;
+  }
+  if (abs_direction.z > abs_direction[axis]) {
+    axis = 2;
+  }
+  if (abs_direction[axis] <= 0.0f) {
+    return glm::vec3{0.0f};
+  }
+  int face = axis * 2 + (direction[axis] < 0.0f ? 1 : 0);
+  float scale = 0.5f * float(face_size_) / abs_direction[axis];
+
+  // Texel centers of the face sit at half integers after the border texel.
+  int stride = face_size_ + 2;
+  float offset = float(face_size_) * 0.5f + 0.5f;
+  float fx = direction[(axis + 1) % 3] * scale + offset;
+  float fy = direction[(axis + 2) % 3] * scale + offset;
+  int x = std::min(std::max(int(fx), 0), face_size_);
+  int y = std::min(std::max(int(fy), 0), face_size_);
+  float wx = std::min(std::max(fx - float(x), 0.0f), 1.0f);
+  float wy = std::min(std::max(fy - float(y), 0.0f), 1.0f);
+  auto *texels = texels_.data() +
+                 (size_t(face) * size_t(stride) + size_t(y)) * size_t(stride) +
+                 size_t(x);
+  return glm::mix(glm::mix(texels[0], texels[1], wx),
+                  glm::mix(texels[stride], texels[stride + 1], wx), wy);
+}
+
+}  // namespace sparks
@@ -0,0 +1,30 @@
+#pragma once
+#include "glm/glm.hpp"
+#include "sparks/assets/texture.h"
+#include "vector"
+
+namespace sparks {
+
+// Cube map copy of an equirectangular envmap, looked up with the dominant axis
+// of the direction and a single division instead of the inverse trigonometry
+// of the equirectangular mapping. Faces carry a one texel border resampled
+// from the envmap, so bilinear lookups never straddle two faces. Directions
+// are in envmap space, the envmap offset is applied by the caller.
+class EnvmapCubemap {
+ public:
+  // face_size 0 matches the resolution of the envmap at its equator, the
+  // faces then hold three quarters of the texels of the envmap.
+  void Build(const Texture &envmap, int face_size = 0);
+  void Clear();
+
+  [[nodiscard]] bool Empty() const;
+  [[nodiscard]] int GetFaceSize() const;
+  [[nodiscard]] glm::vec3 Sample(const glm::vec3 &direction) const;
+
+ private:
+  int face_size_{0};
+  // 6 faces of (face_size + 2)^2 texels, ordered +x, -x, +y, -y, +z, -z.
+  std::vector<glm::vec3> texels_;
+};
+
+}  // namespace sparks
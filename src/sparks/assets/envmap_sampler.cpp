@@ -0,0 +1,93 @@
+#include "sparks/assets/envmap_sampler.h"
+
+#include "algorithm"
+#include "sparks/util/util.h"
+
+namespace sparks {
+
+namespace {
+float TexelStrength(const glm::vec4 &color) {
+  return std::max(color.x, std::max(color.y, color.z));
+}
+
+// Fraction of the sphere covered by the texel row y, divided by 4 PI.
+float RowScale(int y, int height) {
+  float inv_height = 1.0f / float(height);
+  return (std::cos(float(y) * PI * inv_height) -
+          std::cos(float(y + 1) * PI * inv_height)) *
+         0.5f;
+}
+}  // namespace
+
+void EnvmapSampler::Build(const Texture &envmap) {
+  width_ = int(envmap.GetWidth());
+  height_ = int(envmap.GetHeight());
+  entries_.resize(size_t(height_) * size_t(width_ + 1));
+  std::vector<float> row_weights(height_);
+  float inv_width = 1.0f / float(width_);
+  ParallelFor(0, height_, [&](int y) {
+    std::vector<float> weights(width_);
+    for (int x = 0; x < width_; x++) {
+      weights[x] = TexelStrength(envmap(x, y));
+    }
+    float row_weight = AliasTable::BuildEntries(
+        weights.data(), width_,
+        entries_.data() + height_ + size_t(y) * size_t(width_));
+    row_weights[y] = row_weight * RowScale(y, height_) * inv_width;
+  });
+  total_power_ =
+      AliasTable::BuildEntries(row_weights.data(), height_, entries_.data());
+}
+
+void EnvmapSampler::Clear() {
+  width_ = 0;
+  height_ = 0;
+  total_power_ = 0.0f;
+  entries_.clear();
+}
+
+float EnvmapSampler::Sample(const Texture &envmap,
+                            float r1,
+                            float r2,
+                            glm::vec2 *tex_coord) const {
+  if (total_power_ <= 0.0f) {
+    return 0.0f;
+  }
+  int y = AliasTable::SampleEntries(entries_.data(), height_, r1, &r1);
+  int x = AliasTable::SampleEntries(
+      entries_.data() + height_ + size_t(y) * size_t(width_), width_, r2, &r2);
+  float inv_height = 1.0f / float(height_);
+  float z_lbound = std::cos(float(y) * PI * inv_height);
+  float z_rbound = std::cos(float(y + 1) * PI * inv_height);
+  *tex_coord = {(float(x) + r2) / float(width_),
+                std::acos(r1 * (z_rbound - z_lbound) + z_lbound) * INV_PI};
+  return TexelStrength(envmap(x, y)) / (total_power_ * 4.0f * PI);
+}
+
+float EnvmapSampler::GetPdf(const Texture &envmap, glm::vec2 tex_coord) const {
+  if (total_power_ <= 0.0f) {
+    return 0.0f;
+  }
+  tex_coord -= glm::floor(tex_coord);
+  int x = std::min(int(tex_coord.x * float(width_)), width_ - 1);
+  int y = std::min(int(tex_coord.y * float(height_)), height_ - 1);
+  return TexelStrength(envmap(x, y)) / (total_power_ * 4.0f * PI);
+}
+
+float EnvmapSampler::GetTotalPower() const {
+  return total_power_;
+}
+
+int EnvmapSampler::GetWidth() const {
+  return width_;
+}
+
+int EnvmapSampler::GetHeight() const {
+  return height_;
+}
+
+const std::vector<AliasEntry> &EnvmapSampler::GetEntries() const {
+  return entries_;
+}
+
+}  // namespace sparks
@@ -0,0 +1,42 @@
+#pragma once
+#include "glm/glm.hpp"
+#include "sparks/assets/alias_table.h"
+#include "sparks/assets/texture.h"
+#include "vector"
+
+namespace sparks {
+
+// Marginal/conditional alias tables over the texels of an equirectangular
+// envmap. Texels are weighted by their max channel times their solid angle,
+// inside a texel directions are sampled uniformly in solid angle. Everything
+// works in envmap texture coordinates, so rotating the envmap with the scene
+// envmap offset does not require a rebuild.
+class EnvmapSampler {
+ public:
+  void Build(const Texture &envmap);
+  void Clear();
+
+  // Returns the solid angle pdf of the sampled texture coordinate, 0 if the
+  // envmap is black. envmap must be the texture the sampler was built from.
+  float Sample(const Texture &envmap,
+               float r1,
+               float r2,
+               glm::vec2 *tex_coord) const;
+  [[nodiscard]] float GetPdf(const Texture &envmap, glm::vec2 tex_coord) const;
+
+  // Integral of the texel weights over the sphere divided by 4 PI.
+  [[nodiscard]] float GetTotalPower() const;
+  [[nodiscard]] int GetWidth() const;
+  [[nodiscard]] int GetHeight() const;
+  // The height marginal entries followed by the width x height conditional
+  // entries in row major order, the layout consumed by the shaders.
+  [[nodiscard]] const std::vector<AliasEntry> &GetEntries() const;
+
+ private:
+  int width_{0};
+  int height_{0};
+  float total_power_{0.0f};
+  std::vector<AliasEntry> entries_;
+};
+
+}  // namespace sparks
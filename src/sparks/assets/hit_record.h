@@ -2,13 +2,28 @@
 #include "glm/glm.hpp"
 
 namespace sparks {
+// Closest hit kept by traversal, the HitRecord is only evaluated from it
+// once the search is done. The meaning of primitive_id and uv is up to the
+// model, triangles store their barycentric coordinates.
+struct RayHit {
+  float t{-1.0f};
+  int entity_id{-1};
+  int primitive_id{-1};
+  glm::vec2 uv{};
+};
+
 struct HitRecord {
   int hit_entity_id{-1};
+  int primitive_id{-1};
   glm::vec3 position{};
   glm::vec3 normal{};
   glm::vec3 geometry_normal{};
   glm::vec3 tangent{};
   glm::vec2 tex_coord{};
+  // Partial derivatives of the position with respect to tex_coord, zero if
+  // the texture coordinates of the triangle are degenerate.
+  glm::vec3 dpdu{};
+  glm::vec3 dpdv{};
   bool front_face{};
 };
 }  // namespace sparks
@@ -0,0 +1,105 @@
+#include "sparks/assets/instance_bvh.h"
+
+#include "algorithm"
+#include "unordered_map"
+
+namespace sparks {
+
+namespace {
+constexpr int kMaxLeafInstances = 2;
+// Bounds the traversal stack, one slot per level plus the pending siblings.
+constexpr int kMaxInstanceDepth = 30;
+
+AxisAlignedBoundingBox TransformAABB(const AxisAlignedBoundingBox &aabb,
+                                     const glm::mat4 &transform) {
+  AxisAlignedBoundingBox result;
+  for (int i = 0; i < 8; i++) {
+    glm::vec3 corner{i & 1 ? aabb.x_high : aabb.x_low,
+                     i & 2 ? aabb.y_high : aabb.y_low,
+                     i & 4 ? aabb.z_high : aabb.z_low};
+    corner = transform * glm::vec4{corner, 1.0f};
+    result = i ? result | AxisAlignedBoundingBox(corner)
+               : AxisAlignedBoundingBox(corner);
+  }
+  return result;
+}
+
+glm::vec3 GetCenter(const AxisAlignedBoundingBox &aabb) {
+  return glm::vec3{aabb.x_low + aabb.x_high, aabb.y_low + aabb.y_high,
+                   aabb.z_low + aabb.z_high} *
+         0.5f;
+}
+}  // namespace
+
+void InstanceBvh::Build(const std::vector<Entity> &entities) {
+  Clear();
+  std::unordered_map<const Model *, AxisAlignedBoundingBox> model_aabbs;
+  instances_.resize(entities.size());
+  for (size_t i = 0; i < entities.size(); i++) {
+    auto &entity = entities[i];
+    auto model = entity.GetModel();
+    auto it = model_aabbs.find(model);
+    if (it == model_aabbs.end()) {
+      it = model_aabbs.emplace(model, model->GetAABB(glm::mat4{1.0f})).first;
+    }
+    auto &transform = entity.GetTransformMatrix();
+    auto &instance = instances_[i];
+    instance.aabb = TransformAABB(it->second, transform);
+    instance.inv_transform = glm::inverse(transform);
+    instance.entity_id = int(i);
+  }
+  if (!instances_.empty()) {
+    BuildNode(0, int(instances_.size()), 0);
+  }
+}
+
+void InstanceBvh::Clear() {
+  instances_.clear();
+  nodes_.clear();
+}
+
+int InstanceBvh::GetInstanceCount() const {
+  return int(instances_.size());
+}
+
+int InstanceBvh::BuildNode(int begin, int end, int depth) {
+  int index = int(nodes_.size());
+  nodes_.emplace_back();
+  AxisAlignedBoundingBox aabb = instances_[begin].aabb;
+  AxisAlignedBoundingBox center_bounds(GetCenter(aabb));
+  for (int i = begin + 1; i < end; i++) {
+    aabb |= instances_[i].aabb;
+    center_bounds |= AxisAlignedBoundingBox(GetCenter(instances_[i].aabb));
+  }
+  nodes_[index].aabb = aabb;
+  if (end - begin <= kMaxLeafInstances || depth >= kMaxInstanceDepth) {
+    nodes_[index].begin = begin;
+    nodes_[index].end = end;
+    return index;
+  }
+
+  // Median split of the centers along their widest axis.
+  glm::vec3 extent{center_bounds.x_high - center_bounds.x_low,
+                   center_bounds.y_high - center_bounds.y_low,
+                   center_bounds.z_high - center_bounds.z_low};
+  int axis = 0;
+  if (extent.y > extent[axis]) {
+    axis = 1;
+  }
+  if (extent.z > extent[axis]) {
+    axis = 2;
+  }
+  int mid = (begin + end) / 2;
+  std::nth_element(instances_.begin() + begin, instances_.begin() + mid,
+                   instances_.begin() + end,
+                   [axis](const Instance &a, const Instance &b) {
+                     return GetCenter(a.aabb)[axis] < GetCenter(b.aabb)[axis];
+                   });
+  int left = BuildNode(begin, mid, depth + 1);
+  int right = BuildNode(mid, end, depth + 1);
+  nodes_[index].child[0] = left;
+  nodes_[index].child[1] = right;
+  return index;
+}
+
+}  // namespace sparks
@@ -0,0 +1,72 @@
+#pragma once
+#include "sparks/assets/aabb.h"
+#include "sparks/assets/entity.h"
+#include "vector"
+
+namespace sparks {
+
+// Top level bounding volume hierarchy over the entities of a scene. Entities
+// sharing a model each get a node here while the triangles and the bottom
+// level tree stay in the shared model, so the hierarchy only grows with the
+// instance count.
+class InstanceBvh {
+ public:
+  struct Instance {
+    AxisAlignedBoundingBox aabb{};
+    glm::mat4 inv_transform{1.0f};
+    int entity_id{-1};
+  };
+
+  // The bounds of each distinct model are computed once and transformed per
+  // entity.
+  void Build(const std::vector<Entity> &entities);
+  void Clear();
+  // Entities with an index at or above the count were added after the build.
+  [[nodiscard]] int GetInstanceCount() const;
+
+  // Calls visit(instance) for every instance whose bounds the ray enters
+  // between t_min and t_max. visit returns the t_max of the remaining
+  // traversal, the distance of the closest hit so far.
+  template <class Visitor>
+  void Traverse(const Ray &ray, Visitor &&visit) const {
+    if (nodes_.empty()) {
+      return;
+    }
+    Ray traversal_ray = ray;
+    int stack[64];
+    int stack_size = 0;
+    stack[stack_size++] = 0;
+    while (stack_size) {
+      auto &node = nodes_[stack[--stack_size]];
+      if (!node.aabb.IsIntersect(traversal_ray)) {
+        continue;
+      }
+      if (node.child[0] < 0) {
+        for (int i = node.begin; i < node.end; i++) {
+          if (instances_[i].aabb.IsIntersect(traversal_ray)) {
+            traversal_ray.t_max = visit(instances_[i]);
+          }
+        }
+        continue;
+      }
+      stack[stack_size++] = node.child[1];
+      stack[stack_size++] = node.child[0];
+    }
+  }
+
+ private:
+  struct Node {
+    AxisAlignedBoundingBox aabb{};
+    // -1 marks a leaf holding instances_[begin, end).
+    int child[2]{-1, -1};
+    int begin{0};
+    int end{0};
+  };
+
+  int BuildNode(int begin, int end, int depth);
+
+  std::vector<Instance> instances_;
+  std::vector<Node> nodes_;
+};
+
+}  // namespace sparks
@@ -0,0 +1,278 @@
+#include "sparks/assets/light_bvh.h"
+
+#include "algorithm"
+#include "functional"
+#include "numeric"
+#include "sparks/util/util.h"
+
+namespace sparks {
+
+namespace {
+constexpr float HALF_PI = PI * 0.5f;
+
+float SafeAcos(float x) {
+  return std::acos(std::min(std::max(x, -1.0f), 1.0f));
+}
+
+// Smallest cone around both cones in the space of undirected lines.
+void MergeCones(const glm::vec3 &axis_a,
+                float theta_a,
+                glm::vec3 axis_b,
+                float theta_b,
+                glm::vec3 *axis,
+                float *theta_o) {
+  if (glm::dot(axis_a, axis_b) < 0.0f) {
+    axis_b = -axis_b;
+  }
+  if (theta_b > theta_a) {
+    MergeCones(axis_b, theta_b, axis_a, theta_a, axis, theta_o);
+    return;
+  }
+  float theta_d = SafeAcos(glm::dot(axis_a, axis_b));
+  if (theta_d + theta_b <= theta_a) {
+    *axis = axis_a;
+    *theta_o = theta_a;
+    return;
+  }
+  float theta = (theta_a + theta_d + theta_b) * 0.5f;
+  auto ortho = axis_b - axis_a * glm::dot(axis_a, axis_b);
+  float ortho_length = glm::length(ortho);
+  if (theta >= HALF_PI || ortho_length < 1e-6f) {
+    *axis = axis_a;
+    *theta_o = HALF_PI;
+    return;
+  }
+  float theta_r = theta - theta_a;
+  *axis = glm::normalize(axis_a * std::cos(theta_r) +
+                         ortho * (std::sin(theta_r) / ortho_length));
+  *theta_o = theta;
+}
+
+void SetLeaf(const LightPrimitive &primitive, LightBvhNode *node) {
+  node->aabb_min = glm::min(primitive.vertices[0],
+                            glm::min(primitive.vertices[1],
+                                     primitive.vertices[2]));
+  node->aabb_max = glm::max(primitive.vertices[0],
+                            glm::max(primitive.vertices[1],
+                                     primitive.vertices[2]));
+  node->power = primitive.power;
+  auto normal = glm::cross(primitive.vertices[1] - primitive.vertices[0],
+                           primitive.vertices[2] - primitive.vertices[0]);
+  if (glm::length(normal) > 0.0f) {
+    node->axis = glm::normalize(normal);
+    node->theta_o = 0.0f;
+  } else {
+    node->theta_o = HALF_PI;
+  }
+  node->entity_id = primitive.entity_id;
+  node->primitive_id = primitive.primitive_id;
+}
+
+void MergeChildren(const LightBvhNode &left_node,
+                   const LightBvhNode &right_node,
+                   LightBvhNode *node) {
+  node->aabb_min = glm::min(left_node.aabb_min, right_node.aabb_min);
+  node->aabb_max = glm::max(left_node.aabb_max, right_node.aabb_max);
+  node->power = left_node.power + right_node.power;
+  if (left_node.power <= 0.0f) {
+    node->axis = right_node.axis;
+    node->theta_o = right_node.theta_o;
+  } else if (right_node.power <= 0.0f) {
+    node->axis = left_node.axis;
+    node->theta_o = left_node.theta_o;
+  } else {
+    MergeCones(left_node.axis, left_node.theta_o, right_node.axis,
+               right_node.theta_o, &node->axis, &node->theta_o);
+  }
+}
+}  // namespace
+
+void LightBvh::Build(const std::vector<LightPrimitive> &primitives) {
+  nodes_.clear();
+  leaf_indices_.assign(primitives.size(), -1);
+  if (primitives.empty()) {
+    return;
+  }
+  nodes_.reserve(primitives.size() * 2 - 1);
+  std::vector<int> indices(primitives.size());
+  std::iota(indices.begin(), indices.end(), 0);
+  BuildNode(primitives, indices.data(), int(indices.size()), -1);
+}
+
+void LightBvh::Refit(const std::vector<int> &primitive_indices,
+                     const std::vector<LightPrimitive> &primitives) {
+  // Children are built after their parents, so refitting the ancestors in
+  // decreasing index order sees every child before its parent.
+  std::vector<bool> is_ancestor(nodes_.size(), false);
+  std::vector<int> ancestors;
+  for (size_t i = 0; i < primitive_indices.size(); i++) {
+    int leaf = leaf_indices_[primitive_indices[i]];
+    SetLeaf(primitives[i], &nodes_[leaf]);
+    for (int node_index = nodes_[leaf].parent;
+         node_index != -1 && !is_ancestor[node_index];
+         node_index = nodes_[node_index].parent) {
+      is_ancestor[node_index] = true;
+      ancestors.push_back(node_index);
+    }
+  }
+  std::sort(ancestors.begin(), ancestors.end(), std::greater<>());
+  for (int node_index : ancestors) {
+    auto &node = nodes_[node_index];
+    MergeChildren(nodes_[node.child[0]], nodes_[node.child[1]], &node);
+  }
+}
+
+void LightBvh::Clear() {
+  nodes_.clear();
+  leaf_indices_.clear();
+}
+
+int LightBvh::BuildNode(const std::vector<LightPrimitive> &primitives,
+                        int *indices,
+                        int count,
+                        int parent) {
+  int node_index = int(nodes_.size());
+  nodes_.emplace_back();
+  nodes_[node_index].parent = parent;
+
+  if (count == 1) {
+    SetLeaf(primitives[indices[0]], &nodes_[node_index]);
+    leaf_indices_[indices[0]] = node_index;
+    return node_index;
+  }
+
+  glm::vec3 centroid_min{1e30f};
+  glm::vec3 centroid_max{-1e30f};
+  for (int i = 0; i < count; i++) {
+    auto &vertices = primitives[indices[i]].vertices;
+    auto centroid = (vertices[0] + vertices[1] + vertices[2]) * (1.0f / 3.0f);
+    centroid_min = glm::min(centroid_min, centroid);
+    centroid_max = glm::max(centroid_max, centroid);
+  }
+  auto extent = centroid_max - centroid_min;
+  int axis = 0;
+  if (extent[1] > extent[axis]) {
+    axis = 1;
+  }
+  if (extent[2] > extent[axis]) {
+    axis = 2;
+  }
+  int half = count / 2;
+  std::nth_element(indices, indices + half, indices + count,
+                   [&primitives, axis](int a, int b) {
+                     auto &va = primitives[a].vertices;
+                     auto &vb = primitives[b].vertices;
+                     return va[0][axis] + va[1][axis] + va[2][axis] <
+                            vb[0][axis] + vb[1][axis] + vb[2][axis];
+                   });
+  int left = BuildNode(primitives, indices, half, node_index);
+  int right = BuildNode(primitives, indices + half, count - half, node_index);
+
+  LightBvhNode &node = nodes_[node_index];
+  node.child[0] = left;
+  node.child[1] = right;
+  MergeChildren(nodes_[left], nodes_[right], &node);
+  return node_index;
+}
+
+int LightBvh::Sample(const glm::vec3 &position,
+                     const glm::vec3 &normal,
+                     float r,
+                     float *pdf) const {
+  if (nodes_.empty()) {
+    return -1;
+  }
+  int node_index = 0;
+  float prob = 1.0f;
+  while (nodes_[node_index].child[0] != -1) {
+    auto &node = nodes_[node_index];
+    float importance_left = Importance(nodes_[node.child[0]], position, normal);
+    float importance_right =
+        Importance(nodes_[node.child[1]], position, normal);
+    float total_importance = importance_left + importance_right;
+    if (total_importance <= 0.0f) {
+      return -1;
+    }
+    float prob_left = importance_left / total_importance;
+    if (r < prob_left) {
+      r = std::min(r / prob_left, 0.99999994f);
+      prob *= prob_left;
+      node_index = node.child[0];
+    } else {
+      r = std::min((r - prob_left) / (1.0f - prob_left), 0.99999994f);
+      prob *= 1.0f - prob_left;
+      node_index = node.child[1];
+    }
+  }
+  if (nodes_[node_index].power <= 0.0f) {
+    return -1;
+  }
+  *pdf = prob;
+  return node_index;
+}
+
+float LightBvh::GetPdf(int leaf,
+                       const glm::vec3 &position,
+                       const glm::vec3 &normal) const {
+  if (leaf < 0 || nodes_[leaf].power <= 0.0f) {
+    return 0.0f;
+  }
+  float prob = 1.0f;
+  for (int node_index = leaf; nodes_[node_index].parent != -1;) {
+    auto &parent = nodes_[nodes_[node_index].parent];
+    float importance_left =
+        Importance(nodes_[parent.child[0]], position, normal);
+    float importance_right =
+        Importance(nodes_[parent.child[1]], position, normal);
+    float total_importance = importance_left + importance_right;
+    if (total_importance <= 0.0f) {
+      return 0.0f;
+    }
+    prob *= (parent.child[0] == node_index ? importance_left
+                                           : importance_right) /
+            total_importance;
+    node_index = nodes_[node_index].parent;
+  }
+  return prob;
+}
+
+bool LightBvh::Empty() const {
+  return nodes_.empty();
+}
+
+const std::vector<LightBvhNode> &LightBvh::GetNodes() const {
+  return nodes_;
+}
+
+const std::vector<int> &LightBvh::GetLeafIndices() const {
+  return leaf_indices_;
+}
+
+float LightBvh::Importance(const LightBvhNode &node,
+                           const glm::vec3 &position,
+                           const glm::vec3 &normal) {
+  if (node.power <= 0.0f) {
+    return 0.0f;
+  }
+  auto center = (node.aabb_min + node.aabb_max) * 0.5f;
+  float radius = glm::length(node.aabb_max - node.aabb_min) * 0.5f;
+  auto offset = center - position;
+  float dist2 = glm::dot(offset, offset);
+  // Inside the bounding sphere any orientation is possible.
+  if (dist2 <= radius * radius) {
+    return node.power / std::max(radius * radius, 1e-8f);
+  }
+  float dist = std::sqrt(dist2);
+  auto direction = offset / dist;
+  float theta_u = std::asin(radius / dist);
+  float theta = SafeAcos(std::abs(glm::dot(node.axis, direction)));
+  float theta_prime = std::max(theta - node.theta_o - theta_u, 0.0f);
+  if (theta_prime >= HALF_PI) {
+    return 0.0f;
+  }
+  float theta_i = SafeAcos(std::abs(glm::dot(normal, direction)));
+  float theta_i_prime = std::max(theta_i - theta_u, 0.0f);
+  return node.power * std::cos(theta_prime) * std::cos(theta_i_prime) / dist2;
+}
+
+}  // namespace sparks
@@ -0,0 +1,73 @@
+#pragma once
+#include "glm/glm.hpp"
+#include "vector"
+
+namespace sparks {
+
+// Matches the std430 layout of LightBvhNode in light_bvh.glsl. Emitters are
+// two-sided, so the orientation cone bounds the normal lines rather than the
+// normal vectors and theta_o never exceeds PI / 2.
+struct LightBvhNode {
+  glm::vec3 aabb_min{0.0f};
+  float power{0.0f};
+  glm::vec3 aabb_max{0.0f};
+  float theta_o{0.0f};
+  glm::vec3 axis{0.0f, 1.0f, 0.0f};
+  int parent{-1};
+  int child[2]{-1, -1};
+  int entity_id{-1};
+  int primitive_id{-1};
+};
+
+struct LightPrimitive {
+  glm::vec3 vertices[3]{};
+  float power{0.0f};
+  int entity_id{-1};
+  int primitive_id{-1};
+};
+
+// Bounding volume hierarchy over emissive triangles in world space. Leaves
+// are picked stochastically with a per shading point importance that accounts
+// for power, distance and the orientation of both the emitters and the
+// receiver, following Conty Estevez and Kulla, "Importance Sampling of Many
+// Lights with Adaptive Tree Splitting".
+class LightBvh {
+ public:
+  void Build(const std::vector<LightPrimitive> &primitives);
+  // Moves the leaves of the primitives with the given indices into Build to
+  // primitives[i] and refits their ancestors. The topology is kept, so the
+  // tree degrades as primitives move away from where it was built.
+  void Refit(const std::vector<int> &primitive_indices,
+             const std::vector<LightPrimitive> &primitives);
+  void Clear();
+
+  // Returns the index of the sampled leaf node and writes the probability of
+  // picking it to *pdf, -1 if no light can reach the shading point.
+  int Sample(const glm::vec3 &position,
+             const glm::vec3 &normal,
+             float r,
+             float *pdf) const;
+  [[nodiscard]] float GetPdf(int leaf,
+                             const glm::vec3 &position,
+                             const glm::vec3 &normal) const;
+
+  [[nodiscard]] bool Empty() const;
+  [[nodiscard]] const std::vector<LightBvhNode> &GetNodes() const;
+  // Leaf node of each primitive, in the order they were passed to Build.
+  [[nodiscard]] const std::vector<int> &GetLeafIndices() const;
+
+  static float Importance(const LightBvhNode &node,
+                          const glm::vec3 &position,
+                          const glm::vec3 &normal);
+
+ private:
+  int BuildNode(const std::vector<LightPrimitive> &primitives,
+                int *indices,
+                int count,
+                int parent);
+
+  std::vector<LightBvhNode> nodes_;
+  std::vector<int> leaf_indices_;
+};
+
+}  // namespace sparks
@@ -0,0 +1,275 @@
+#include "sparks/assets/light_sampler.h"
+
+namespace sparks {
+
+void LightSampler::Update(const std::vector<Entity> &entities,
+                          bool enable_light_bvh) {
+  bool rebuild = entity_lights_.size() != entities.size();
+  bool rebuild_light_bvh = rebuild;
+  std::vector<int> moved_entities;
+  entity_lights_.resize(entities.size());
+  for (size_t i = 0; i < entities.size(); i++) {
+    bool primitives_changed = false;
+    if (UpdateEntity(entities[i], entity_lights_[i], &primitives_changed)) {
+      rebuild = true;
+      if (primitives_changed) {
+        rebuild_light_bvh = true;
+      } else {
+        moved_entities.push_back(int(i));
+      }
+    }
+  }
+  if (rebuild) {
+    std::vector<float> powers;
+    powers.reserve(entity_lights_.size());
+    for (auto &entity_light : entity_lights_) {
+      powers.push_back(entity_light.power);
+    }
+    entity_table_.Build(powers);
+    total_power_ = entity_table_.GetTotalWeight();
+  }
+
+  if (!enable_light_bvh) {
+    light_bvh_.Clear();
+    light_bvh_outdated_ = true;
+  } else if (light_bvh_outdated_ || rebuild_light_bvh) {
+    BuildLightBvh();
+  } else if (!moved_entities.empty()) {
+    RefitLightBvh(moved_entities);
+  }
+}
+
+void LightSampler::Clear() {
+  entity_lights_.clear();
+  primitive_offsets_.clear();
+  entity_table_ = AliasTable{};
+  light_bvh_.Clear();
+  light_bvh_outdated_ = true;
+  total_power_ = 0.0f;
+}
+
+LightPrimitive LightSampler::GetLightPrimitive(int entity_id,
+                                               int primitive_id) const {
+  auto &entity_light = entity_lights_[entity_id];
+  LightPrimitive primitive;
+  for (int k = 0; k < 3; k++) {
+    primitive.vertices[k] =
+        entity_light.transform *
+        glm::vec4{entity_light.positions[primitive_id * 3 + k], 1.0f};
+  }
+  primitive.power =
+      GetTriangleTable(entity_id).GetPdf(primitive_id) * entity_light.power;
+  primitive.entity_id = entity_id;
+  primitive.primitive_id = primitive_id;
+  return primitive;
+}
+
+void LightSampler::BuildLightBvh() {
+  std::vector<LightPrimitive> primitives;
+  primitive_offsets_.resize(entity_lights_.size());
+  for (size_t i = 0; i < entity_lights_.size(); i++) {
+    auto &entity_light = entity_lights_[i];
+    primitive_offsets_[i] = int(primitives.size());
+    for (int j = 0; j < entity_light.primitive_table.GetSize(); j++) {
+      primitives.push_back(GetLightPrimitive(int(i), j));
+    }
+  }
+  light_bvh_.Build(primitives);
+  light_bvh_outdated_ = false;
+}
+
+void LightSampler::RefitLightBvh(const std::vector<int> &entity_ids) {
+  std::vector<int> primitive_indices;
+  std::vector<LightPrimitive> primitives;
+  for (int entity_id : entity_ids) {
+    auto &entity_light = entity_lights_[entity_id];
+    for (int j = 0; j < entity_light.primitive_table.GetSize(); j++) {
+      primitive_indices.push_back(primitive_offsets_[entity_id] + j);
+      primitives.push_back(GetLightPrimitive(entity_id, j));
+    }
+  }
+  light_bvh_.Refit(primitive_indices, primitives);
+}
+
+bool LightSampler::UpdateEntity(const Entity &entity,
+                                EntityLight &entity_light,
+                                bool *primitives_changed) {
+  auto &material = entity.GetMaterial();
+  auto &transform = entity.GetTransformMatrix();
+  auto model = entity.GetModel();
+  float previous_power = entity_light.power;
+  if (material.emission_strength <= 1e-4f) {
+    *primitives_changed = !entity_light.positions.empty();
+    entity_light = EntityLight{};
+    return previous_power != 0.0f || *primitives_changed;
+  }
+
+  bool rebuild_positions =
+      entity_light.model != model || entity_light.positions.empty();
+  bool rebuild_areas =
+      rebuild_positions ||
+      glm::mat3{entity_light.transform} != glm::mat3{transform};
+  bool changed = rebuild_positions || entity_light.transform != transform ||
+                 entity_light.emission !=
+                     material.emission * material.emission_strength;
+  *primitives_changed = rebuild_positions;
+  entity_light.model = model;
+  entity_light.transform = transform;
+  entity_light.emission = material.emission * material.emission_strength;
+
+  if (rebuild_positions) {
+    entity_light.analytic_model = dynamic_cast<const AnalyticModel *>(model);
+    // Decoded for the moment if the model stores compact vertices.
+    auto vertices = model->GetVertices();
+    auto indices = model->GetIndexView();
+    entity_light.positions.resize(indices.size() / 3 * 3);
+    for (size_t i = 0; i < entity_light.positions.size(); i++) {
+      entity_light.positions[i] = vertices[indices[i]].position;
+    }
+  }
+
+  if (rebuild_areas) {
+    glm::mat3 linear{transform};
+    std::vector<float> areas(entity_light.positions.size() / 3);
+    for (size_t i = 0; i < areas.size(); i++) {
+      auto &p0 = entity_light.positions[i * 3];
+      auto &p1 = entity_light.positions[i * 3 + 1];
+      auto &p2 = entity_light.positions[i * 3 + 2];
+      areas[i] = 0.5f * glm::length(glm::cross(linear * (p1 - p0),
+                                               linear * (p2 - p0)));
+    }
+    if (entity_light.analytic_model) {
+      entity_light.triangle_table.Build(areas);
+      for (size_t i = 0; i < areas.size(); i++) {
+        areas[i] = entity_light.analytic_model->GetPatchArea(int(i), linear);
+      }
+    } else {
+      entity_light.triangle_table = AliasTable{};
+    }
+    entity_light.primitive_table.Build(areas);
+    entity_light.area = entity_light.primitive_table.GetTotalWeight();
+  }
+
+  entity_light.power = entity_light.area * material.emission_strength;
+  return changed || entity_light.power != previous_power;
+}
+
+bool LightSampler::Sample(float r1,
+                          float r2,
+                          float r3,
+                          LightSample *light_sample) const {
+  if (total_power_ <= 0.0f) {
+    return false;
+  }
+  int entity_id = entity_table_.Sample(r1, &r1);
+  int primitive_id = entity_lights_[entity_id].primitive_table.Sample(r1);
+  SamplePrimitive(entity_id, primitive_id, r2, r3, light_sample);
+  light_sample->pdf = GetPdf(entity_id);
+  return true;
+}
+
+bool LightSampler::Sample(const glm::vec3 &position,
+                          const glm::vec3 &normal,
+                          float r1,
+                          float r2,
+                          float r3,
+                          LightSample *light_sample) const {
+  float leaf_pdf;
+  int leaf = light_bvh_.Sample(position, normal, r1, &leaf_pdf);
+  if (leaf < 0) {
+    return false;
+  }
+  auto &node = light_bvh_.GetNodes()[leaf];
+  auto &entity_light = entity_lights_[node.entity_id];
+  SamplePrimitive(node.entity_id, node.primitive_id, r2, r3, light_sample);
+  light_sample->pdf =
+      leaf_pdf / (entity_light.primitive_table.GetPdf(node.primitive_id) *
+                  entity_light.area);
+  return true;
+}
+
+void LightSampler::SamplePrimitive(int entity_id,
+                                   int primitive_id,
+                                   float r2,
+                                   float r3,
+                                   LightSample *light_sample) const {
+  auto &entity_light = entity_lights_[entity_id];
+  light_sample->emission = entity_light.emission;
+  light_sample->entity_id = entity_id;
+  light_sample->primitive_id = primitive_id;
+  glm::mat3 linear{entity_light.transform};
+  if (entity_light.analytic_model) {
+    glm::vec3 position;
+    glm::vec3 normal;
+    entity_light.analytic_model->SamplePatch(primitive_id, r2, r3, &position,
+                                             &normal);
+    light_sample->position =
+        entity_light.transform * glm::vec4{position, 1.0f};
+    light_sample->normal =
+        glm::normalize(AnalyticModel::TransformNormal(linear, normal));
+    return;
+  }
+
+  auto &p0 = entity_light.positions[primitive_id * 3];
+  auto &p1 = entity_light.positions[primitive_id * 3 + 1];
+  auto &p2 = entity_light.positions[primitive_id * 3 + 2];
+  float sqrt_r2 = std::sqrt(r2);
+  float b1 = r3 * sqrt_r2;
+  float b2 = 1.0f - sqrt_r2;
+  float b0 = 1.0f - b1 - b2;
+  light_sample->position =
+      entity_light.transform * glm::vec4{p0 * b0 + p1 * b1 + p2 * b2, 1.0f};
+  light_sample->normal =
+      glm::normalize(glm::cross(linear * (p1 - p0), linear * (p2 - p0)));
+}
+
+float LightSampler::GetPdf(int entity_id) const {
+  auto &entity_light = entity_lights_[entity_id];
+  if (total_power_ <= 0.0f || entity_light.area <= 0.0f) {
+    return 0.0f;
+  }
+  return entity_light.power / (total_power_ * entity_light.area);
+}
+
+float LightSampler::GetPdf(int entity_id,
+                           int primitive_id,
+                           const glm::vec3 &position,
+                           const glm::vec3 &normal) const {
+  auto &entity_light = entity_lights_[entity_id];
+  if (entity_light.primitive_table.Empty() || light_bvh_.Empty()) {
+    return 0.0f;
+  }
+  float primitive_area =
+      entity_light.primitive_table.GetPdf(primitive_id) * entity_light.area;
+  if (primitive_area <= 0.0f) {
+    return 0.0f;
+  }
+  int leaf =
+      light_bvh_.GetLeafIndices()[primitive_offsets_[entity_id] + primitive_id];
+  return light_bvh_.GetPdf(leaf, position, normal) / primitive_area;
+}
+
+float LightSampler::GetTotalPower() const {
+  return total_power_;
+}
+
+const AliasTable &LightSampler::GetEntityTable() const {
+  return entity_table_;
+}
+
+const std::vector<LightSampler::EntityLight> &LightSampler::GetEntityLights()
+    const {
+  return entity_lights_;
+}
+
+const AliasTable &LightSampler::GetTriangleTable(int entity_id) const {
+  auto &entity_light = entity_lights_[entity_id];
+  return entity_light.analytic_model ? entity_light.triangle_table
+                                     : entity_light.primitive_table;
+}
+
+const LightBvh &LightSampler::GetLightBvh() const {
+  return light_bvh_;
+}
+
+}  // namespace sparks
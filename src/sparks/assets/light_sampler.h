@@ -0,0 +1,102 @@
+#pragma once
+#include "glm/glm.hpp"
+#include "sparks/assets/alias_table.h"
+#include "sparks/assets/analytic_model.h"
+#include "sparks/assets/entity.h"
+#include "sparks/assets/light_bvh.h"
+#include "vector"
+
+namespace sparks {
+
+struct LightSample {
+  glm::vec3 position{};
+  glm::vec3 normal{};
+  glm::vec3 emission{};
+  float pdf{0.0f};
+  int entity_id{-1};
+  int primitive_id{-1};
+};
+
+class LightSampler {
+ public:
+  struct EntityLight {
+    const Model *model{nullptr};
+    // Set for analytic models, whose primitives are sampled on the patches
+    // of the exact surface they stand for.
+    const AnalyticModel *analytic_model{nullptr};
+    glm::mat4 transform{1.0f};
+    glm::vec3 emission{0.0f};
+    float area{0.0f};
+    float power{0.0f};
+    std::vector<glm::vec3> positions;
+    AliasTable primitive_table;
+    // World space areas of the triangles of analytic models, see
+    // GetTriangleTable.
+    AliasTable triangle_table;
+  };
+
+  // Brings the sampler up to date with the entities. Only the entities whose
+  // model, linear transform or emission changed since the last update are
+  // rebuilt, the entity level table is rebuilt whenever any emitter changed.
+  // The light BVH is only kept while enable_light_bvh is set. It is rebuilt
+  // when emitters are added, removed or change their model, and refit when
+  // they only move or change their power.
+  void Update(const std::vector<Entity> &entities, bool enable_light_bvh);
+  void Clear();
+
+  // Picks a light proportional to its power.
+  bool Sample(float r1, float r2, float r3, LightSample *light_sample) const;
+  // Picks a light with the light BVH, proportional to its estimated
+  // contribution to the shading point.
+  bool Sample(const glm::vec3 &position,
+              const glm::vec3 &normal,
+              float r1,
+              float r2,
+              float r3,
+              LightSample *light_sample) const;
+  // Area density of sampling a point on the given entity.
+  [[nodiscard]] float GetPdf(int entity_id) const;
+  // Area density of the light BVH sampling the given primitive.
+  [[nodiscard]] float GetPdf(int entity_id,
+                             int primitive_id,
+                             const glm::vec3 &position,
+                             const glm::vec3 &normal) const;
+
+  [[nodiscard]] float GetTotalPower() const;
+  [[nodiscard]] const AliasTable &GetEntityTable() const;
+  [[nodiscard]] const std::vector<EntityLight> &GetEntityLights() const;
+  // Picks the triangles of the index view of an entity by their world space
+  // area, which is what the GPU samples and what the light BVH weighs. For
+  // analytic models it differs from primitive_table, which picks the exact
+  // patches, and leaves out the degenerate triangles of the tessellation.
+  [[nodiscard]] const AliasTable &GetTriangleTable(int entity_id) const;
+  // The leaves are indexed with the primitives of all the entity lights
+  // concatenated in entity order. Empty while the light BVH is disabled.
+  [[nodiscard]] const LightBvh &GetLightBvh() const;
+
+ private:
+  // Returns whether the light changed, *primitives_changed tells whether its
+  // primitives were replaced rather than moved or reweighted.
+  bool UpdateEntity(const Entity &entity,
+                    EntityLight &entity_light,
+                    bool *primitives_changed);
+  [[nodiscard]] LightPrimitive GetLightPrimitive(int entity_id,
+                                                 int primitive_id) const;
+  void BuildLightBvh();
+  void RefitLightBvh(const std::vector<int> &entity_ids);
+  void SamplePrimitive(int entity_id,
+                       int primitive_id,
+                       float r2,
+                       float r3,
+                       LightSample *light_sample) const;
+
+  std::vector<EntityLight> entity_lights_;
+  std::vector<int> primitive_offsets_;
+  AliasTable entity_table_;
+  LightBvh light_bvh_;
+  // Set while light_bvh_ does not match the entity lights.
+  bool light_bvh_outdated_{true};
+  float total_power_{0.0f};
+};
+
+}  // namespace sparks
@@ -14,6 +14,21 @@ std::unordered_map<std::string, MaterialType> material_name_map{
     {"transmissive", MATERIAL_TYPE_TRANSMISSIVE},
     {"principled", MATERIAL_TYPE_PRINCIPLED},
     {"emission", MATERIAL_TYPE_EMISSION}};
+
+std::unordered_map<std::string, SampleType> sample_type_name_map{
+    {"linear", SAMPLE_TYPE_LINEAR},
+    {"nearest", SAMPLE_TYPE_NEAREST},
+    {"stochastic", SAMPLE_TYPE_STOCHASTIC}};
+
+int LoadTextureElement(Scene *scene, const tinyxml2::XMLElement *element) {
+  SampleType sample_type = SAMPLE_TYPE_LINEAR;
+  auto sample_type_attribute = element->FindAttribute("sample_type");
+  if (sample_type_attribute) {
+    sample_type = sample_type_name_map[sample_type_attribute->Value()];
+  }
+  return scene->LoadTextureAsync(element->FindAttribute("value")->Value(),
+                                 sample_type);
+}
 }
 
 Material::Material(Scene *scene, const tinyxml2::XMLElement *material_element)
@@ -29,42 +44,35 @@ Material::Material(Scene *scene, const tinyxml2::XMLElement *material_element)
 
   child_element = material_element->FirstChildElement("albedo_texture");
   if (child_element) {
-    std::string path = child_element->FindAttribute("value")->Value();
-    Texture albedo_texture(1, 1);
-    if (Texture::Load(path, albedo_texture)) {
-      base_color_texture_id =
-          scene->AddTexture(albedo_texture, PathToFilename(path));
+    int texture_id = LoadTextureElement(scene, child_element);
+    if (texture_id >= 0) {
+      base_color_texture_id = texture_id;
     }
   }
 
   child_element = material_element->FirstChildElement("roughness_texture");
   if (child_element) {
-    std::string path = child_element->FindAttribute("value")->Value();
-    Texture roughness_texture(1, 1);
-    if (Texture::Load(path, roughness_texture)) {
-      roughness_texture_id =
-          scene->AddTexture(roughness_texture, PathToFilename(path));
+    int texture_id = LoadTextureElement(scene, child_element);
+    if (texture_id >= 0) {
+      roughness_texture_id = texture_id;
       roughness = 1.0f;
     }
   }
 
   child_element = material_element->FirstChildElement("metallic_texture");
   if (child_element) {
-    std::string path = child_element->FindAttribute("value")->Value();
-    Texture metallic_texture(1, 1);
-    if (Texture::Load(path, metallic_texture)) {
-      metallic_texture_id =
-          scene->AddTexture(metallic_texture, PathToFilename(path));
+    int texture_id = LoadTextureElement(scene, child_element);
+    if (texture_id >= 0) {
+      metallic_texture_id = texture_id;
       metallic = 1.0f;
     }
   }
 
   child_element = material_element->FirstChildElement("normal_map");
   if (child_element) {
-    std::string path = child_element->FindAttribute("value")->Value();
-    Texture normal_map(1, 1);
-    if (Texture::Load(path, normal_map)) {
-      normal_map_id = scene->AddTexture(normal_map, PathToFilename(path));
+    int texture_id = LoadTextureElement(scene, child_element);
+    if (texture_id >= 0) {
+      normal_map_id = texture_id;
     }
   }
 
@@ -1,29 +1,306 @@
 #include "sparks/assets/mesh.h"
 
+#include "atomic"
 #include "fstream"
 #include "iomanip"
 #include "iostream"
-#include "unordered_map"
-
-#define TINYOBJLOADER_IMPLEMENTATION
 #include "mikktspace.h"
-#include "tiny_obj_loader.h"
+#include "sparks/assets/box.h"
+#include "sparks/assets/obj_parser.h"
+#include "sparks/util/util.h"
 
 namespace sparks {
 
-Mesh::Mesh(const Mesh &mesh)
-    : vertices_(mesh.vertices_), indices_(mesh.indices_) {
+namespace {
+constexpr int kWeldBlockSize = 1 << 16;
+constexpr int kNumWeldShards = 256;
+constexpr int kTangentChunkFaces = 1 << 16;
+constexpr float kAmbiguousRatio = 1e-4f;
+constexpr float kAmbiguousArea = 1e-30f;
+
+// Faces of a mesh handed to MikkTSpace, tangent spaces are written to one
+// unwelded corner per face vertex.
+struct TangentChunk {
+  const std::vector<Vertex> *vertices;
+  const uint32_t *indices;
+  int num_faces;
+  Vertex *corners;
+};
+
+const Vertex &ChunkVertex(const SMikkTSpaceContext *context,
+                          int i_face,
+                          int i_vert) {
+  auto chunk = reinterpret_cast<const TangentChunk *>(context->m_pUserData);
+  return (*chunk->vertices)[chunk->indices[i_face * 3 + i_vert]];
+}
+
+int GetNumFaces(const SMikkTSpaceContext *context) {
+  return reinterpret_cast<const TangentChunk *>(context->m_pUserData)
+      ->num_faces;
+}
+
+int GetNumVerticesOfFace(const SMikkTSpaceContext * /*context*/,
+                         const int /*i_face*/) {
+  return 3;
+}
+
+void GetNormal(const SMikkTSpaceContext *context,
+               float normal_out[],
+               const int i_face,
+               const int i_vert) {
+  auto &normal = ChunkVertex(context, i_face, i_vert).normal;
+  normal_out[0] = normal.x;
+  normal_out[1] = normal.y;
+  normal_out[2] = normal.z;
+}
+
+void GetPosition(const SMikkTSpaceContext *context,
+                 float position_out[],
+                 const int i_face,
+                 const int i_vert) {
+  auto &position = ChunkVertex(context, i_face, i_vert).position;
+  position_out[0] = position.x;
+  position_out[1] = position.y;
+  position_out[2] = position.z;
+}
+
+void GetTexCoord(const SMikkTSpaceContext *context,
+                 float texcoord_out[],
+                 const int i_face,
+                 const int i_vert) {
+  auto &tex_coord = ChunkVertex(context, i_face, i_vert).tex_coord;
+  texcoord_out[0] = tex_coord.x;
+  texcoord_out[1] = tex_coord.y;
+}
+
+void SetTSpaceBasic(const SMikkTSpaceContext *context,
+                    const float tangent[],
+                    const float sign,
+                    const int i_face,
+                    const int i_vert) {
+  auto chunk = reinterpret_cast<const TangentChunk *>(context->m_pUserData);
+  auto &vert = chunk->corners[i_face * 3 + i_vert];
+  vert.tangent = glm::vec3{tangent[0], tangent[1], tangent[2]};
+  vert.signal = sign;
+}
+
+// Copies the vertices of the faces to their corners and runs MikkTSpace on
+// them, false if it failed.
+bool GenerateTangents(const TangentChunk &chunk) {
+  for (int i = 0; i < chunk.num_faces * 3; i++) {
+    chunk.corners[i] = (*chunk.vertices)[chunk.indices[i]];
+  }
+
+  SMikkTSpaceInterface interface {};
+  interface.m_getNumFaces = GetNumFaces;
+  interface.m_getNumVerticesOfFace = GetNumVerticesOfFace;
+  interface.m_getNormal = GetNormal;
+  interface.m_getPosition = GetPosition;
+  interface.m_getTexCoord = GetTexCoord;
+  interface.m_setTSpaceBasic = SetTSpaceBasic;
+
+  SMikkTSpaceContext context{};
+  context.m_pInterface = &interface;
+  context.m_pUserData =
+      reinterpret_cast<void *>(const_cast<TangentChunk *>(&chunk));
+  return genTangSpaceDefault(&context);
+}
+
+// Representative of each vertex among the vertices equal to it, the first of
+// them.
+std::vector<uint32_t> FindRepresentatives(const std::vector<Vertex> &vertices) {
+  const int num_vertices = int(vertices.size());
+  std::vector<size_t> hashes(num_vertices);
+  ParallelFor(
+      0, num_vertices, [&](int i) { hashes[i] = VertexHash()(vertices[i]); },
+      kWeldBlockSize);
+
+  // Vertices are bucketed into shards by the low bits of their hashes, each
+  // shard is welded into its own open addressing table indexed by the
+  // remaining bits. Buckets keep the vertex order, so the first of a group
+  // of equal vertices becomes their representative.
+  int num_blocks = (num_vertices + kWeldBlockSize - 1) / kWeldBlockSize;
+  std::vector<uint32_t> bucket_offsets(size_t(num_blocks) * kNumWeldShards, 0);
+  auto bucket_offset = [&](int block, int shard) -> uint32_t & {
+    return bucket_offsets[size_t(shard) * num_blocks + block];
+  };
+  auto block_end = [num_vertices](int block) {
+    return std::min((block + 1) * kWeldBlockSize, num_vertices);
+  };
+  ParallelFor(0, num_blocks, [&](int block) {
+    for (int i = block * kWeldBlockSize; i < block_end(block); i++) {
+      bucket_offset(block, int(hashes[i] % kNumWeldShards))++;
+    }
+  });
+  uint32_t offset = 0;
+  for (auto &bucket : bucket_offsets) {
+    auto count = bucket;
+    bucket = offset;
+    offset += count;
+  }
+  std::vector<uint32_t> shard_vertices(num_vertices);
+  ParallelFor(0, num_blocks, [&](int block) {
+    for (int i = block * kWeldBlockSize; i < block_end(block); i++) {
+      shard_vertices[bucket_offset(block, int(hashes[i] % kNumWeldShards))++] =
+          uint32_t(i);
+    }
+  });
+
+  // bucket_offset now holds the end of each (shard, block) range.
+  std::vector<uint32_t> representatives(num_vertices);
+  ParallelFor(0, num_blocks ? kNumWeldShards : 0, [&](int shard) {
+    uint32_t begin = shard ? bucket_offset(num_blocks - 1, shard - 1) : 0;
+    uint32_t end = bucket_offset(num_blocks - 1, shard);
+    size_t table_size = 1;
+    while (table_size < size_t(end - begin) * 2) {
+      table_size <<= 1;
+    }
+    std::vector<uint32_t> table(table_size, UINT32_MAX);
+    for (auto i = begin; i < end; i++) {
+      auto vertex = shard_vertices[i];
+      auto hash = hashes[vertex];
+      for (size_t slot = (hash / kNumWeldShards) & (table_size - 1);;
+           slot = (slot + 1) & (table_size - 1)) {
+        auto &entry = table[slot];
+        if (entry == UINT32_MAX) {
+          entry = vertex;
+          representatives[vertex] = vertex;
+          break;
+        }
+        if (hashes[entry] == hash && vertices[entry] == vertices[vertex]) {
+          representatives[vertex] = entry;
+          break;
+        }
+      }
+    }
+  });
+  return representatives;
+}
+
+// MikkTSpace lets a face without a usable texture mapping take the
+// orientation of whichever vertex group reaches it first, so it ties the
+// tangent spaces of all of its vertices together. Errs on the side of
+// flagging.
+bool IsOrientationAmbiguous(const Vertex &v0,
+                            const Vertex &v1,
+                            const Vertex &v2) {
+  auto t1 = v1.tex_coord - v0.tex_coord;
+  auto t2 = v2.tex_coord - v0.tex_coord;
+  float tex_area = t1.x * t2.y - t1.y * t2.x;
+  float tex_scale = std::abs(t1.x * t2.y) + std::abs(t1.y * t2.x);
+  auto p1 = v1.position - v0.position;
+  auto p2 = v2.position - v0.position;
+  float area = glm::length(glm::cross(p1, p2));
+  float scale = glm::length(p1) * glm::length(p2);
+  return std::abs(tex_area) <= kAmbiguousRatio * tex_scale + kAmbiguousArea ||
+         area <= kAmbiguousRatio * scale + kAmbiguousArea;
 }
 
-Mesh::Mesh(const std::vector<Vertex> &vertices,
-           const std::vector<uint32_t> &indices) {
-  vertices_ = vertices;
-  indices_ = indices;
+// The tangent space MikkTSpace gives a corner depends on the faces around
+// its vertex, as MikkTSpace welds them by position, normal and texture
+// coordinates, and through ambiguous faces on the faces around their other
+// vertices. Flags the corners whose dependencies cross a chunk border and
+// returns the faces they depend on, in their order.
+std::vector<int> FindTangentBorder(const std::vector<Vertex> &vertices,
+                                   const std::vector<uint32_t> &indices,
+                                   std::vector<bool> *is_border_corner) {
+  std::vector<Vertex> keys(vertices.size());
+  ParallelFor(
+      0, int(keys.size()),
+      [&](int i) {
+        keys[i] = Vertex(vertices[i].position, vertices[i].normal,
+                         vertices[i].tex_coord);
+      },
+      kWeldBlockSize);
+  auto welded = FindRepresentatives(keys);
+  int num_faces = int(indices.size() / 3);
+  auto face_vertex = [&](int face, int corner) {
+    return welded[indices[size_t(face) * 3 + corner]];
+  };
+
+  const int kNoChunk = -1;
+  const int kManyChunks = -2;
+  std::vector<int> vertex_chunks(vertices.size(), kNoChunk);
+  std::vector<uint32_t> face_offsets(vertices.size() + 1, 0);
+  for (int face = 0; face < num_faces; face++) {
+    int chunk = face / kTangentChunkFaces;
+    for (int corner = 0; corner < 3; corner++) {
+      auto vertex = face_vertex(face, corner);
+      auto &vertex_chunk = vertex_chunks[vertex];
+      vertex_chunk = vertex_chunk == kNoChunk || vertex_chunk == chunk
+                         ? chunk
+                         : kManyChunks;
+      face_offsets[vertex + 1]++;
+    }
+  }
+  for (size_t i = 1; i < face_offsets.size(); i++) {
+    face_offsets[i] += face_offsets[i - 1];
+  }
+  std::vector<int> vertex_faces(indices.size());
+  {
+    auto next = face_offsets;
+    for (int face = 0; face < num_faces; face++) {
+      for (int corner = 0; corner < 3; corner++) {
+        vertex_faces[next[face_vertex(face, corner)]++] = face;
+      }
+    }
+  }
+
+  std::vector<bool> is_border(vertices.size(), false);
+  std::vector<uint32_t> stack;
+  for (size_t i = 0; i < vertices.size(); i++) {
+    if (vertex_chunks[i] == kManyChunks) {
+      is_border[i] = true;
+      stack.push_back(uint32_t(i));
+    }
+  }
+  while (!stack.empty()) {
+    auto vertex = stack.back();
+    stack.pop_back();
+    for (auto i = face_offsets[vertex]; i < face_offsets[vertex + 1]; i++) {
+      int face = vertex_faces[i];
+      auto corner_vertices = indices.data() + size_t(face) * 3;
+      if (!IsOrientationAmbiguous(vertices[corner_vertices[0]],
+                                  vertices[corner_vertices[1]],
+                                  vertices[corner_vertices[2]])) {
+        continue;
+      }
+      for (int corner = 0; corner < 3; corner++) {
+        auto other = face_vertex(face, corner);
+        if (!is_border[other]) {
+          is_border[other] = true;
+          stack.push_back(other);
+        }
+      }
+    }
+  }
+
+  std::vector<int> border_faces;
+  is_border_corner->assign(indices.size(), false);
+  for (int face = 0; face < num_faces; face++) {
+    bool on_border = false;
+    for (int corner = 0; corner < 3; corner++) {
+      if (is_border[face_vertex(face, corner)]) {
+        (*is_border_corner)[size_t(face) * 3 + corner] = true;
+        on_border = true;
+      }
+    }
+    if (on_border) {
+      border_faces.push_back(face);
+    }
+  }
+  return border_faces;
+}
+}  // namespace
+
+Mesh::Mesh(std::vector<Vertex> vertices, std::vector<uint32_t> indices)
+    : vertices_(std::move(vertices)), indices_(std::move(indices)) {
   BuildTangent();
 }
 
 Mesh Mesh::Cube(const glm::vec3 &center, const glm::vec3 &size) {
-  return {{}, {}};
+  Box box(center, size);
+  return {box.GetVertices(), box.GetIndices()};
 }
 
 Mesh Mesh::Sphere(const glm::vec3 &center, float radius) {
@@ -62,7 +339,7 @@ Mesh Mesh::Sphere(const glm::vec3 &center, float radius) {
       }
     }
   }
-  return {vertices, indices};
+  return {std::move(vertices), std::move(indices)};
 }
 
 AxisAlignedBoundingBox Mesh::GetAABB(const glm::mat4 &transform) const {
@@ -80,60 +357,101 @@ AxisAlignedBoundingBox Mesh::GetAABB(const glm::mat4 &transform) const {
   return result;
 }
 
-float Mesh::TraceRay(const glm::vec3 &origin,
-                     const glm::vec3 &direction,
-                     float t_min,
-                     HitRecord *hit_record) const {
-  float result = -1.0f;
-  for (int i = 0; i < indices_.size(); i += 3) {
-    int j = i + 1, k = i + 2;
-    const auto &v0 = vertices_[indices_[i]];
-    const auto &v1 = vertices_[indices_[j]];
-    const auto &v2 = vertices_[indices_[k]];
-
-    glm::mat3 A = glm::mat3(v1.position - v0.position,
-                            v2.position - v0.position, -direction);
-    if (std::abs(glm::determinant(A)) < 1e-9f) {
-      continue;
-    }
-    A = glm::inverse(A);
-    auto uvt = A * (origin - v0.position);
-    auto &t = uvt.z;
-    if (t < t_min || (result > 0.0f && t > result)) {
-      continue;
-    }
-    auto &u = uvt.x;
-    auto &v = uvt.y;
-    auto w = 1.0f - u - v;
-    auto position = origin + t * direction;
-    if (u >= 0.0f && v >= 0.0f && u + v <= 1.0f) {
-      result = t;
-      if (hit_record) {
-        auto geometry_normal = glm::normalize(
-            glm::cross(v2.position - v0.position, v1.position - v0.position));
-        if (glm::dot(geometry_normal, direction) < 0.0f) {
-          hit_record->position = position;
-          hit_record->geometry_normal = geometry_normal;
-          hit_record->normal = v0.normal * w + v1.normal * u + v2.normal * v;
-          hit_record->tangent =
-              v0.tangent * w + v1.tangent * u + v2.tangent * v;
-          hit_record->tex_coord =
-              v0.tex_coord * w + v1.tex_coord * u + v2.tex_coord * v;
-          hit_record->front_face = true;
-        } else {
-          hit_record->position = position;
-          hit_record->geometry_normal = -geometry_normal;
-          hit_record->normal = -(v0.normal * w + v1.normal * u + v2.normal * v);
-          hit_record->tangent =
-              -(v0.tangent * w + v1.tangent * u + v2.tangent * v);
-          hit_record->tex_coord =
-              v0.tex_coord * w + v1.tex_coord * u + v2.tex_coord * v;
-          hit_record->front_face = false;
-        }
-      }
+bool Mesh::Intersect(const Ray &ray, RayHit *hit) const {
+  Ray local_ray = ray;
+  bool found = false;
+  for (int i = 0; i * 3 + 2 < indices_.size(); i++) {
+    if (IntersectTriangle(i, local_ray, hit)) {
+      local_ray.t_max = hit->t;
+      found = true;
     }
   }
-  return result;
+  return found;
+}
+
+bool Mesh::IntersectTriangle(int primitive_id,
+                             const Ray &ray,
+                             RayHit *hit) const {
+  const auto &p0 = vertices_[indices_[primitive_id * 3]].position;
+  const auto &p1 = vertices_[indices_[primitive_id * 3 + 1]].position;
+  const auto &p2 = vertices_[indices_[primitive_id * 3 + 2]].position;
+  return IntersectTriangle(p0, p1 - p0, p2 - p0, primitive_id, ray, hit);
+}
+
+bool Mesh::IntersectTriangle(const glm::vec3 &p0,
+                             const glm::vec3 &edge1,
+                             const glm::vec3 &edge2,
+                             int primitive_id,
+                             const Ray &ray,
+                             RayHit *hit) {
+  glm::mat3 A = glm::mat3(edge1, edge2, -ray.direction);
+  if (std::abs(glm::determinant(A)) < 1e-9f) {
+    return false;
+  }
+  auto uvt = glm::inverse(A) * (ray.origin - p0);
+  if (uvt.z < ray.t_min || uvt.z > ray.t_max || uvt.x < 0.0f ||
+      uvt.y < 0.0f || uvt.x + uvt.y > 1.0f) {
+    return false;
+  }
+  hit->t = uvt.z;
+  hit->primitive_id = primitive_id;
+  hit->uv = {uvt.x, uvt.y};
+  return true;
+}
+
+void Mesh::EvaluateHit(const Ray &ray,
+                       const RayHit &hit,
+                       HitRecord *hit_record) const {
+  EvaluateTriangleHit(vertices_[indices_[hit.primitive_id * 3]],
+                      vertices_[indices_[hit.primitive_id * 3 + 1]],
+                      vertices_[indices_[hit.primitive_id * 3 + 2]], ray, hit,
+                      hit_record);
+}
+
+void Mesh::EvaluateTriangleHit(const Vertex &v0,
+                               const Vertex &v1,
+                               const Vertex &v2,
+                               const Ray &ray,
+                               const RayHit &hit,
+                               HitRecord *hit_record) {
+  float u = hit.uv.x;
+  float v = hit.uv.y;
+  float w = 1.0f - u - v;
+  hit_record->primitive_id = hit.primitive_id;
+  hit_record->position = ray.At(hit.t);
+  TexCoordDerivatives(v0, v1, v2, &hit_record->dpdu, &hit_record->dpdv);
+  hit_record->tex_coord =
+      v0.tex_coord * w + v1.tex_coord * u + v2.tex_coord * v;
+  auto geometry_normal = glm::normalize(
+      glm::cross(v1.position - v0.position, v2.position - v0.position));
+  auto normal = v0.normal * w + v1.normal * u + v2.normal * v;
+  auto tangent = v0.tangent * w + v1.tangent * u + v2.tangent * v;
+  // The frame faces the ray, front_face tells which side was hit.
+  hit_record->front_face = glm::dot(geometry_normal, ray.direction) < 0.0f;
+  float side = hit_record->front_face ? 1.0f : -1.0f;
+  hit_record->geometry_normal = geometry_normal * side;
+  hit_record->normal = normal * side;
+  hit_record->tangent = tangent * side;
+}
+
+void Mesh::TexCoordDerivatives(const Vertex &v0,
+                               const Vertex &v1,
+                               const Vertex &v2,
+                               glm::vec3 *dpdu,
+                               glm::vec3 *dpdv) {
+  auto duv1 = v1.tex_coord - v0.tex_coord;
+  auto duv2 = v2.tex_coord - v0.tex_coord;
+  float det = duv1.x * duv2.y - duv1.y * duv2.x;
+  if (std::abs(det) < 1e-12f) {
+    *dpdu = glm::vec3{0.0f};
+    *dpdv = glm::vec3{0.0f};
+    return;
+  }
+  auto dp1 = v1.position - v0.position;
+  auto dp2 = v2.position - v0.position;
+  float inv_det = 1.0f / det;
+  *dpdu = (dp1 * duv2.y - dp2 * duv1.y) * inv_det;
+  *dpdv = (dp2 * duv1.x - dp1 * duv2.x) * inv_det;
 }
 
 void Mesh::WriteObjFile(const std::string &file_path) const {
@@ -158,135 +476,43 @@ void Mesh::WriteObjFile(const std::string &file_path) const {
     file.close();
   }
 }
-std::vector<Vertex> Mesh::GetVertices() const {
+Span<const Vertex> Mesh::GetVertexView() const {
   return vertices_;
 }
-std::vector<uint32_t> Mesh::GetIndices() const {
+Span<const uint32_t> Mesh::GetIndexView() const {
   return indices_;
 }
 
 bool Mesh::LoadObjFile(const std::string &obj_file_path, Mesh &mesh) {
-  tinyobj::ObjReaderConfig reader_config;
-  reader_config.mtl_search_path = "./";  // Path to material files
-
-  tinyobj::ObjReader reader;
-
-  if (!reader.ParseFromFile(obj_file_path, reader_config)) {
-    if (!reader.Error().empty()) {
-      LAND_WARN("[Load obj, ERROR]: {}", reader.Error());
-    }
-    return false;
-  }
-
-  if (!reader.Warning().empty()) {
-    LAND_WARN("{}", reader.Warning());
-  }
-
-  auto &attrib = reader.GetAttrib();
-  auto &shapes = reader.GetShapes();
-  auto &materials = reader.GetMaterials();
-
   std::vector<Vertex> vertices;
   std::vector<uint32_t> indices;
-
-  // Loop over shapes
-  for (size_t s = 0; s < shapes.size(); s++) {
-    // Loop over faces(polygon)
-    size_t index_offset = 0;
-    for (size_t f = 0; f < shapes[s].mesh.num_face_vertices.size(); f++) {
-      size_t fv = size_t(shapes[s].mesh.num_face_vertices[f]);
-
-      // Loop over vertices in the face.
-      std::vector<Vertex> face_vertices;
-      for (size_t v = 0; v < fv; v++) {
-        Vertex vertex{};
-        // access to vertex
-        tinyobj::index_t idx = shapes[s].mesh.indices[index_offset + v];
-        tinyobj::real_t vx = attrib.vertices[3 * size_t(idx.vertex_index) + 0];
-        tinyobj::real_t vy = attrib.vertices[3 * size_t(idx.vertex_index) + 1];
-        tinyobj::real_t vz = attrib.vertices[3 * size_t(idx.vertex_index) + 2];
-        vertex.position = {vx, vy, vz};
-        // Check if `normal_index` is zero or positive. negative = no normal
-        // data
-        if (idx.normal_index >= 0) {
-          tinyobj::real_t nx = attrib.normals[3 * size_t(idx.normal_index) + 0];
-          tinyobj::real_t ny = attrib.normals[3 * size_t(idx.normal_index) + 1];
-          tinyobj::real_t nz = attrib.normals[3 * size_t(idx.normal_index) + 2];
-          vertex.normal = {nx, ny, nz};
-        } else {
-          vertex.normal = {0.0f, 0.0f, 0.0f};
-        }
-
-        // Check if `texcoord_index` is zero or positive. negative = no texcoord
-        // data
-        if (idx.texcoord_index >= 0) {
-          tinyobj::real_t tx =
-              attrib.texcoords[2 * size_t(idx.texcoord_index) + 0];
-          tinyobj::real_t ty =
-              attrib.texcoords[2 * size_t(idx.texcoord_index) + 1];
-          vertex.tex_coord = {tx, ty};
-        }
-        face_vertices.push_back(vertex);
-      }
-
-      for (int i = 1; i < face_vertices.size() - 1; i++) {
-        Vertex v0 = face_vertices[0];
-        Vertex v1 = face_vertices[i];
-        Vertex v2 = face_vertices[i + 1];
-        auto geometry_normal = glm::normalize(
-            glm::cross(v1.position - v0.position, v2.position - v0.position));
-        if (v0.normal == glm::vec3{0.0f, 0.0f, 0.0f}) {
-          v0.normal = geometry_normal;
-        } else if (glm::dot(geometry_normal, v0.normal) < 0.0f) {
-          v0.normal = -v0.normal;
-        }
-        if (v1.normal == glm::vec3{0.0f, 0.0f, 0.0f}) {
-          v1.normal = geometry_normal;
-        } else if (glm::dot(geometry_normal, v1.normal) < 0.0f) {
-          v1.normal = -v1.normal;
-        }
-        if (v2.normal == glm::vec3{0.0f, 0.0f, 0.0f}) {
-          v2.normal = geometry_normal;
-        } else if (glm::dot(geometry_normal, v2.normal) < 0.0f) {
-          v2.normal = -v2.normal;
-        }
-        indices.push_back(vertices.size());
-        indices.push_back(vertices.size() + 1);
-        indices.push_back(vertices.size() + 2);
-        vertices.push_back(v0);
-        vertices.push_back(v1);
-        vertices.push_back(v2);
-      }
-
-      index_offset += fv;
-    }
+  if (!ParseObjFile(obj_file_path, vertices, indices)) {
+    return false;
   }
-  mesh = Mesh(vertices, indices);
-  mesh.MergeVertices();
+  mesh = Mesh(std::move(vertices), std::move(indices));
   return true;
 }
 
 void Mesh::MergeVertices() {
+  const int num_vertices = int(vertices_.size());
+  auto representatives = FindRepresentatives(vertices_);
+
+  // Numbered in the order of first use, unreferenced vertices are dropped.
+  std::vector<uint32_t> new_indices(num_vertices, UINT32_MAX);
   std::vector<Vertex> vertices;
-  std::vector<uint32_t> indices;
-  std::unordered_map<Vertex, uint32_t, VertexHash> vertex_index_map;
-  auto index_func = [&vertices, &vertex_index_map](const Vertex &v) {
-    if (vertex_index_map.count(v)) {
-      return vertex_index_map.at(v);
+  for (auto &index : indices_) {
+    auto representative = representatives[index];
+    auto &new_index = new_indices[representative];
+    if (new_index == UINT32_MAX) {
+      new_index = uint32_t(vertices.size());
+      vertices.push_back(vertices_[representative]);
     }
-    uint32_t res = vertices.size();
-    vertex_index_map[v] = res;
-    vertices.push_back(v);
-    return res;
-  };
-  for (auto ind : indices_) {
-    indices.push_back(index_func(vertices_[ind]));
+    index = new_index;
   }
-  vertices_ = vertices;
-  indices_ = indices;
+  vertices_.swap(vertices);
 }
 
-const char *Mesh::GetDefaultEntityName() {
+const char *Mesh::GetDefaultEntityName() const {
   return "Mesh";
 }
 
@@ -375,81 +601,77 @@ Mesh::Mesh(const tinyxml2::XMLElement *element) {
 void Mesh::BuildTangent() {
   LAND_INFO("Building tangent.");
 
-  std::vector<Vertex> vertices(indices_.size());
-  for (int i = 0; i < indices_.size(); i++) {
-    vertices[i] = vertices_[indices_[i]];
-    indices_[i] = i;
+  // MikkTSpace runs on independent chunks of faces, every corner receives
+  // its own tangent space and equal corners are welded again afterwards.
+  // Corners depending on faces of other chunks are redone in one more run
+  // over all the faces they depend on, so the result matches a single run
+  // over the whole mesh.
+  std::vector<Vertex> corners(indices_.size());
+  int num_faces = int(indices_.size() / 3);
+  int num_chunks = (num_faces + kTangentChunkFaces - 1) / kTangentChunkFaces;
+  std::atomic_bool failed{false};
+  ParallelFor(0, num_chunks, [&](int chunk_index) {
+    int first_face = chunk_index * kTangentChunkFaces;
+    TangentChunk chunk{
+        &vertices_, indices_.data() + size_t(first_face) * 3,
+        std::min(kTangentChunkFaces, num_faces - first_face),
+        corners.data() + size_t(first_face) * 3};
+    if (!GenerateTangents(chunk)) {
+      failed = true;
+    }
+  });
+
+  std::vector<bool> is_border_corner;
+  auto border_faces =
+      num_chunks > 1 ? FindTangentBorder(vertices_, indices_, &is_border_corner)
+                     : std::vector<int>{};
+  if (!border_faces.empty()) {
+    std::vector<uint32_t> border_indices;
+    border_indices.reserve(border_faces.size() * 3);
+    for (int face : border_faces) {
+      auto face_indices = indices_.begin() + size_t(face) * 3;
+      border_indices.insert(border_indices.end(), face_indices,
+                            face_indices + 3);
+    }
+    std::vector<Vertex> border_corners(border_indices.size());
+    TangentChunk chunk{&vertices_, border_indices.data(),
+                       int(border_faces.size()), border_corners.data()};
+    if (!GenerateTangents(chunk)) {
+      failed = true;
+    }
+    for (size_t i = 0; i < border_faces.size(); i++) {
+      for (int corner = 0; corner < 3; corner++) {
+        auto index = size_t(border_faces[i]) * 3 + corner;
+        if (is_border_corner[index]) {
+          corners[index] = border_corners[i * 3 + corner];
+        }
+      }
+    }
   }
-  vertices_ = vertices;
-
-  SMikkTSpaceInterface interface {};
-
-  interface.m_getNumFaces = [](const SMikkTSpaceContext *context) {
-    auto mesh = reinterpret_cast<Mesh *>(context->m_pUserData);
-    return int(mesh->indices_.size() / 3);
-  };
-
-  interface.m_getNumVerticesOfFace = [](const SMikkTSpaceContext *context,
-                                        const int i_face) { return 3; };
-
-  interface.m_getNormal = [](const SMikkTSpaceContext *context,
-                             float normal_out[], const int i_face,
-                             const int i_vert) {
-    auto mesh = reinterpret_cast<Mesh *>(context->m_pUserData);
-    auto normal = mesh->vertices_[mesh->indices_[i_face * 3 + i_vert]].normal;
-    normal_out[0] = normal.x;
-    normal_out[1] = normal.y;
-    normal_out[2] = normal.z;
-  };
-
-  interface.m_getPosition = [](const SMikkTSpaceContext *context,
-                               float position_out[], const int i_face,
-                               const int i_vert) {
-    auto mesh = reinterpret_cast<Mesh *>(context->m_pUserData);
-    auto position =
-        mesh->vertices_[mesh->indices_[i_face * 3 + i_vert]].position;
-    position_out[0] = position.x;
-    position_out[1] = position.y;
-    position_out[2] = position.z;
-  };
-
-  interface.m_getTexCoord = [](const SMikkTSpaceContext *context,
-                               float texcoord_out[], const int i_face,
-                               const int i_vert) {
-    auto mesh = reinterpret_cast<Mesh *>(context->m_pUserData);
-    auto tex_coord =
-        mesh->vertices_[mesh->indices_[i_face * 3 + i_vert]].tex_coord;
-    texcoord_out[0] = tex_coord.x;
-    texcoord_out[1] = tex_coord.y;
-  };
-
-  interface.m_setTSpaceBasic = [](const SMikkTSpaceContext *context,
-                                  const float tangent[], const float sign,
-                                  const int i_face, const int i_vert) {
-    auto mesh = reinterpret_cast<Mesh *>(context->m_pUserData);
-    auto &vert = mesh->vertices_[i_face * 3 + i_vert];
-    vert.tangent = glm::vec3{tangent[0], tangent[1], tangent[2]};
-    vert.signal = sign;
-  };
-
-  SMikkTSpaceContext context{};
-  context.m_pInterface = &interface;
-  context.m_pUserData = reinterpret_cast<void *>(this);
-
-  if (!genTangSpaceDefault(&context)) {
+  if (failed) {
     LAND_WARN("Build MikkTSpace failed.");
   }
 
-  for (auto &vertex : vertices_) {
-    if (std::abs(glm::dot(vertex.normal, vertex.tangent)) > 1e-4f) {
-      vertex.tangent = glm::cross(vertex.normal, glm::vec3{1.0f, 0.0f, 0.0f});
-      if (glm::length(vertex.tangent) < 1e-4f) {
-        vertex.tangent = glm::cross(vertex.normal, glm::vec3{0.0f, 1.0f, 0.0f});
-      }
-      vertex.tangent = glm::normalize(vertex.tangent);
-    }
-  }
+  ParallelFor(
+      0, int(corners.size()),
+      [&](int i) {
+        auto &vertex = corners[i];
+        if (std::abs(glm::dot(vertex.normal, vertex.tangent)) > 1e-4f) {
+          vertex.tangent =
+              glm::cross(vertex.normal, glm::vec3{1.0f, 0.0f, 0.0f});
+          if (glm::length(vertex.tangent) < 1e-4f) {
+            vertex.tangent =
+                glm::cross(vertex.normal, glm::vec3{0.0f, 1.0f, 0.0f});
+          }
+          vertex.tangent = glm::normalize(vertex.tangent);
+        }
+      },
+      kWeldBlockSize);
 
+  vertices_.swap(corners);
+  for (size_t i = 0; i < indices_.size(); i++) {
+    indices_[i] = uint32_t(i);
+  }
   MergeVertices();
 }
 
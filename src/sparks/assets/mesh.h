@@ -8,20 +8,22 @@ namespace sparks {
 class Mesh : public Model {
  public:
   Mesh() = default;
-  Mesh(const Mesh &mesh);
-  Mesh(const std::vector<Vertex> &vertices,
-       const std::vector<uint32_t> &indices);
+  Mesh(const Mesh &mesh) = default;
+  Mesh(Mesh &&mesh) noexcept = default;
+  Mesh(std::vector<Vertex> vertices, std::vector<uint32_t> indices);
   explicit Mesh(const tinyxml2::XMLElement *element);
   ~Mesh() override = default;
-  [[nodiscard]] float TraceRay(const glm::vec3 &origin,
-                               const glm::vec3 &direction,
-                               float t_min,
-                               HitRecord *hit_record) const override;
-  const char *GetDefaultEntityName() override;
+  Mesh &operator=(const Mesh &mesh) = default;
+  Mesh &operator=(Mesh &&mesh) noexcept = default;
+  [[nodiscard]] bool Intersect(const Ray &ray, RayHit *hit) const override;
+  void EvaluateHit(const Ray &ray,
+                   const RayHit &hit,
+                   HitRecord *hit_record) const override;
+  const char *GetDefaultEntityName() const override;
   [[nodiscard]] AxisAlignedBoundingBox GetAABB(
       const glm::mat4 &transform) const override;
-  [[nodiscard]] std::vector<Vertex> GetVertices() const override;
-  [[nodiscard]] std::vector<uint32_t> GetIndices() const override;
+  [[nodiscard]] Span<const Vertex> GetVertexView() const override;
+  [[nodiscard]] Span<const uint32_t> GetIndexView() const override;
   static Mesh Cube(const glm::vec3 &center, const glm::vec3 &size);
   static Mesh Sphere(const glm::vec3 &center = glm::vec3{0.0f},
                      float radius = 1.0f);
@@ -31,6 +33,26 @@ class Mesh : public Model {
   void BuildTangent();
 
  protected:
+  // Stores the hit to hit if the ray enters the triangle within its range.
+  bool IntersectTriangle(int primitive_id, const Ray &ray, RayHit *hit) const;
+  static void EvaluateTriangleHit(const Vertex &v0,
+                                  const Vertex &v1,
+                                  const Vertex &v2,
+                                  const Ray &ray,
+                                  const RayHit &hit,
+                                  HitRecord *hit_record);
+  static bool IntersectTriangle(const glm::vec3 &p0,
+                                const glm::vec3 &edge1,
+                                const glm::vec3 &edge2,
+                                int primitive_id,
+                                const Ray &ray,
+                                RayHit *hit);
+  static void TexCoordDerivatives(const Vertex &v0,
+                                  const Vertex &v1,
+                                  const Vertex &v2,
+                                  glm::vec3 *dpdu,
+                                  glm::vec3 *dpdv);
+
   std::vector<Vertex> vertices_;
   std::vector<uint32_t> indices_;
 };
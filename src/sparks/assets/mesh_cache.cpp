@@ -0,0 +1,293 @@
+#include "sparks/assets/mesh_cache.h"
+
+#include "cstring"
+#include "filesystem"
+#include "fstream"
+#include "sparks/util/mapped_file.h"
+#include "sparks/util/util.h"
+
+namespace sparks {
+
+namespace {
+// Bump whenever the loader, the welding, the tangent generation, the
+// acceleration structure builders, the tree optimization or the reordering
+// produce different results.
+constexpr uint32_t kMeshCacheVersion = 4;
+constexpr char kMeshCacheMagic[8] = "SPKMESH";
+constexpr size_t kMeshCacheAlignment = 16;
+
+struct MeshCacheHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t vertex_size;
+  uint32_t node_size;
+  int32_t root;
+  uint32_t bvh_quality;
+  uint64_t source_size;
+  int64_t source_time;
+  uint64_t num_vertices;
+  uint64_t num_indices;
+  uint64_t num_nodes;
+  // The canonical source path follows the header.
+  uint64_t path_length;
+};
+
+size_t AlignOffset(size_t offset) {
+  return (offset + kMeshCacheAlignment - 1) & ~(kMeshCacheAlignment - 1);
+}
+
+// Fills everything but the array sizes and the root, false if the source
+// cannot be inspected.
+bool MakeHeader(const std::string &source_path,
+                std::string *canonical_path,
+                MeshCacheHeader *header) {
+  std::error_code error_code;
+  auto path = std::filesystem::u8path(source_path);
+  *canonical_path =
+      std::filesystem::weakly_canonical(path, error_code).u8string();
+  if (error_code) {
+    return false;
+  }
+  auto source_size = std::filesystem::file_size(path, error_code);
+  if (error_code) {
+    return false;
+  }
+  auto source_time = std::filesystem::last_write_time(path, error_code);
+  if (error_code) {
+    return false;
+  }
+  *header = MeshCacheHeader{};
+  std::memcpy(header->magic, kMeshCacheMagic, sizeof(header->magic));
+  header->version = kMeshCacheVersion;
+  header->vertex_size = uint32_t(sizeof(Vertex));
+  header->node_size = uint32_t(sizeof(detail::TreeNode));
+  header->source_size = uint64_t(source_size);
+  header->source_time = int64_t(source_time.time_since_epoch().count());
+  header->path_length = canonical_path->size();
+  return true;
+}
+
+struct MeshCacheLayout {
+  size_t vertex_offset;
+  size_t index_offset;
+  size_t node_offset;
+  // One per node, like the triangles.
+  size_t triangle_position_offset;
+  // As many preview indices as indices.
+  size_t preview_index_offset;
+  size_t size;
+};
+
+MeshCacheLayout GetLayout(const MeshCacheHeader &header) {
+  MeshCacheLayout layout{};
+  layout.vertex_offset =
+      AlignOffset(sizeof(MeshCacheHeader) + header.path_length);
+  layout.index_offset =
+      AlignOffset(layout.vertex_offset + header.num_vertices * sizeof(Vertex));
+  layout.node_offset = AlignOffset(layout.index_offset +
+                                   header.num_indices * sizeof(uint32_t));
+  layout.triangle_position_offset = AlignOffset(
+      layout.node_offset + header.num_nodes * sizeof(detail::TreeNode));
+  layout.preview_index_offset =
+      AlignOffset(layout.triangle_position_offset +
+                  header.num_nodes * sizeof(detail::TrianglePositions));
+  layout.size = layout.preview_index_offset +
+                header.num_indices * sizeof(uint32_t);
+  return layout;
+}
+
+template <class T>
+Span<const T> MappedArray(const MappedFile &file,
+                          size_t offset,
+                          uint64_t size) {
+  return {reinterpret_cast<const T *>(file.GetData() + offset), size_t(size)};
+}
+
+// Out of range links of a damaged file would be followed past the mapping.
+// The nodes are stored in preorder, so children come after their parent,
+// which also rules out cycles.
+bool IsTopologyValid(const MeshCacheHeader &header,
+                     Span<const uint32_t> indices,
+                     Span<const uint32_t> preview_indices,
+                     Span<const detail::TreeNode> nodes) {
+  for (auto &span : {indices, preview_indices}) {
+    for (auto index : span) {
+      if (index >= header.num_vertices) {
+        return false;
+      }
+    }
+  }
+  if (header.root != (nodes.empty() ? -1 : 0)) {
+    return false;
+  }
+  for (size_t i = 0; i < nodes.size(); i++) {
+    for (int child : nodes[i].child) {
+      if (child != -1 &&
+          (child <= int64_t(i) || child >= int64_t(nodes.size()))) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+}  // namespace
+
+MeshCache::MeshCache() {
+  std::error_code error_code;
+  auto temp_directory = std::filesystem::temp_directory_path(error_code);
+  if (!error_code) {
+    directory_ = (temp_directory / "sparks_mesh_cache").u8string();
+  }
+}
+
+MeshCache &MeshCache::GetInstance() {
+  static MeshCache instance;
+  return instance;
+}
+
+void MeshCache::SetDirectory(const std::string &directory) {
+  directory_ = directory;
+}
+
+const std::string &MeshCache::GetDirectory() const {
+  return directory_;
+}
+
+bool MeshCache::Load(const std::string &source_path,
+                     AcceleratedMesh &mesh) const {
+  if (directory_.empty()) {
+    return false;
+  }
+  std::string canonical_path;
+  MeshCacheHeader expected_header{};
+  if (!MakeHeader(source_path, &canonical_path, &expected_header)) {
+    return false;
+  }
+  auto cache_path =
+      std::filesystem::u8path(directory_) /
+      (std::to_string(std::hash<std::string>()(canonical_path)) + ".mesh");
+  // Meshes are traced in place, their trees are walked in any order.
+  auto file = std::make_shared<const MappedFile>(cache_path.u8string(),
+                                                 FILE_ACCESS_PATTERN_NORMAL);
+  if (!file->IsOpen() || file->GetSize() < sizeof(MeshCacheHeader)) {
+    return false;
+  }
+
+  MeshCacheHeader header{};
+  std::memcpy(&header, file->GetData(), sizeof(header));
+  if (std::memcmp(header.magic, expected_header.magic, sizeof(header.magic)) ||
+      header.version != expected_header.version ||
+      header.vertex_size != expected_header.vertex_size ||
+      header.node_size != expected_header.node_size ||
+      header.source_size != expected_header.source_size ||
+      header.source_time != expected_header.source_time ||
+      header.path_length != expected_header.path_length ||
+      file->GetSize() < sizeof(MeshCacheHeader) + header.path_length ||
+      std::memcmp(file->GetData() + sizeof(MeshCacheHeader),
+                  canonical_path.data(), canonical_path.size())) {
+    return false;
+  }
+  auto layout = GetLayout(header);
+  if (file->GetSize() != layout.size || header.num_indices % 3 ||
+      header.num_nodes != header.num_indices / 3 ||
+      header.bvh_quality > BVH_BUILD_QUALITY_OPTIMIZED) {
+    LAND_WARN("[Sparks] Mesh cache \"{}\" is corrupted.",
+              cache_path.u8string());
+    return false;
+  }
+  auto vertices =
+      MappedArray<Vertex>(*file, layout.vertex_offset, header.num_vertices);
+  auto indices =
+      MappedArray<uint32_t>(*file, layout.index_offset, header.num_indices);
+  auto nodes = MappedArray<detail::TreeNode>(*file, layout.node_offset,
+                                             header.num_nodes);
+  auto triangle_positions = MappedArray<detail::TrianglePositions>(
+      *file, layout.triangle_position_offset, header.num_nodes);
+  auto preview_indices = MappedArray<uint32_t>(
+      *file, layout.preview_index_offset, header.num_indices);
+  if (!IsTopologyValid(header, indices, preview_indices, nodes)) {
+    LAND_WARN("[Sparks] Mesh cache \"{}\" is corrupted.",
+              cache_path.u8string());
+    return false;
+  }
+
+  // The mesh reads the arrays in place and keeps the file mapped.
+  mesh = AcceleratedMesh();
+  mesh.cache_file_ = std::move(file);
+  mesh.root_ = header.root;
+  mesh.bvh_quality_ = BvhBuildQuality(header.bvh_quality);
+  mesh.vertex_view_ = vertices;
+  mesh.index_view_ = indices;
+  mesh.tree_node_view_ = nodes;
+  mesh.triangle_position_view_ = triangle_positions;
+  mesh.preview_index_view_ = preview_indices;
+  return true;
+}
+
+void MeshCache::Store(const std::string &source_path,
+                      const AcceleratedMesh &mesh) const {
+  // Compact meshes no longer hold the full vertices, they are cached before
+  // the conversion.
+  if (directory_.empty() || mesh.GetVertexFormat() != VERTEX_FORMAT_FULL) {
+    return;
+  }
+  std::string canonical_path;
+  MeshCacheHeader header{};
+  if (!MakeHeader(source_path, &canonical_path, &header)) {
+    return;
+  }
+  header.root = mesh.root_;
+  header.bvh_quality = uint32_t(mesh.bvh_quality_);
+  header.num_vertices = mesh.vertex_view_.size();
+  header.num_indices = mesh.index_view_.size();
+  header.num_nodes = mesh.tree_node_view_.size();
+  auto layout = GetLayout(header);
+
+  std::error_code error_code;
+  auto directory = std::filesystem::u8path(directory_);
+  std::filesystem::create_directories(directory, error_code);
+  auto cache_path =
+      directory /
+      (std::to_string(std::hash<std::string>()(canonical_path)) + ".mesh");
+  // Written aside and renamed, so that readers never see a partial file.
+  auto temp_path = cache_path;
+  temp_path += ".tmp";
+  {
+    std::ofstream file(temp_path, std::ios::binary | std::ios::trunc);
+    size_t position = 0;
+    auto write_at = [&](size_t offset, const void *data, size_t size) {
+      static const char kPadding[kMeshCacheAlignment]{};
+      file.write(kPadding, std::streamsize(offset - position));
+      file.write(static_cast<const char *>(data), std::streamsize(size));
+      position = offset + size;
+    };
+    write_at(0, &header, sizeof(header));
+    write_at(sizeof(header), canonical_path.data(), canonical_path.size());
+    write_at(layout.vertex_offset, mesh.vertex_view_.data(),
+             mesh.vertex_view_.size() * sizeof(Vertex));
+    write_at(layout.index_offset, mesh.index_view_.data(),
+             mesh.index_view_.size() * sizeof(uint32_t));
+    write_at(layout.node_offset, mesh.tree_node_view_.data(),
+             mesh.tree_node_view_.size() * sizeof(detail::TreeNode));
+    write_at(layout.triangle_position_offset,
+             mesh.triangle_position_view_.data(),
+             mesh.triangle_position_view_.size() *
+                 sizeof(detail::TrianglePositions));
+    auto preview_indices = mesh.GetPreviewIndexView();
+    write_at(layout.preview_index_offset, preview_indices.data(),
+             preview_indices.size() * sizeof(uint32_t));
+    if (!file) {
+      LAND_WARN("[Sparks] Write mesh cache \"{}\" failed.",
+                temp_path.u8string());
+      file.close();
+      std::filesystem::remove(temp_path, error_code);
+      return;
+    }
+  }
+  std::filesystem::rename(temp_path, cache_path, error_code);
+  if (error_code) {
+    std::filesystem::remove(temp_path, error_code);
+  }
+}
+
+}  // namespace sparks
@@ -0,0 +1,35 @@
+#pragma once
+#include "sparks/assets/accelerated_mesh.h"
+#include "string"
+
+namespace sparks {
+
+// On-disk cache of meshes loaded from files together with their acceleration
+// structure. Each source file gets one cache file, named after a hash of its
+// canonical path, whose header records the path, the size and modification
+// time of the source and the version of the layout and of the builders. A
+// cache file is only used when all of them match, anything else is rebuilt.
+//
+// The arrays are stored in the in-memory layout of the mesh behind a fixed
+// header. A loaded mesh keeps the file mapped and traces straight out of it,
+// pages are read in as the traversal touches them.
+class MeshCache {
+ public:
+  static MeshCache &GetInstance();
+
+  // Empty disables the cache. Defaults to sparks_mesh_cache inside the
+  // temporary directory of the system.
+  void SetDirectory(const std::string &directory);
+  [[nodiscard]] const std::string &GetDirectory() const;
+
+  bool Load(const std::string &source_path, AcceleratedMesh &mesh) const;
+  void Store(const std::string &source_path,
+             const AcceleratedMesh &mesh) const;
+
+ private:
+  MeshCache();
+
+  std::string directory_;
+};
+
+}  // namespace sparks
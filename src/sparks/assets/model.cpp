@@ -1,7 +1,32 @@
 #include "sparks/assets/model.h"
 
 namespace sparks {
-const char *Model::GetDefaultEntityName() {
+float Model::TraceRay(const Ray &ray, HitRecord *hit_record) const {
+  RayHit hit;
+  if (!Intersect(ray, &hit)) {
+    return -1.0f;
+  }
+  if (hit_record) {
+    EvaluateHit(ray, hit, hit_record);
+  }
+  return hit.t;
+}
+
+Span<const uint32_t> Model::GetPreviewIndexView() const {
+  return GetIndexView();
+}
+
+std::vector<Vertex> Model::GetVertices() const {
+  auto vertices = GetVertexView();
+  return {vertices.begin(), vertices.end()};
+}
+
+std::vector<uint32_t> Model::GetIndices() const {
+  auto indices = GetIndexView();
+  return {indices.begin(), indices.end()};
+}
+
+const char *Model::GetDefaultEntityName() const {
   return "Unknown Model";
 }
 }  // namespace sparks
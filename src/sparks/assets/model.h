@@ -3,7 +3,9 @@
 #include "iostream"
 #include "sparks/assets/aabb.h"
 #include "sparks/assets/hit_record.h"
+#include "sparks/assets/ray.h"
 #include "sparks/assets/vertex.h"
+#include "sparks/util/span.h"
 #include "sparks/util/util.h"
 #include "vector"
 
@@ -11,14 +13,30 @@ namespace sparks {
 class Model {
  public:
   virtual ~Model() = default;
-  [[nodiscard]] virtual float TraceRay(const glm::vec3 &origin,
-                                       const glm::vec3 &direction,
-                                       float t_min,
-                                       HitRecord *hit_record) const = 0;
+  // Finds the closest hit within [ray.t_min, ray.t_max] and stores it to hit,
+  // which is left untouched if there is none.
+  [[nodiscard]] virtual bool Intersect(const Ray &ray, RayHit *hit) const = 0;
+  // Evaluates the surface at a hit Intersect found for the same ray.
+  virtual void EvaluateHit(const Ray &ray,
+                           const RayHit &hit,
+                           HitRecord *hit_record) const = 0;
+  // Intersect followed by EvaluateHit if hit_record is not null. Returns the
+  // distance of the hit, or a negative value if there is none.
+  [[nodiscard]] float TraceRay(const Ray &ray, HitRecord *hit_record) const;
   [[nodiscard]] virtual AxisAlignedBoundingBox GetAABB(
       const glm::mat4 &transform) const = 0;
-  [[nodiscard]] virtual std::vector<Vertex> GetVertices() const = 0;
-  [[nodiscard]] virtual std::vector<uint32_t> GetIndices() const = 0;
-  virtual const char *GetDefaultEntityName();
+  // Views of the geometry owned by the model, valid until it is modified or
+  // destroyed. Models keeping their vertices in a compact format have no
+  // vertex view, GetVertices decodes them.
+  [[nodiscard]] virtual Span<const Vertex> GetVertexView() const = 0;
+  [[nodiscard]] virtual Span<const uint32_t> GetIndexView() const = 0;
+  // The triangles of the index view in the order the raster preview draws
+  // them, its primitive ids do not match the ones of the index view.
+  [[nodiscard]] virtual Span<const uint32_t> GetPreviewIndexView() const;
+  // Copies of the views, for callers that need to own the geometry or the
+  // full format of the vertices.
+  [[nodiscard]] virtual std::vector<Vertex> GetVertices() const;
+  [[nodiscard]] std::vector<uint32_t> GetIndices() const;
+  virtual const char *GetDefaultEntityName() const;
 };
 }  // namespace sparks
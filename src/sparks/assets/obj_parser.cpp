@@ -0,0 +1,518 @@
+#include "sparks/assets/obj_parser.h"
+
+#include "algorithm"
+#include "atomic"
+#include "cmath"
+#include "cstring"
+#include "sparks/util/mapped_file.h"
+#include "sparks/util/util.h"
+#include "unordered_map"
+
+namespace sparks {
+
+namespace {
+constexpr size_t kChunkSize = size_t(16) << 20;
+constexpr size_t kTrianglesPerBlock = size_t(1) << 16;
+constexpr int kNumShards = 256;
+
+// Attribute indices of a face corner, -1 marks an absent attribute.
+struct ObjCorner {
+  int position;
+  int tex_coord;
+  int normal;
+};
+
+struct ObjChunk {
+  const char *begin{nullptr};
+  const char *end{nullptr};
+  size_t num_positions{0};
+  size_t num_tex_coords{0};
+  size_t num_normals{0};
+  size_t num_triangles{0};
+  // Number of statements of each kind in the preceding chunks.
+  size_t position_offset{0};
+  size_t tex_coord_offset{0};
+  size_t normal_offset{0};
+  size_t triangle_offset{0};
+};
+
+struct ObjData {
+  std::vector<glm::vec3> positions;
+  std::vector<glm::vec2> tex_coords;
+  std::vector<glm::vec3> normals;
+  std::vector<ObjCorner> corners;
+  std::atomic_bool error{false};
+};
+
+// Corners weld when they reference the same position and tex coord and end
+// up with bitwise equal normals, after the fallback to the geometry normal
+// and the flip towards it.
+struct CornerKey {
+  uint32_t position;
+  uint32_t tex_coord;
+  uint32_t normal[3];
+
+  bool operator==(const CornerKey &key) const {
+    return position == key.position && tex_coord == key.tex_coord &&
+           normal[0] == key.normal[0] && normal[1] == key.normal[1] &&
+           normal[2] == key.normal[2];
+  }
+};
+
+struct CornerKeyHash {
+  std::size_t operator()(const CornerKey &key) const {
+    uint64_t hash = 0x9e3779b97f4a7c15ull;
+    for (uint32_t word : {key.position, key.tex_coord, key.normal[0],
+                          key.normal[1], key.normal[2]}) {
+      hash = (hash ^ word) * 0xff51afd7ed558ccdull;
+      hash ^= hash >> 32;
+    }
+    return std::size_t(hash);
+  }
+};
+
+struct ShardEntry {
+  CornerKey key;
+  uint32_t corner;
+};
+
+bool IsSpace(char c) {
+  return c == ' ' || c == '\t' || c == '\r';
+}
+
+bool IsDigit(char c) {
+  return c >= '0' && c <= '9';
+}
+
+const char *SkipSpaces(const char *p, const char *end) {
+  while (p < end && IsSpace(*p)) {
+    p++;
+  }
+  return p;
+}
+
+const char *SkipToken(const char *p, const char *end) {
+  while (p < end && !IsSpace(*p)) {
+    p++;
+  }
+  return p;
+}
+
+double Pow10(int exponent) {
+  static const double kExactPowers[] = {
+      1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+      1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+  if (exponent <= 22) {
+    return kExactPowers[exponent];
+  }
+  return std::pow(10.0, double(exponent));
+}
+
+// Decimal floats as written by exporters, accumulating up to 18 significant
+// digits and scaling by an exact power of ten where possible. Anything else,
+// such as inf and nan, goes through strtof.
+bool ParseFloat(const char **cursor, const char *end, float *value) {
+  const char *p = *cursor;
+  bool negative = false;
+  if (p < end && (*p == '-' || *p == '+')) {
+    negative = *p == '-';
+    p++;
+  }
+  uint64_t mantissa = 0;
+  int exponent = 0;
+  bool any_digit = false;
+  for (; p < end && IsDigit(*p); p++) {
+    any_digit = true;
+    if (mantissa < 100000000000000000ull) {
+      mantissa = mantissa * 10 + uint64_t(*p - '0');
+    } else {
+      exponent++;
+    }
+  }
+  if (p < end && *p == '.') {
+    for (p++; p < end && IsDigit(*p); p++) {
+      any_digit = true;
+      if (mantissa < 100000000000000000ull) {
+        mantissa = mantissa * 10 + uint64_t(*p - '0');
+        exponent--;
+      }
+    }
+  }
+  if (!any_digit) {
+    char buffer[64];
+    size_t length = std::min(size_t(SkipToken(*cursor, end) - *cursor),
+                             sizeof(buffer) - 1);
+    std::memcpy(buffer, *cursor, length);
+    buffer[length] = '\0';
+    char *parsed_end;
+    *value = std::strtof(buffer, &parsed_end);
+    if (parsed_end == buffer) {
+      return false;
+    }
+    *cursor += parsed_end - buffer;
+    return true;
+  }
+  if (p + 1 < end && (*p == 'e' || *p == 'E')) {
+    const char *q = p + 1;
+    bool negative_exponent = false;
+    if (*q == '-' || *q == '+') {
+      negative_exponent = *q == '-';
+      q++;
+    }
+    if (q < end && IsDigit(*q)) {
+      int explicit_exponent = 0;
+      for (; q < end && IsDigit(*q); q++) {
+        explicit_exponent =
+            std::min(explicit_exponent * 10 + (*q - '0'), 100000);
+      }
+      exponent += negative_exponent ? -explicit_exponent : explicit_exponent;
+      p = q;
+    }
+  }
+  double result = double(mantissa);
+  if (mantissa) {
+    result =
+        exponent < 0 ? result / Pow10(-exponent) : result * Pow10(exponent);
+  }
+  *value = float(negative ? -result : result);
+  *cursor = p;
+  return true;
+}
+
+bool ParseIndex(const char **cursor, const char *end, int64_t *value) {
+  const char *p = *cursor;
+  bool negative = false;
+  if (p < end && (*p == '-' || *p == '+')) {
+    negative = *p == '-';
+    p++;
+  }
+  if (p == end || !IsDigit(*p)) {
+    return false;
+  }
+  int64_t result = 0;
+  for (; p < end && IsDigit(*p); p++) {
+    result = std::min(result * 10 + (*p - '0'), int64_t(1) << 40);
+  }
+  *value = negative ? -result : result;
+  *cursor = p;
+  return true;
+}
+
+// Turns a 1-based or negative relative OBJ index into a 0-based one, count is
+// the number of attributes defined before the statement. Returns -1 for
+// indices out of [0, total).
+int ResolveIndex(int64_t index, size_t count, size_t total) {
+  int64_t resolved = index > 0 ? index - 1 : int64_t(count) + index;
+  if (!index || resolved < 0 || resolved >= int64_t(total)) {
+    return -1;
+  }
+  return int(resolved);
+}
+
+int ParseFloats(const char *p, const char *end, float *values, int count) {
+  int parsed = 0;
+  for (; parsed < count; parsed++) {
+    p = SkipSpaces(p, end);
+    if (!ParseFloat(&p, end, values + parsed)) {
+      break;
+    }
+  }
+  return parsed;
+}
+
+// First pass over a chunk when parse is false, counting the statements.
+// Second pass when parse is true, filling data at the offsets of the chunk.
+void ScanChunk(ObjChunk *chunk, ObjData *data, bool parse) {
+  size_t num_positions = 0;
+  size_t num_tex_coords = 0;
+  size_t num_normals = 0;
+  size_t num_triangles = 0;
+  std::vector<ObjCorner> polygon;
+  for (const char *line = chunk->begin; line < chunk->end;) {
+    auto line_end = static_cast<const char *>(
+        std::memchr(line, '\n', size_t(chunk->end - line)));
+    if (!line_end) {
+      line_end = chunk->end;
+    }
+    const char *p = SkipSpaces(line, line_end);
+    line = line_end < chunk->end ? line_end + 1 : line_end;
+    if (line_end - p < 2) {
+      continue;
+    }
+
+    if (p[0] == 'v' && IsSpace(p[1])) {
+      if (parse) {
+        auto &position = data->positions[chunk->position_offset +
+                                         num_positions];
+        if (ParseFloats(p + 2, line_end, &position[0], 3) != 3) {
+          data->error = true;
+        }
+      }
+      num_positions++;
+    } else if (p[0] == 'v' && p[1] == 't' && p + 2 < line_end &&
+               IsSpace(p[2])) {
+      if (parse) {
+        auto &tex_coord = data->tex_coords[chunk->tex_coord_offset +
+                                           num_tex_coords];
+        if (ParseFloats(p + 3, line_end, &tex_coord[0], 2) < 1) {
+          data->error = true;
+        }
+      }
+      num_tex_coords++;
+    } else if (p[0] == 'v' && p[1] == 'n' && p + 2 < line_end &&
+               IsSpace(p[2])) {
+      if (parse) {
+        auto &normal = data->normals[chunk->normal_offset + num_normals];
+        if (ParseFloats(p + 3, line_end, &normal[0], 3) != 3) {
+          data->error = true;
+        }
+      }
+      num_normals++;
+    } else if (p[0] == 'f' && IsSpace(p[1])) {
+      polygon.clear();
+      for (p = SkipSpaces(p + 2, line_end); p < line_end;
+           p = SkipSpaces(p, line_end)) {
+        auto token_end = SkipToken(p, line_end);
+        ObjCorner corner{0, -1, -1};
+        if (parse) {
+          int64_t index;
+          if (ParseIndex(&p, token_end, &index)) {
+            corner.position =
+                ResolveIndex(index, chunk->position_offset + num_positions,
+                             data->positions.size());
+          } else {
+            corner.position = -1;
+          }
+          if (p < token_end && *p == '/') {
+            p++;
+            if (p < token_end && *p != '/' &&
+                ParseIndex(&p, token_end, &index)) {
+              corner.tex_coord =
+                  ResolveIndex(index, chunk->tex_coord_offset + num_tex_coords,
+                               data->tex_coords.size());
+              if (corner.tex_coord < 0) {
+                data->error = true;
+              }
+            }
+            if (p < token_end && *p == '/') {
+              p++;
+              if (ParseIndex(&p, token_end, &index)) {
+                corner.normal =
+                    ResolveIndex(index, chunk->normal_offset + num_normals,
+                                 data->normals.size());
+                if (corner.normal < 0) {
+                  data->error = true;
+                }
+              }
+            }
+          }
+          if (corner.position < 0) {
+            data->error = true;
+            corner.position = 0;
+          }
+        }
+        polygon.push_back(corner);
+        p = token_end;
+      }
+      if (polygon.size() < 3) {
+        continue;
+      }
+      if (parse) {
+        auto *corners =
+            data->corners.data() + (chunk->triangle_offset + num_triangles) * 3;
+        for (size_t i = 1; i + 1 < polygon.size(); i++) {
+          *corners++ = polygon[0];
+          *corners++ = polygon[i];
+          *corners++ = polygon[i + 1];
+        }
+      }
+      num_triangles += polygon.size() - 2;
+    }
+  }
+  chunk->num_positions = num_positions;
+  chunk->num_tex_coords = num_tex_coords;
+  chunk->num_normals = num_normals;
+  chunk->num_triangles = num_triangles;
+}
+
+std::vector<ObjChunk> SplitChunks(const char *data, size_t size) {
+  size_t num_chunks = std::max((size + kChunkSize - 1) / kChunkSize, size_t(1));
+  std::vector<ObjChunk> chunks(num_chunks);
+  const char *end = data + size;
+  const char *begin = data;
+  for (size_t i = 0; i < num_chunks; i++) {
+    chunks[i].begin = begin;
+    if (i + 1 < num_chunks) {
+      const char *split = std::max(data + (i + 1) * kChunkSize, begin);
+      auto newline = static_cast<const char *>(
+          std::memchr(split, '\n', size_t(end - split)));
+      begin = newline ? newline + 1 : end;
+    } else {
+      begin = end;
+    }
+    chunks[i].end = begin;
+  }
+  return chunks;
+}
+
+CornerKey MakeCornerKey(const ObjData &data,
+                        const ObjCorner &corner,
+                        const glm::vec3 &geometry_normal) {
+  glm::vec3 normal{0.0f};
+  if (corner.normal >= 0) {
+    normal = data.normals[corner.normal];
+  }
+  if (normal == glm::vec3{0.0f}) {
+    normal = geometry_normal;
+  } else if (glm::dot(geometry_normal, normal) < 0.0f) {
+    normal = -normal;
+  }
+  CornerKey key{uint32_t(corner.position), uint32_t(corner.tex_coord), {}};
+  std::memcpy(key.normal, &normal[0], sizeof(key.normal));
+  return key;
+}
+
+Vertex MakeVertex(const ObjData &data, const CornerKey &key) {
+  glm::vec3 normal;
+  std::memcpy(&normal[0], key.normal, sizeof(key.normal));
+  glm::vec2 tex_coord{0.0f};
+  if (int(key.tex_coord) >= 0) {
+    tex_coord = data.tex_coords[key.tex_coord];
+  }
+  return {data.positions[key.position], normal, tex_coord};
+}
+}  // namespace
+
+bool ParseObjFile(const std::string &file_path,
+                  std::vector<Vertex> &vertices,
+                  std::vector<uint32_t> &indices) {
+  MappedFile file(file_path);
+  if (!file.IsOpen()) {
+    LAND_WARN("[Load obj, ERROR]: Cannot open file \"{}\".", file_path);
+    return false;
+  }
+
+  auto chunks = SplitChunks(file.GetData(), file.GetSize());
+  ObjData data;
+  ParallelFor(0, int(chunks.size()),
+              [&](int i) { ScanChunk(&chunks[i], &data, false); });
+  size_t num_positions = 0;
+  size_t num_tex_coords = 0;
+  size_t num_normals = 0;
+  size_t num_triangles = 0;
+  for (auto &chunk : chunks) {
+    chunk.position_offset = num_positions;
+    chunk.tex_coord_offset = num_tex_coords;
+    chunk.normal_offset = num_normals;
+    chunk.triangle_offset = num_triangles;
+    num_positions += chunk.num_positions;
+    num_tex_coords += chunk.num_tex_coords;
+    num_normals += chunk.num_normals;
+    num_triangles += chunk.num_triangles;
+  }
+  if (num_triangles * 3 > size_t(UINT32_MAX) || num_positions > INT32_MAX ||
+      num_tex_coords > INT32_MAX || num_normals > INT32_MAX) {
+    LAND_WARN("[Load obj, ERROR]: \"{}\" exceeds 32-bit indices.", file_path);
+    return false;
+  }
+  data.positions.resize(num_positions);
+  data.tex_coords.resize(num_tex_coords);
+  data.normals.resize(num_normals);
+  data.corners.resize(num_triangles * 3);
+  ParallelFor(0, int(chunks.size()),
+              [&](int i) { ScanChunk(&chunks[i], &data, true); });
+  if (data.error) {
+    LAND_WARN("[Load obj, ERROR]: Malformed statement in \"{}\".", file_path);
+    return false;
+  }
+
+  // Corners are bucketed into shards by position index, so every shard can
+  // be welded independently. Entries keep the file order inside a shard,
+  // which keeps the output deterministic.
+  int num_blocks =
+      int((num_triangles + kTrianglesPerBlock - 1) / kTrianglesPerBlock);
+  auto shard_of = [num_positions](int position) {
+    return int(uint64_t(position) * kNumShards / num_positions);
+  };
+  std::vector<uint32_t> shard_offsets(size_t(num_blocks) * kNumShards, 0);
+  auto block_counts = [&](int block, int shard) -> uint32_t & {
+    return shard_offsets[size_t(shard) * num_blocks + block];
+  };
+  ParallelFor(0, num_blocks, [&](int block) {
+    size_t corner_end =
+        std::min((size_t(block) + 1) * kTrianglesPerBlock, num_triangles) * 3;
+    for (size_t i = size_t(block) * kTrianglesPerBlock * 3; i < corner_end;
+         i++) {
+      block_counts(block, shard_of(data.corners[i].position))++;
+    }
+  });
+  uint32_t offset = 0;
+  for (auto &shard_offset : shard_offsets) {
+    auto count = shard_offset;
+    shard_offset = offset;
+    offset += count;
+  }
+
+  std::vector<ShardEntry> entries(num_triangles * 3);
+  ParallelFor(0, num_blocks, [&](int block) {
+    size_t triangle_end =
+        std::min((size_t(block) + 1) * kTrianglesPerBlock, num_triangles);
+    for (size_t i = size_t(block) * kTrianglesPerBlock; i < triangle_end;
+         i++) {
+      const auto *corners = data.corners.data() + i * 3;
+      const auto &p0 = data.positions[corners[0].position];
+      auto geometry_normal =
+          glm::normalize(glm::cross(data.positions[corners[1].position] - p0,
+                                    data.positions[corners[2].position] - p0));
+      for (int j = 0; j < 3; j++) {
+        auto &entry_offset = block_counts(block, shard_of(corners[j].position));
+        entries[entry_offset++] = {
+            MakeCornerKey(data, corners[j], geometry_normal),
+            uint32_t(i * 3 + j)};
+      }
+    }
+  });
+  std::vector<ObjCorner>().swap(data.corners);
+
+  // block_counts now holds the end of each (shard, block) range.
+  auto shard_begin = [&](int shard) {
+    return shard ? block_counts(num_blocks - 1, shard - 1) : 0u;
+  };
+  auto shard_end = [&](int shard) {
+    return num_blocks ? block_counts(num_blocks - 1, shard) : 0u;
+  };
+  indices.resize(num_triangles * 3);
+  std::vector<std::vector<Vertex>> shard_vertices(kNumShards);
+  ParallelFor(0, kNumShards, [&](int shard) {
+    std::unordered_map<CornerKey, uint32_t, CornerKeyHash> vertex_ids;
+    vertex_ids.reserve((shard_end(shard) - shard_begin(shard)) / 4);
+    auto &shard_vertex_list = shard_vertices[shard];
+    for (auto i = shard_begin(shard); i < shard_end(shard); i++) {
+      auto &entry = entries[i];
+      auto result = vertex_ids.emplace(
+          entry.key, uint32_t(shard_vertex_list.size()));
+      if (result.second) {
+        shard_vertex_list.push_back(MakeVertex(data, entry.key));
+      }
+      indices[entry.corner] = result.first->second;
+    }
+  });
+
+  std::vector<uint32_t> vertex_offsets(kNumShards + 1, 0);
+  for (int shard = 0; shard < kNumShards; shard++) {
+    vertex_offsets[shard + 1] =
+        vertex_offsets[shard] + uint32_t(shard_vertices[shard].size());
+  }
+  vertices.resize(vertex_offsets[kNumShards]);
+  ParallelFor(0, kNumShards, [&](int shard) {
+    std::copy(shard_vertices[shard].begin(), shard_vertices[shard].end(),
+              vertices.begin() + vertex_offsets[shard]);
+    std::vector<Vertex>().swap(shard_vertices[shard]);
+    for (auto i = shard_begin(shard); i < shard_end(shard); i++) {
+      indices[entries[i].corner] += vertex_offsets[shard];
+    }
+  });
+  return true;
+}
+
+}  // namespace sparks
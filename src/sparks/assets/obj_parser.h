@@ -0,0 +1,19 @@
+#pragma once
+#include "sparks/assets/vertex.h"
+#include "string"
+#include "vector"
+
+namespace sparks {
+
+// Loads the triangles of a Wavefront OBJ file into indexed vertices. The file
+// is memory mapped and split into newline aligned chunks that are parsed in
+// parallel, corners are welded on their (position, tex coord, normal) indices
+// without materializing a vertex per corner. Polygons are fanned into
+// triangles. Corners without a normal take the geometry normal of their
+// triangle, given normals are flipped to its side. Groups, materials and
+// every other statement are ignored.
+bool ParseObjFile(const std::string &file_path,
+                  std::vector<Vertex> &vertices,
+                  std::vector<uint32_t> &indices);
+
+}  // namespace sparks
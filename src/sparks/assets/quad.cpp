@@ -0,0 +1,121 @@
+#include "sparks/assets/quad.h"
+
+namespace sparks {
+
+Quad::Quad(const glm::vec3 &corner,
+           const glm::vec3 &edge_u,
+           const glm::vec3 &edge_v)
+    : corner_(corner), edge_u_(edge_u), edge_v_(edge_v) {
+  BuildNormal();
+}
+
+Quad::Quad(const tinyxml2::XMLElement *element) {
+  auto child_element = element->FirstChildElement("corner");
+  if (child_element) {
+    corner_ = StringToVec3(child_element->FindAttribute("value")->Value());
+  }
+  child_element = element->FirstChildElement("edge_u");
+  if (child_element) {
+    edge_u_ = StringToVec3(child_element->FindAttribute("value")->Value());
+  }
+  child_element = element->FirstChildElement("edge_v");
+  if (child_element) {
+    edge_v_ = StringToVec3(child_element->FindAttribute("value")->Value());
+  }
+  BuildNormal();
+}
+
+void Quad::BuildNormal() {
+  normal_ = glm::normalize(glm::cross(edge_u_, edge_v_));
+}
+
+bool Quad::Intersect(const Ray &ray, RayHit *hit) const {
+  float cos_direction = glm::dot(ray.direction, normal_);
+  if (std::abs(cos_direction) < 1e-9f) {
+    return false;
+  }
+  float t = glm::dot(corner_ - ray.origin, normal_) / cos_direction;
+  if (t < ray.t_min || t > ray.t_max) {
+    return false;
+  }
+  auto offset = ray.At(t) - corner_;
+  // Least squares solution of edge_u * u + edge_v * v = offset.
+  float a11 = glm::dot(edge_u_, edge_u_);
+  float a12 = glm::dot(edge_u_, edge_v_);
+  float a22 = glm::dot(edge_v_, edge_v_);
+  float b1 = glm::dot(edge_u_, offset);
+  float b2 = glm::dot(edge_v_, offset);
+  float inv_det = 1.0f / (a11 * a22 - a12 * a12);
+  float u = (a22 * b1 - a12 * b2) * inv_det;
+  float v = (a11 * b2 - a12 * b1) * inv_det;
+  if (u < 0.0f || u > 1.0f || v < 0.0f || v > 1.0f) {
+    return false;
+  }
+  hit->t = t;
+  hit->primitive_id = v <= u ? 0 : 1;
+  hit->uv = {u, v};
+  return true;
+}
+
+void Quad::EvaluateHit(const Ray &ray,
+                       const RayHit &hit,
+                       HitRecord *hit_record) const {
+  hit_record->primitive_id = hit.primitive_id;
+  hit_record->position = ray.At(hit.t);
+  hit_record->tex_coord = hit.uv;
+  hit_record->dpdu = edge_u_;
+  hit_record->dpdv = edge_v_;
+  hit_record->front_face = glm::dot(ray.direction, normal_) < 0.0f;
+  float side = hit_record->front_face ? 1.0f : -1.0f;
+  hit_record->geometry_normal = normal_ * side;
+  hit_record->normal = normal_ * side;
+  hit_record->tangent = glm::normalize(edge_u_) * side;
+}
+
+AxisAlignedBoundingBox Quad::GetAABB(const glm::mat4 &transform) const {
+  AxisAlignedBoundingBox result(
+      glm::vec3{transform * glm::vec4{corner_, 1.0f}});
+  result |= {glm::vec3{transform * glm::vec4{corner_ + edge_u_, 1.0f}}};
+  result |= {glm::vec3{transform * glm::vec4{corner_ + edge_v_, 1.0f}}};
+  result |= {
+      glm::vec3{transform * glm::vec4{corner_ + edge_u_ + edge_v_, 1.0f}}};
+  return result;
+}
+
+const char *Quad::GetDefaultEntityName() const {
+  return "Quad";
+}
+
+void Quad::SamplePatch(int primitive_id,
+                       float r1,
+                       float r2,
+                       glm::vec3 *position,
+                       glm::vec3 *normal) const {
+  // Uniform point of the triangle (0, 0), (1, 0), (1, 1), mirrored on the
+  // diagonal for primitive 1.
+  float sqrt_r1 = std::sqrt(r1);
+  glm::vec2 uv{sqrt_r1, sqrt_r1 * r2};
+  if (primitive_id) {
+    uv = {uv.y, uv.x};
+  }
+  *position = corner_ + edge_u_ * uv.x + edge_v_ * uv.y;
+  *normal = normal_;
+}
+
+float Quad::GetPatchArea(int /*primitive_id*/, const glm::mat3 &linear) const {
+  return 0.5f * glm::length(glm::cross(linear * edge_u_, linear * edge_v_));
+}
+
+void Quad::Tessellate(std::vector<Vertex> &vertices,
+                      std::vector<uint32_t> &indices) const {
+  vertices.clear();
+  for (auto uv : {glm::vec2{0.0f, 0.0f}, glm::vec2{1.0f, 0.0f},
+                  glm::vec2{1.0f, 1.0f}, glm::vec2{0.0f, 1.0f}}) {
+    Vertex vertex(corner_ + edge_u_ * uv.x + edge_v_ * uv.y, normal_, uv);
+    vertex.tangent = glm::normalize(edge_u_);
+    vertices.push_back(vertex);
+  }
+  indices = {0, 1, 2, 0, 2, 3};
+}
+
+}  // namespace sparks
@@ -0,0 +1,46 @@
+#pragma once
+#include "sparks/assets/analytic_model.h"
+#include "sparks/assets/util.h"
+
+namespace sparks {
+
+// Two-sided parallelogram corner + u * edge_u + v * edge_v over the unit
+// square of (u, v), which are also its texture coordinates. Primitive 0 is
+// the triangle v <= u, primitive 1 the triangle v >= u, so the patches are
+// the triangles themselves.
+class Quad : public AnalyticModel {
+ public:
+  explicit Quad(const glm::vec3 &corner = glm::vec3{-1.0f, 0.0f, 1.0f},
+                const glm::vec3 &edge_u = glm::vec3{2.0f, 0.0f, 0.0f},
+                const glm::vec3 &edge_v = glm::vec3{0.0f, 0.0f, -2.0f});
+  explicit Quad(const tinyxml2::XMLElement *element);
+  [[nodiscard]] bool Intersect(const Ray &ray, RayHit *hit) const override;
+  void EvaluateHit(const Ray &ray,
+                   const RayHit &hit,
+                   HitRecord *hit_record) const override;
+  [[nodiscard]] AxisAlignedBoundingBox GetAABB(
+      const glm::mat4 &transform) const override;
+  const char *GetDefaultEntityName() const override;
+  void SamplePatch(int primitive_id,
+                   float r1,
+                   float r2,
+                   glm::vec3 *position,
+                   glm::vec3 *normal) const override;
+  [[nodiscard]] float GetPatchArea(int primitive_id,
+                                   const glm::mat3 &linear) const override;
+
+ protected:
+  void Tessellate(std::vector<Vertex> &vertices,
+                  std::vector<uint32_t> &indices) const override;
+
+ private:
+  void BuildNormal();
+
+  glm::vec3 corner_{-1.0f, 0.0f, 1.0f};
+  glm::vec3 edge_u_{2.0f, 0.0f, 0.0f};
+  glm::vec3 edge_v_{0.0f, 0.0f, -2.0f};
+  // Normalized edge_u x edge_v.
+  glm::vec3 normal_{0.0f, 1.0f, 0.0f};
+};
+
+}  // namespace sparks
@@ -0,0 +1,42 @@
+#pragma once
+#include "cmath"
+#include "glm/glm.hpp"
+
+namespace sparks {
+
+constexpr float kRayTMax = 1e10f;
+
+// Ray with its reciprocal direction and sign bits precomputed for slab
+// tests. Only hits with t_min <= t <= t_max count, traversals shrink t_max
+// to the closest hit found so far.
+struct Ray {
+  glm::vec3 origin{0.0f};
+  glm::vec3 direction{0.0f, 0.0f, 1.0f};
+  // Components are infinite along axes the direction does not move on.
+  glm::vec3 inv_direction{kRayTMax, kRayTMax, 1.0f};
+  // 1 where the direction is negative, selecting the near and far planes.
+  int sign[3]{};
+  float t_min{0.0f};
+  float t_max{kRayTMax};
+
+  Ray() = default;
+  Ray(const glm::vec3 &origin,
+      const glm::vec3 &direction,
+      float t_min = 0.0f,
+      float t_max = kRayTMax)
+      : origin(origin),
+        direction(direction),
+        inv_direction(1.0f / direction),
+        t_min(t_min),
+        t_max(t_max) {
+    for (int i = 0; i < 3; i++) {
+      sign[i] = std::signbit(direction[i]);
+    }
+  }
+
+  [[nodiscard]] glm::vec3 At(float t) const {
+    return origin + direction * t;
+  }
+};
+
+}  // namespace sparks
@@ -2,12 +2,32 @@
 
 #include "glm/glm.hpp"
 #include "glm/gtc/matrix_transform.hpp"
+#include "filesystem"
 #include "imgui.h"
-#include "sparks/assets/accelerated_mesh.h"
+#include "sparks/assets/box.h"
+#include "sparks/assets/disk.h"
+#include "sparks/assets/mesh_cache.h"
+#include "sparks/assets/quad.h"
+#include "sparks/assets/sphere.h"
+#include "sparks/util/thread_pool.h"
 #include "sparks/util/util.h"
 
 namespace sparks {
 
+namespace {
+std::string CanonicalPath(const std::string &file_path) {
+  std::error_code error_code;
+  auto canonical_path =
+      std::filesystem::weakly_canonical(std::filesystem::u8path(file_path),
+                                        error_code)
+          .u8string();
+  if (error_code) {
+    return file_path;
+  }
+  return canonical_path;
+}
+}  // namespace
+
 Scene::Scene() {
   AddTexture(Texture(1, 1, glm::vec4{1.0f}, SAMPLE_TYPE_LINEAR), "Pure White");
   AddTexture(Texture(1, 1, glm::vec4{0.0f}, SAMPLE_TYPE_LINEAR), "Pure Black");
@@ -28,8 +48,18 @@ int Scene::GetTextureCount() const {
 }
 
 void Scene::Clear() {
+  WaitTextureLoads();
   textures_.clear();
+  texture_names_.clear();
+  texture_path_ids_.clear();
+  texture_content_ids_.clear();
   entities_.clear();
+  obj_models_.clear();
+  mesh_assets_.clear();
+  instance_bvh_.Clear();
+  light_sampler_.Clear();
+  envmap_sampler_.Clear();
+  envmap_cubemap_.Clear();
   camera_ = Camera{};
 }
 
@@ -114,64 +144,63 @@ const glm::vec3 &Scene::GetCameraPitchYawRoll() const {
 }
 
 void Scene::UpdateEnvmapConfiguration() {
-  const auto &scene = *this;
-  auto envmap_id = scene.GetEnvmapId();
-  auto &envmap_texture = scene.GetTextures()[envmap_id];
-  auto buffer = envmap_texture.GetBuffer();
-
-  envmap_minor_color_ = glm::vec3{0.0f};
-  envmap_major_color_ = glm::vec3{0.0f};
-  envmap_cdf_.resize(envmap_texture.GetWidth() * envmap_texture.GetHeight());
-
-  std::vector<float> sample_scale_(envmap_texture.GetHeight() + 1);
-  auto inv_width = 1.0f / float(envmap_texture.GetWidth());
-  auto inv_height = 1.0f / float(envmap_texture.GetHeight());
-  for (int i = 0; i <= envmap_texture.GetHeight(); i++) {
-    float x = float(i) * glm::pi<float>() * inv_height;
-    sample_scale_[i] = (-std::cos(x) + 1.0f) * 0.5f;
-  }
-
-  auto width_height = envmap_texture.GetWidth() * envmap_texture.GetHeight();
-  float total_weight = 0.0f;
-  float major_strength = -1.0f;
-  for (int y = 0; y < envmap_texture.GetHeight(); y++) {
-    auto scale = sample_scale_[y + 1] - sample_scale_[y];
-
-    auto theta = (float(y) + 0.5f) * inv_height * glm::pi<float>();
-    auto sin_theta = std::sin(theta);
-    auto cos_theta = std::cos(theta);
-
-    for (int x = 0; x < envmap_texture.GetWidth(); x++) {
-      auto phi = (float(x) + 0.5f) * inv_width * glm::pi<float>() * 2.0f;
-      auto sin_phi = std::sin(phi);
-      auto cos_phi = std::cos(phi);
-
-      auto i = y * envmap_texture.GetWidth() + x;
-      auto color = glm::vec3{buffer[i]};
+  auto &envmap_texture = textures_[envmap_id_];
+  envmap_sampler_.Build(envmap_texture);
+  envmap_total_power_ = envmap_sampler_.GetTotalPower();
+  envmap_cubemap_.Build(envmap_texture);
+  UpdateEnvmapRotation();
+
+  int width = int(envmap_texture.GetWidth());
+  int height = int(envmap_texture.GetHeight());
+  auto inv_width = 1.0f / float(width);
+  auto inv_height = 1.0f / float(height);
+  struct RowSummary {
+    glm::vec3 major_color{0.0f};
+    glm::vec3 minor_color{0.0f};
+    float major_strength{-1.0f};
+    int major_x{0};
+  };
+  std::vector<RowSummary> row_summaries(height);
+  ParallelFor(0, height, [&](int y) {
+    auto &summary = row_summaries[y];
+    auto scale = (std::cos(float(y) * PI * inv_height) -
+                  std::cos(float(y + 1) * PI * inv_height)) *
+                 0.5f * inv_width;
+    for (int x = 0; x < width; x++) {
+      auto color = glm::vec3{envmap_texture(x, y)};
       auto minor_color = glm::clamp(color, 0.0f, 1.0f);
-      auto major_color = color - minor_color;
-      envmap_major_color_ += major_color * (scale * inv_width);
-      envmap_minor_color_ += minor_color * (scale * inv_width);
-
+      summary.major_color += (color - minor_color) * scale;
+      summary.minor_color += minor_color * scale;
       auto strength = std::max(color.x, std::max(color.y, color.z));
-      if (strength > major_strength) {
-        envmap_light_direction_ = {sin_theta * sin_phi, cos_theta,
-                                   -sin_theta * cos_phi};
-        major_strength = strength;
+      if (strength > summary.major_strength) {
+        summary.major_strength = strength;
+        summary.major_x = x;
       }
-      total_weight += strength * inv_width * scale;
-      envmap_cdf_[i] = total_weight;
     }
-  }
+  });
 
-  envmap_total_power_ = total_weight;
-
-  auto inv_total_weight = 1.0f / total_weight;
-  for (auto &v : envmap_cdf_) {
-    v *= inv_total_weight;
+  envmap_minor_color_ = glm::vec3{0.0f};
+  envmap_major_color_ = glm::vec3{0.0f};
+  float major_strength = -1.0f;
+  for (int y = 0; y < height; y++) {
+    auto &summary = row_summaries[y];
+    envmap_major_color_ += summary.major_color;
+    envmap_minor_color_ += summary.minor_color;
+    if (summary.major_strength > major_strength) {
+      major_strength = summary.major_strength;
+      auto theta = (float(y) + 0.5f) * inv_height * PI;
+      auto phi = (float(summary.major_x) + 0.5f) * inv_width * PI * 2.0f;
+      envmap_light_direction_ = {std::sin(theta) * std::sin(phi),
+                                 std::cos(theta),
+                                 -std::sin(theta) * std::cos(phi)};
+    }
   }
-  envmap_cdf_.push_back(1.0f);
 }
+void Scene::UpdateEnvmapRotation() {
+  envmap_rotation_offset_ = envmap_offset_;
+  envmap_rotation_ = {std::cos(envmap_offset_), std::sin(envmap_offset_)};
+}
+
 glm::vec3 Scene::GetEnvmapLightDirection() const {
   float sin_offset = std::sin(envmap_offset_);
   float cos_offset = std::cos(envmap_offset_);
@@ -187,67 +216,138 @@ const glm::vec3 &Scene::GetEnvmapMinorColor() const {
 const glm::vec3 &Scene::GetEnvmapMajorColor() const {
   return envmap_major_color_;
 }
-const std::vector<float> &Scene::GetEnvmapCdf() const {
-  return envmap_cdf_;
+const EnvmapSampler &Scene::GetEnvmapSampler() const {
+  return envmap_sampler_;
 }
 
-float Scene::TraceRay(const glm::vec3 &origin,
-                      const glm::vec3 &direction,
-                      float t_min,
-                      float t_max,
-                      HitRecord *hit_record) const {
+const EnvmapCubemap &Scene::GetEnvmapCubemap() const {
+  return envmap_cubemap_;
+}
+
+void Scene::UpdateLightSampler(bool enable_light_bvh) {
+  light_sampler_.Update(entities_, enable_light_bvh);
+}
+
+const LightSampler &Scene::GetLightSampler() const {
+  return light_sampler_;
+}
+
+void Scene::UpdateInstanceBvh() {
+  instance_bvh_.Build(entities_);
+}
+
+float Scene::TraceRay(const Ray &ray, HitRecord *hit_record) const {
+  // The search only keeps the closest hit in model space along with the
+  // transform it was found under, its surface is evaluated once at the end.
   float result = -1.0f;
-  HitRecord local_hit_record;
-  float local_result;
-  for (int entity_id = 0; entity_id < entities_.size(); entity_id++) {
-    auto &entity = entities_[entity_id];
-    auto &transform = entity.GetTransformMatrix();
-    auto inv_transform = glm::inverse(transform);
+  RayHit hit;
+  Ray hit_local_ray;
+  glm::mat4 hit_inv_transform{1.0f};
+  auto trace_entity = [&](int entity_id, const glm::mat4 &inv_transform) {
     auto transformed_direction =
-        glm::vec3{inv_transform * glm::vec4{direction, 0.0f}};
+        glm::vec3{inv_transform * glm::vec4{ray.direction, 0.0f}};
     auto transformed_direction_length = glm::length(transformed_direction);
     if (transformed_direction_length < 1e-6) {
-      continue;
+      return;
     }
-    local_result = entity.GetModel()->TraceRay(
-        inv_transform * glm::vec4{origin, 1.0f},
-        transformed_direction / transformed_direction_length, t_min,
-        hit_record ? &local_hit_record : nullptr);
-    local_result /= transformed_direction_length;
-    if (local_result > t_min && local_result < t_max &&
-        (result < 0.0f || local_result < result)) {
-      result = local_result;
-      if (hit_record) {
-        local_hit_record.position =
-            transform * glm::vec4{local_hit_record.position, 1.0f};
-        local_hit_record.normal = glm::transpose(inv_transform) *
-                                  glm::vec4{local_hit_record.normal, 0.0f};
-        local_hit_record.tangent =
-            transform * glm::vec4{local_hit_record.tangent, 0.0f};
-        local_hit_record.geometry_normal =
-            glm::transpose(inv_transform) *
-            glm::vec4{local_hit_record.geometry_normal, 0.0f};
-        *hit_record = local_hit_record;
-        hit_record->hit_entity_id = entity_id;
-      }
+    // The model space ray has unit direction, its distances are scaled by
+    // the direction length. The closest hit so far bounds the range.
+    float t_max = result < 0.0f ? ray.t_max : result;
+    Ray local_ray(inv_transform * glm::vec4{ray.origin, 1.0f},
+                  transformed_direction / transformed_direction_length,
+                  ray.t_min * transformed_direction_length,
+                  t_max * transformed_direction_length);
+    if (!entities_[entity_id].GetModel()->Intersect(local_ray, &hit)) {
+      return;
+    }
+    result = hit.t / transformed_direction_length;
+    hit.entity_id = entity_id;
+    if (hit_record) {
+      hit_local_ray = local_ray;
+      hit_inv_transform = inv_transform;
     }
+  };
+  instance_bvh_.Traverse(ray, [&](const InstanceBvh::Instance &instance) {
+    trace_entity(instance.entity_id, instance.inv_transform);
+    return result < 0.0f ? ray.t_max : result;
+  });
+  for (int entity_id = instance_bvh_.GetInstanceCount();
+       entity_id < entities_.size(); entity_id++) {
+    trace_entity(entity_id,
+                 glm::inverse(entities_[entity_id].GetTransformMatrix()));
   }
-  if (hit_record) {
-    hit_record->geometry_normal = glm::normalize(hit_record->geometry_normal);
-    hit_record->normal = glm::normalize(hit_record->normal);
-    hit_record->tangent = glm::normalize(hit_record->tangent);
+  if (result < 0.0f || !hit_record) {
+    return result;
   }
+
+  auto &entity = entities_[hit.entity_id];
+  auto &transform = entity.GetTransformMatrix();
+  auto normal_matrix = glm::transpose(glm::mat3{hit_inv_transform});
+  entity.GetModel()->EvaluateHit(hit_local_ray, hit, hit_record);
+  hit_record->hit_entity_id = hit.entity_id;
+  hit_record->position = transform * glm::vec4{hit_record->position, 1.0f};
+  hit_record->normal = glm::normalize(normal_matrix * hit_record->normal);
+  hit_record->geometry_normal =
+      glm::normalize(normal_matrix * hit_record->geometry_normal);
+  hit_record->tangent =
+      glm::normalize(transform * glm::vec4{hit_record->tangent, 0.0f});
+  hit_record->dpdu = transform * glm::vec4{hit_record->dpdu, 0.0f};
+  hit_record->dpdv = transform * glm::vec4{hit_record->dpdv, 0.0f};
   return result;
 }
 
 glm::vec4 Scene::SampleEnvmap(const glm::vec3 &direction) const {
+  return textures_[envmap_id_].Sample(DirectionToEnvmapCoord(direction));
+}
+
+glm::vec3 Scene::SampleEnvmapCubemap(const glm::vec3 &direction) const {
+  if (envmap_cubemap_.Empty()) {
+    return glm::vec3{SampleEnvmap(direction)};
+  }
+  auto rotation = envmap_rotation_;
+  if (envmap_rotation_offset_ != envmap_offset_) {
+    rotation = {std::cos(envmap_offset_), std::sin(envmap_offset_)};
+  }
+  // Turns the direction by the offset around the y axis, the inverse of
+  // GetEnvmapLightDirection.
+  return envmap_cubemap_.Sample(
+      {rotation.x * direction.x - rotation.y * direction.z, direction.y,
+       rotation.y * direction.x + rotation.x * direction.z});
+}
+
+float Scene::SampleEnvmapLight(float r1,
+                               float r2,
+                               glm::vec3 *direction) const {
+  glm::vec2 tex_coord;
+  float pdf =
+      envmap_sampler_.Sample(textures_[envmap_id_], r1, r2, &tex_coord);
+  if (pdf > 0.0f) {
+    *direction = EnvmapCoordToDirection(tex_coord);
+  }
+  return pdf;
+}
+
+float Scene::GetEnvmapLightPdf(const glm::vec3 &direction) const {
+  return envmap_sampler_.GetPdf(textures_[envmap_id_],
+                                DirectionToEnvmapCoord(direction));
+}
+
+glm::vec2 Scene::DirectionToEnvmapCoord(const glm::vec3 &direction) const {
   float x = envmap_offset_;
   float y = acos(direction.y) * INV_PI;
   if (glm::length(glm::vec2{direction.x, direction.y}) > 1e-4) {
     x += glm::atan(direction.x, -direction.z);
   }
   x *= INV_PI * 0.5;
-  return textures_[envmap_id_].Sample(glm::vec2{x, y});
+  return {x, y};
+}
+
+glm::vec3 Scene::EnvmapCoordToDirection(glm::vec2 tex_coord) const {
+  float phi = tex_coord.x * PI * 2.0f - envmap_offset_;
+  float theta = tex_coord.y * PI;
+  float sin_theta = std::sin(theta);
+  return {std::sin(phi) * sin_theta, std::cos(theta),
+          -std::cos(phi) * sin_theta};
 }
 
 const Texture &Scene::GetTexture(int texture_id) const {
@@ -283,26 +383,115 @@ bool Scene::EntityCombo(const char *label, int *current_item) const {
 }
 
 int Scene::LoadTexture(const std::string &file_path) {
-  Texture texture;
-  if (Texture::Load(file_path, texture)) {
-    return AddTexture(texture, PathToFilename(file_path));
-  } else {
+  int texture_id = LoadTextureAsync(file_path);
+  WaitTextureLoads();
+  if (texture_id < 0) {
     LAND_WARN("[Sparks] Load Texture \"{}\" failed.", file_path);
     return 0;
   }
+  return texture_id;
+}
+
+int Scene::LoadTextureAsync(const std::string &file_path,
+                            SampleType sample_type) {
+  auto canonical_path = CanonicalPath(file_path);
+  auto path_it = texture_path_ids_.find(canonical_path);
+  if (path_it != texture_path_ids_.end()) {
+    return path_it->second;
+  }
+
+  // Reading is cheap next to decoding, the bytes are hashed here so that
+  // copies of a file under other names share one texture.
+  auto file_data = std::make_shared<std::vector<uint8_t>>();
+  if (!ReadFile(file_path, *file_data)) {
+    return -1;
+  }
+  auto content_hash = std::hash<std::string_view>()(std::string_view(
+      reinterpret_cast<const char *>(file_data->data()), file_data->size()));
+  auto content_it = texture_content_ids_.find(content_hash);
+  if (content_it != texture_content_ids_.end()) {
+    texture_path_ids_[canonical_path] = content_it->second;
+    return content_it->second;
+  }
+
+  int texture_id = AddTexture(Texture{}, PathToFilename(file_path));
+  texture_path_ids_[canonical_path] = texture_id;
+  texture_content_ids_[content_hash] = texture_id;
+  pending_textures_.emplace_back(
+      texture_id,
+      ThreadPool::GetInstance().Submit([file_path, file_data, sample_type]() {
+        Texture texture;
+        if (!Texture::Load(file_path, *file_data, texture)) {
+          LAND_WARN("[Sparks] Decode Texture \"{}\" failed.", file_path);
+        }
+        texture.SetSampleType(sample_type);
+        return texture;
+      }));
+  return texture_id;
+}
+
+void Scene::WaitTextureLoads() {
+  for (auto &pending_texture : pending_textures_) {
+    textures_[pending_texture.first] = pending_texture.second.get();
+  }
+  pending_textures_.clear();
 }
 
 int Scene::LoadObjMesh(const std::string &file_path) {
-  AcceleratedMesh mesh;
-  if (Mesh::LoadObjFile(file_path, mesh)) {
-    mesh.BuildAccelerationStructure();
-    return AddEntity(mesh, Material{}, glm::mat4{1.0f},
-                     PathToFilename(file_path));
+  auto model =
+      LoadObjModel(file_path, VERTEX_FORMAT_FULL, BVH_BUILD_QUALITY_FAST);
+  if (model) {
+    int entity_id = AddEntity(std::move(model), Material{}, glm::mat4{1.0f},
+                              PathToFilename(file_path));
+    UpdateInstanceBvh();
+    return entity_id;
   } else {
     return -1;
   }
 }
 
+std::shared_ptr<const Model> Scene::LoadObjModel(
+    const std::string &file_path,
+    VertexFormat vertex_format,
+    BvhBuildQuality bvh_quality) {
+  // The same file in another format or tree quality is another model.
+  auto key = CanonicalPath(file_path) + '\n' + std::to_string(vertex_format) +
+             '\n' + std::to_string(bvh_quality);
+  auto it = obj_models_.find(key);
+  if (it != obj_models_.end()) {
+    return it->second;
+  }
+  auto mesh = std::make_shared<AcceleratedMesh>();
+  if (!LoadAcceleratedObjMesh(file_path, *mesh, bvh_quality)) {
+    return nullptr;
+  }
+  mesh->SetVertexFormat(vertex_format);
+  obj_models_[key] = mesh;
+  return mesh;
+}
+
+bool Scene::LoadAcceleratedObjMesh(const std::string &file_path,
+                                   AcceleratedMesh &mesh,
+                                   BvhBuildQuality bvh_quality) {
+  auto &mesh_cache = MeshCache::GetInstance();
+  if (mesh_cache.Load(file_path, mesh)) {
+    // Fast trees are not cached, so only a high quality tree falls short.
+    if (mesh.GetBvhQuality() < bvh_quality) {
+      mesh.OptimizeAccelerationStructure();
+      mesh_cache.Store(file_path, mesh);
+    }
+    return true;
+  }
+  if (!Mesh::LoadObjFile(file_path, mesh)) {
+    return false;
+  }
+  mesh.BuildAccelerationStructure(bvh_quality);
+  if (bvh_quality != BVH_BUILD_QUALITY_FAST) {
+    mesh_cache.Store(file_path, mesh);
+  }
+  return true;
+}
+
 Scene::Scene(const std::string &filename) : Scene() {
   if (filename.empty()) {
     return;
@@ -323,9 +512,10 @@ Scene::Scene(const std::string &filename) : Scene() {
       if (envmap_type == "file") {
         std::string envmap_filename =
             child_element->FindAttribute("value")->Value();
-        Texture envmap;
-        Texture::Load(envmap_filename, envmap);
-        envmap_id_ = AddTexture(envmap, PathToFilename(envmap_filename));
+        envmap_id_ = LoadTextureAsync(envmap_filename);
+        if (envmap_id_ < 0) {
+          envmap_id_ = AddTexture(Texture{}, PathToFilename(envmap_filename));
+        }
       } else if (envmap_type == "color") {
         glm::vec3 color =
             StringToVec3(child_element->FindAttribute("value")->Value());
@@ -358,31 +548,121 @@ Scene::Scene(const std::string &filename) : Scene() {
             std::stof(grandchild_element->FindAttribute("value")->Value());
       }
       camera_ = Camera(fov, aperture, focal_length);
-    } else if (element_type == "model") {
-      Mesh mesh = Mesh(child_element);
-      Material material{};
-
-      auto grandchild_element = child_element->FirstChildElement("material");
-      if (grandchild_element) {
-        material = Material(this, grandchild_element);
-      }
-
-      glm::mat4 transformation = XmlComposeTransformMatrix(child_element);
-
-      auto name_attribute = child_element->FindAttribute("name");
-      if (name_attribute) {
-        AddEntity(AcceleratedMesh(mesh), material, transformation,
-                  std::string(name_attribute->Value()));
-      } else {
-        AddEntity(AcceleratedMesh(mesh), material, transformation);
-      }
     } else {
-      LAND_ERROR("Unknown Element Type: {}", child_element->Value());
+      LoadXmlEntity(child_element, glm::mat4{1.0f}, nullptr);
     }
   }
 
+  WaitTextureLoads();
   SetCameraToWorld(camera_to_world);
   UpdateEnvmapConfiguration();
+  UpdateInstanceBvh();
+}
+
+std::shared_ptr<const Model> Scene::LoadXmlModel(
+    tinyxml2::XMLElement *element) {
+  std::string mesh_type{};
+  auto type_attribute = element->FindAttribute("type");
+  if (type_attribute) {
+    mesh_type = type_attribute->Value();
+  }
+  if (mesh_type == "obj") {
+    auto vertex_format = VERTEX_FORMAT_FULL;
+    auto format_element = element->FirstChildElement("vertex_format");
+    if (format_element) {
+      vertex_format = StringToVertexFormat(
+          format_element->FindAttribute("value")->Value());
+    }
+    auto bvh_quality = BVH_BUILD_QUALITY_HIGH;
+    auto quality_element = element->FirstChildElement("bvh_quality");
+    if (quality_element) {
+      bvh_quality = StringToBvhBuildQuality(
+          quality_element->FindAttribute("value")->Value());
+    }
+    auto model = LoadObjModel(element->FirstChildElement("filename")
+                                  ->FindAttribute("value")
+                                  ->Value(),
+                              vertex_format, bvh_quality);
+    if (model) {
+      return model;
+    }
+    return std::make_shared<AcceleratedMesh>();
+  } else if (mesh_type == "sphere") {
+    return std::make_shared<Sphere>(element);
+  } else if (mesh_type == "disk") {
+    return std::make_shared<Disk>(element);
+  } else if (mesh_type == "quad") {
+    return std::make_shared<Quad>(element);
+  } else if (mesh_type == "box") {
+    return std::make_shared<Box>(element);
+  }
+  return std::make_shared<AcceleratedMesh>(Mesh{element});
+}
+
+void Scene::LoadXmlEntity(tinyxml2::XMLElement *element,
+                          const glm::mat4 &parent_transform,
+                          const Material *parent_material) {
+  std::string element_type{element->Value()};
+  glm::mat4 transformation =
+      parent_transform * XmlComposeTransformMatrix(element);
+  std::optional<Material> material;
+  auto material_element = element->FirstChildElement("material");
+  if (material_element) {
+    material = Material(this, material_element);
+  }
+  auto name_attribute = element->FindAttribute("name");
+
+  if (element_type == "model") {
+    auto model = LoadXmlModel(element);
+    std::string name = name_attribute ? name_attribute->Value()
+                                      : model->GetDefaultEntityName();
+    AddEntity(std::move(model),
+              material          ? *material
+              : parent_material ? *parent_material
+                                : Material{},
+              transformation, name);
+  } else if (element_type == "mesh") {
+    auto id_attribute = element->FindAttribute("id");
+    if (!id_attribute) {
+      LAND_ERROR("Mesh declared without an id.");
+      return;
+    }
+    mesh_assets_[id_attribute->Value()] = {
+        LoadXmlModel(element), material, XmlComposeTransformMatrix(element)};
+  } else if (element_type == "instance") {
+    auto mesh_attribute = element->FindAttribute("mesh");
+    auto it = mesh_attribute ? mesh_assets_.find(mesh_attribute->Value())
+                             : mesh_assets_.end();
+    if (it == mesh_assets_.end()) {
+      LAND_ERROR("Instance of undeclared mesh: {}",
+                 mesh_attribute ? mesh_attribute->Value() : "");
+      return;
+    }
+    auto &mesh_asset = it->second;
+    Material instance_material{};
+    if (material) {
+      instance_material = *material;
+    } else if (parent_material) {
+      instance_material = *parent_material;
+    } else if (mesh_asset.material) {
+      instance_material = *mesh_asset.material;
+    }
+    AddEntity(mesh_asset.model, instance_material,
+              transformation * mesh_asset.transform,
+              std::string(name_attribute ? name_attribute->Value()
+                                         : mesh_attribute->Value()));
+  } else if (element_type == "group") {
+    const Material *group_material = material ? &*material : parent_material;
+    for (auto child_element = element->FirstChildElement(); child_element;
+         child_element = child_element->NextSiblingElement()) {
+      std::string child_type{child_element->Value()};
+      if (child_type != "transform" && child_type != "material") {
+        LoadXmlEntity(child_element, transformation, group_material);
+      }
+    }
+  } else {
+    LAND_ERROR("Unknown Element Type: {}", element->Value());
+  }
 }
 
 }  // namespace sparks
@@ -1,14 +1,25 @@
 #pragma once
+#include "future"
 #include "memory"
+#include "sparks/assets/accelerated_mesh.h"
 #include "sparks/assets/camera.h"
+#include "sparks/assets/compact_vertex.h"
 #include "sparks/assets/entity.h"
+#include "sparks/assets/envmap_cubemap.h"
+#include "sparks/assets/envmap_sampler.h"
+#include "sparks/assets/instance_bvh.h"
+#include "sparks/assets/light_sampler.h"
 #include "sparks/assets/material.h"
 #include "sparks/assets/mesh.h"
 #include "sparks/assets/texture.h"
 #include "sparks/assets/util.h"
+#include "optional"
+#include "unordered_map"
 #include "vector"
 
 namespace sparks {
+class AcceleratedMesh;
+
 class Scene {
  public:
   Scene();
@@ -21,8 +32,8 @@ class Scene {
   [[nodiscard]] std::vector<const char *> GetTextureNameList() const;
 
   template <class... Args>
-  int AddEntity(Args... args) {
-    entities_.emplace_back(args...);
+  int AddEntity(Args &&...args) {
+    entities_.emplace_back(std::forward<Args>(args)...);
     return int(entities_.size() - 1);
   }
 
@@ -52,37 +63,107 @@ class Scene {
 
   void Clear();
   void UpdateEnvmapConfiguration();
+  // Caches the rotation of the envmap offset for SampleEnvmapCubemap. Offsets
+  // edited through GetEnvmapOffset are still honored before the next update,
+  // at the cost of a sine and a cosine per lookup.
+  void UpdateEnvmapRotation();
 
   [[nodiscard]] glm::vec3 GetEnvmapLightDirection() const;
   [[nodiscard]] const glm::vec3 &GetEnvmapMinorColor() const;
   [[nodiscard]] const glm::vec3 &GetEnvmapMajorColor() const;
-  [[nodiscard]] const std::vector<float> &GetEnvmapCdf() const;
+  [[nodiscard]] const EnvmapSampler &GetEnvmapSampler() const;
   [[nodiscard]] float GetEnvmapTotalPower() const {
     return envmap_total_power_;
   }
 
+  // Has to follow any change to the emitters, the renderer settings decide
+  // whether the light BVH is kept.
+  void UpdateLightSampler(bool enable_light_bvh);
+  [[nodiscard]] const LightSampler &GetLightSampler() const;
+  // Rebuilds the top level hierarchy after entities were added or moved.
+  // Entities added since the last update are still traced, one by one.
+  void UpdateInstanceBvh();
+
   [[nodiscard]] glm::vec4 SampleEnvmap(const glm::vec3 &direction) const;
+  // Looks up the cube map copy built by UpdateEnvmapConfiguration, falls back
+  // to SampleEnvmap before the first configuration.
+  [[nodiscard]] glm::vec3 SampleEnvmapCubemap(const glm::vec3 &direction) const;
+  [[nodiscard]] const EnvmapCubemap &GetEnvmapCubemap() const;
+  // Importance samples a direction towards the envmap, returns its solid
+  // angle pdf or 0 if the envmap is black.
+  float SampleEnvmapLight(float r1, float r2, glm::vec3 *direction) const;
+  [[nodiscard]] float GetEnvmapLightPdf(const glm::vec3 &direction) const;
 
-  float TraceRay(const glm::vec3 &origin,
-                 const glm::vec3 &direction,
-                 float t_min,
-                 float t_max,
-                 HitRecord *hit_record) const;
+  // Returns the distance of the closest hit within the range of the ray, or
+  // a negative value if there is none.
+  float TraceRay(const Ray &ray, HitRecord *hit_record) const;
 
   bool TextureCombo(const char *label, int *current_item) const;
   bool EntityCombo(const char *label, int *current_item) const;
   int LoadTexture(const std::string &file_path);
+  // Returns the id the texture will occupy and decodes it on the thread pool,
+  // the slot holds a placeholder until WaitTextureLoads. Files already
+  // loaded, by canonical path or by content, resolve to the existing id.
+  // Returns -1 if the file cannot be read. The sample type of the first
+  // request of a file wins.
+  int LoadTextureAsync(const std::string &file_path,
+                       SampleType sample_type = SAMPLE_TYPE_LINEAR);
+  void WaitTextureLoads();
   int LoadObjMesh(const std::string &file_path);
+  // Loads each file once per canonical path, vertex format and tree
+  // quality, later requests share the model. Returns nullptr if the file
+  // cannot be loaded.
+  std::shared_ptr<const Model> LoadObjModel(
+      const std::string &file_path,
+      VertexFormat vertex_format = VERTEX_FORMAT_FULL,
+      BvhBuildQuality bvh_quality = BVH_BUILD_QUALITY_HIGH);
+  // Goes through the MeshCache, parsing and building the acceleration
+  // structure only when the file changed since it was last cached. Cached
+  // trees of a lower quality than asked for are optimized and stored again,
+  // fast trees are never stored.
+  static bool LoadAcceleratedObjMesh(
+      const std::string &file_path,
+      AcceleratedMesh &mesh,
+      BvhBuildQuality bvh_quality = BVH_BUILD_QUALITY_HIGH);
 
  private:
+  // A model declared by a mesh element, placed by instance elements.
+  struct MeshAsset {
+    std::shared_ptr<const Model> model;
+    std::optional<Material> material;
+    glm::mat4 transform{1.0f};
+  };
+
+  std::shared_ptr<const Model> LoadXmlModel(tinyxml2::XMLElement *element);
+  // Loads a model, mesh, instance or group element. Transforms compose from
+  // the outermost group inwards, materials are taken from the instance, the
+  // innermost group declaring one, or else the mesh declaration.
+  void LoadXmlEntity(tinyxml2::XMLElement *element,
+                     const glm::mat4 &parent_transform,
+                     const Material *parent_material);
+  [[nodiscard]] glm::vec2 DirectionToEnvmapCoord(
+      const glm::vec3 &direction) const;
+  [[nodiscard]] glm::vec3 EnvmapCoordToDirection(glm::vec2 tex_coord) const;
+
   std::vector<Texture> textures_;
   std::vector<std::string> texture_names_;
+  std::vector<std::pair<int, std::future<Texture>>> pending_textures_;
+  std::unordered_map<std::string, int> texture_path_ids_;
+  std::unordered_map<size_t, int> texture_content_ids_;
 
   std::vector<Entity> entities_;
+  std::unordered_map<std::string, std::shared_ptr<const Model>> obj_models_;
+  std::unordered_map<std::string, MeshAsset> mesh_assets_;
+  InstanceBvh instance_bvh_;
+  LightSampler light_sampler_;
 
   int envmap_id_{1};
   float envmap_offset_{0.0f};
-  std::vector<float> envmap_cdf_;
+  EnvmapSampler envmap_sampler_;
+  EnvmapCubemap envmap_cubemap_;
+  // cos and sin of envmap_rotation_offset_.
+  float envmap_rotation_offset_{0.0f};
+  glm::vec2 envmap_rotation_{1.0f, 0.0f};
   glm::vec3 envmap_light_direction_{0.0f, 1.0f, 0.0f};
   glm::vec3 envmap_major_color_{0.5f};
   glm::vec3 envmap_minor_color_{0.3f};
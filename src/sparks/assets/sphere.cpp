@@ -0,0 +1,176 @@
+#include "sparks/assets/sphere.h"
+
+#include "algorithm"
+
+namespace sparks {
+
+namespace {
+constexpr int kSphereRings = 16;
+constexpr int kSphereSegments = 32;
+constexpr float kRingAngle = PI / float(kSphereRings);
+constexpr float kSegmentAngle = 2.0f * PI / float(kSphereSegments);
+
+glm::vec3 SphereDirection(float cos_theta, float phi) {
+  float sin_theta = std::sqrt(std::max(1.0f - cos_theta * cos_theta, 0.0f));
+  return {-std::sin(phi) * sin_theta, cos_theta, -std::cos(phi) * sin_theta};
+}
+}  // namespace
+
+Sphere::Sphere(const glm::vec3 &center, float radius)
+    : center_(center), radius_(radius) {
+}
+
+Sphere::Sphere(const tinyxml2::XMLElement *element) {
+  auto child_element = element->FirstChildElement("center");
+  if (child_element) {
+    center_ = StringToVec3(child_element->FindAttribute("value")->Value());
+  }
+  child_element = element->FirstChildElement("radius");
+  if (child_element) {
+    radius_ = std::stof(child_element->FindAttribute("value")->Value());
+  }
+}
+
+bool Sphere::Intersect(const Ray &ray, RayHit *hit) const {
+  auto offset = ray.origin - center_;
+  float a = glm::dot(ray.direction, ray.direction);
+  float half_b = glm::dot(offset, ray.direction);
+  float c = glm::dot(offset, offset) - radius_ * radius_;
+  float discriminant = half_b * half_b - a * c;
+  if (discriminant < 0.0f || a <= 0.0f) {
+    return false;
+  }
+  float root = std::sqrt(discriminant);
+  float t = (-half_b - root) / a;
+  if (t < ray.t_min) {
+    t = (-half_b + root) / a;
+  }
+  if (t < ray.t_min || t > ray.t_max) {
+    return false;
+  }
+  // The patch follows from the hit position in EvaluateHit.
+  hit->t = t;
+  hit->primitive_id = 0;
+  return true;
+}
+
+void Sphere::EvaluateHit(const Ray &ray,
+                         const RayHit &hit,
+                         HitRecord *hit_record) const {
+  auto position = ray.At(hit.t);
+  auto normal = glm::normalize(position - center_);
+  float cos_theta = std::min(std::max(normal.y, -1.0f), 1.0f);
+  float sin_theta = std::sqrt(std::max(1.0f - cos_theta * cos_theta, 0.0f));
+  float theta = std::acos(cos_theta);
+  float phi = std::atan2(-normal.x, -normal.z);
+  if (phi < 0.0f) {
+    phi += 2.0f * PI;
+  }
+  float sin_phi = std::sin(phi);
+  float cos_phi = std::cos(phi);
+
+  int ring = std::min(int(theta / kRingAngle), kSphereRings - 1);
+  int segment = std::min(int(phi / kSegmentAngle), kSphereSegments - 1);
+  int half = phi - float(segment) * kSegmentAngle >= 0.5f * kSegmentAngle;
+  hit_record->primitive_id = (ring * kSphereSegments + segment) * 2 + half;
+  hit_record->position = position;
+  hit_record->tex_coord = {phi * 0.5f * INV_PI, 1.0f - theta * INV_PI};
+  hit_record->dpdu =
+      glm::vec3{-cos_phi, 0.0f, sin_phi} * (radius_ * sin_theta * 2.0f * PI);
+  hit_record->dpdv = glm::vec3{sin_phi * cos_theta, sin_theta,
+                               cos_phi * cos_theta} *
+                     (radius_ * PI);
+  glm::vec3 tangent{-cos_phi, 0.0f, sin_phi};
+  hit_record->front_face = glm::dot(normal, ray.direction) < 0.0f;
+  if (!hit_record->front_face) {
+    normal = -normal;
+    tangent = -tangent;
+  }
+  hit_record->geometry_normal = normal;
+  hit_record->normal = normal;
+  hit_record->tangent = tangent;
+}
+
+AxisAlignedBoundingBox Sphere::GetAABB(const glm::mat4 &transform) const {
+  glm::mat3 linear{transform};
+  glm::vec3 center = transform * glm::vec4{center_, 1.0f};
+  glm::vec3 extent;
+  for (int i = 0; i < 3; i++) {
+    extent[i] = radius_ * glm::length(glm::vec3{linear[0][i], linear[1][i],
+                                                linear[2][i]});
+  }
+  return {center.x - extent.x, center.x + extent.x, center.y - extent.y,
+          center.y + extent.y, center.z - extent.z, center.z + extent.z};
+}
+
+const char *Sphere::GetDefaultEntityName() const {
+  return "Sphere";
+}
+
+void Sphere::SamplePatch(int primitive_id,
+                         float r1,
+                         float r2,
+                         glm::vec3 *position,
+                         glm::vec3 *normal) const {
+  glm::vec2 phi_range;
+  glm::vec2 cos_theta_range;
+  GetPatchRange(primitive_id, &phi_range, &cos_theta_range);
+  // Archimedes: the area is uniform in the cosine of the latitude.
+  *normal =
+      SphereDirection(glm::mix(cos_theta_range.x, cos_theta_range.y, r1),
+                      glm::mix(phi_range.x, phi_range.y, r2));
+  *position = center_ + *normal * radius_;
+}
+
+float Sphere::GetPatchArea(int primitive_id, const glm::mat3 &linear) const {
+  glm::vec2 phi_range;
+  glm::vec2 cos_theta_range;
+  GetPatchRange(primitive_id, &phi_range, &cos_theta_range);
+  float area = radius_ * radius_ * (phi_range.y - phi_range.x) *
+               (cos_theta_range.y - cos_theta_range.x);
+  auto center_normal =
+      SphereDirection((cos_theta_range.x + cos_theta_range.y) * 0.5f,
+                      (phi_range.x + phi_range.y) * 0.5f);
+  return area * glm::length(TransformNormal(linear, center_normal));
+}
+
+void Sphere::Tessellate(std::vector<Vertex> &vertices,
+                        std::vector<uint32_t> &indices) const {
+  vertices.clear();
+  indices.clear();
+  for (int i = 0; i <= kSphereRings; i++) {
+    float theta = float(i) * kRingAngle;
+    for (int j = 0; j <= kSphereSegments; j++) {
+      float phi = float(j) * kSegmentAngle;
+      auto normal = SphereDirection(std::cos(theta), phi);
+      Vertex vertex(center_ + normal * radius_, normal,
+                    {float(j) / float(kSphereSegments),
+                     1.0f - float(i) / float(kSphereRings)});
+      vertex.tangent = {-std::cos(phi), 0.0f, std::sin(phi)};
+      vertices.push_back(vertex);
+    }
+  }
+  // Primitive (ring * kSphereSegments + segment) * 2 + half.
+  for (int i = 0; i < kSphereRings; i++) {
+    for (int j = 0; j < kSphereSegments; j++) {
+      uint32_t v00 = i * (kSphereSegments + 1) + j;
+      uint32_t v10 = v00 + kSphereSegments + 1;
+      indices.insert(indices.end(), {v00, v10, v10 + 1});
+      indices.insert(indices.end(), {v00, v10 + 1, v00 + 1});
+    }
+  }
+}
+
+void Sphere::GetPatchRange(int primitive_id,
+                           glm::vec2 *phi_range,
+                           glm::vec2 *cos_theta_range) const {
+  int half = primitive_id & 1;
+  int segment = (primitive_id >> 1) % kSphereSegments;
+  int ring = (primitive_id >> 1) / kSphereSegments;
+  float phi = (float(segment) + 0.5f * float(half)) * kSegmentAngle;
+  *phi_range = {phi, phi + 0.5f * kSegmentAngle};
+  *cos_theta_range = {std::cos(float(ring + 1) * kRingAngle),
+                      std::cos(float(ring) * kRingAngle)};
+}
+
+}  // namespace sparks
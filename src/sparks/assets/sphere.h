@@ -0,0 +1,44 @@
+#pragma once
+#include "sparks/assets/analytic_model.h"
+#include "sparks/assets/util.h"
+
+namespace sparks {
+
+// Sphere with the texture coordinates of Mesh::Sphere. Each cell of the
+// latitude-longitude tessellation is split into two triangles, whose patches
+// are the halves of the spherical cell in longitude.
+class Sphere : public AnalyticModel {
+ public:
+  explicit Sphere(const glm::vec3 &center = glm::vec3{0.0f},
+                  float radius = 1.0f);
+  explicit Sphere(const tinyxml2::XMLElement *element);
+  [[nodiscard]] bool Intersect(const Ray &ray, RayHit *hit) const override;
+  void EvaluateHit(const Ray &ray,
+                   const RayHit &hit,
+                   HitRecord *hit_record) const override;
+  [[nodiscard]] AxisAlignedBoundingBox GetAABB(
+      const glm::mat4 &transform) const override;
+  const char *GetDefaultEntityName() const override;
+  void SamplePatch(int primitive_id,
+                   float r1,
+                   float r2,
+                   glm::vec3 *position,
+                   glm::vec3 *normal) const override;
+  [[nodiscard]] float GetPatchArea(int primitive_id,
+                                   const glm::mat3 &linear) const override;
+
+ protected:
+  void Tessellate(std::vector<Vertex> &vertices,
+                  std::vector<uint32_t> &indices) const override;
+
+ private:
+  // Longitude range and cosine of the latitude range of the patch.
+  void GetPatchRange(int primitive_id,
+                     glm::vec2 *phi_range,
+                     glm::vec2 *cos_theta_range) const;
+
+  glm::vec3 center_{0.0f};
+  float radius_{1.0f};
+};
+
+}  // namespace sparks
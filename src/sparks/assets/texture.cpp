@@ -1,68 +1,267 @@
 #include "sparks/assets/texture.h"
 
 #include "absl/strings/match.h"
+#include "condition_variable"
+#include "cstdio"
+#include "glm/gtc/packing.hpp"
 #include "grassland/util/util.h"
+#include "sparks/util/util.h"
 #include "stb_image.h"
 #include "stb_image_write.h"
 
 namespace sparks {
 
+namespace {
+// Largest value representable by the half float and shared exponent formats.
+constexpr float kMaxPackedValue = 65000.0f;
+// Streamed images are decoded whole by stb_image, this bounds how many of
+// them are held at once when several textures miss together.
+constexpr int kMaxStreamDecodes = 2;
+
+// Held while a streamed image is decoded.
+class StreamDecodeSlot {
+ public:
+  StreamDecodeSlot() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    condition_.wait(lock, []() { return num_decodes_ < kMaxStreamDecodes; });
+    num_decodes_++;
+  }
+  ~StreamDecodeSlot() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    num_decodes_--;
+    condition_.notify_one();
+  }
+
+ private:
+  static std::mutex mutex_;
+  static std::condition_variable condition_;
+  static int num_decodes_;
+};
+
+std::mutex StreamDecodeSlot::mutex_;
+std::condition_variable StreamDecodeSlot::condition_;
+int StreamDecodeSlot::num_decodes_ = 0;
+
+// Seeks with 64-bit offsets, long is 32 bits on Windows.
+bool SeekFile(std::FILE *file, uint64_t offset) {
+#ifdef _WIN32
+  return _fseeki64(file, int64_t(offset), SEEK_SET) == 0;
+#else
+  return fseeko(file, off_t(offset), SEEK_SET) == 0;
+#endif
+}
+
+constexpr size_t TexelSize(TexelFormat format) {
+  switch (format) {
+    case TEXEL_FORMAT_RGBA16F:
+      return sizeof(uint64_t);
+    case TEXEL_FORMAT_RGBA8:
+    case TEXEL_FORMAT_RGB9E5:
+      return sizeof(uint32_t);
+    default:
+      return sizeof(glm::vec4);
+  }
+}
+
+template <TexelFormat format>
+glm::vec4 DecodeTexel(const uint8_t *texel);
+
+template <>
+glm::vec4 DecodeTexel<TEXEL_FORMAT_RGBA32F>(const uint8_t *texel) {
+  glm::vec4 color;
+  std::memcpy(&color, texel, sizeof(glm::vec4));
+  return color;
+}
+
+template <>
+glm::vec4 DecodeTexel<TEXEL_FORMAT_RGBA16F>(const uint8_t *texel) {
+  uint64_t packed;
+  std::memcpy(&packed, texel, sizeof(uint64_t));
+  return glm::unpackHalf4x16(packed);
+}
+
+template <>
+glm::vec4 DecodeTexel<TEXEL_FORMAT_RGBA8>(const uint8_t *texel) {
+  return glm::vec4{texel[0], texel[1], texel[2], texel[3]} * (1.0f / 255.0f);
+}
+
+template <>
+glm::vec4 DecodeTexel<TEXEL_FORMAT_RGB9E5>(const uint8_t *texel) {
+  uint32_t packed;
+  std::memcpy(&packed, texel, sizeof(uint32_t));
+  return glm::vec4{glm::unpackF3x9_E1x5(packed), 1.0f};
+}
+
+void EncodeTexel(TexelFormat format, const glm::vec4 &color, uint8_t *texel) {
+  switch (format) {
+    case TEXEL_FORMAT_RGBA16F: {
+      uint64_t packed = glm::packHalf4x16(color);
+      std::memcpy(texel, &packed, sizeof(uint64_t));
+      break;
+    }
+    case TEXEL_FORMAT_RGBA8:
+      for (int i = 0; i < 4; i++) {
+        texel[i] = uint8_t(
+            std::min(std::max(std::lround(color[i] * 255.0f), 0l), 255l));
+      }
+      break;
+    case TEXEL_FORMAT_RGB9E5: {
+      uint32_t packed = glm::packF3x9_E1x5(glm::vec3{color});
+      std::memcpy(texel, &packed, sizeof(uint32_t));
+      break;
+    }
+    default:
+      std::memcpy(texel, &color, sizeof(glm::vec4));
+      break;
+  }
+}
+
+// Interleaves the bits of two 4-bit block coordinates.
+uint32_t Morton2D(uint32_t x, uint32_t y) {
+  x = (x | (x << 2)) & 0x33u;
+  x = (x | (x << 1)) & 0x55u;
+  y = (y | (y << 2)) & 0x33u;
+  y = (y | (y << 1)) & 0x55u;
+  return x | (y << 1);
+}
+
+// Exponent of the smallest power of two covering value, clamped to
+// [min_shift, max_shift].
+int FitShift(size_t value, int min_shift, int max_shift) {
+  int shift = min_shift;
+  while (shift < max_shift && (size_t(1) << shift) < value) {
+    shift++;
+  }
+  return shift;
+}
+
+// Shared exponent storage drops alpha and negative values, half floats keep
+// both, anything beyond the packed range stays in full precision.
+TexelFormat SelectHdrFormat(const glm::vec4 *buffer, size_t num_texels) {
+  bool opaque = true;
+  for (size_t i = 0; i < num_texels; i++) {
+    auto &color = buffer[i];
+    if (std::max(std::max(std::abs(color.x), std::abs(color.y)),
+                 std::max(std::abs(color.z), std::abs(color.w))) >
+        kMaxPackedValue) {
+      return TEXEL_FORMAT_RGBA32F;
+    }
+    if (color.w != 1.0f ||
+        std::min(std::min(color.x, color.y), color.z) < 0.0f) {
+      opaque = false;
+    }
+  }
+  return opaque ? TEXEL_FORMAT_RGB9E5 : TEXEL_FORMAT_RGBA16F;
+}
+}  // namespace
+
+// Backing store of a streamed texture. The image is decoded once on the first
+// tile miss and the encoded tiles of every level are written to a temporary
+// spill file one row of tiles at a time, later misses read single tiles back
+// from it.
+struct Texture::Stream {
+  ~Stream();
+
+  std::string file_path;
+  uint32_t texture_id{};
+  std::once_flag decode_flag;
+  std::mutex file_mutex;
+  std::FILE *file{};
+};
+
+Texture::Stream::~Stream() {
+  if (file) {
+    std::fclose(file);
+  }
+  TextureCache::GetInstance().Release(texture_id);
+}
+
 Texture::Texture(uint32_t width,
                  uint32_t height,
                  const glm::vec4 &color,
-                 SampleType sample_type) {
-  width_ = width;
-  height_ = height;
-  buffer_.resize(width * height);
+                 SampleType sample_type,
+                 TexelFormat format) {
+  std::vector<glm::vec4> buffer(width * height, color);
   sample_type_ = sample_type;
-  std::fill(buffer_.data(), buffer_.data() + width * height, color);
+  format_ = format;
+  SetLevel(0, width, height, buffer.data());
+  GenerateMipmaps();
 }
 
 Texture::Texture(uint32_t width,
                  uint32_t height,
                  const glm::vec4 *color_buffer,
-                 SampleType sample_type) {
-  width_ = width;
-  height_ = height;
-  buffer_.resize(width * height);
+                 SampleType sample_type,
+                 TexelFormat format) {
   sample_type_ = sample_type;
-  std::memcpy(buffer_.data(), color_buffer,
-              sizeof(glm::vec4) * width_ * height_);
+  format_ = format;
+  SetLevel(0, width, height, color_buffer);
+  GenerateMipmaps();
+}
+
+Texture::Texture(uint32_t width,
+                 uint32_t height,
+                 const uint8_t *texel_data,
+                 SampleType sample_type,
+                 TexelFormat format) {
+  sample_type_ = sample_type;
+  format_ = format;
+  InitLevel(0, width, height);
+  auto &level = levels_[0];
+  size_t texel_size = TexelSize(format_);
+  for (int y = 0; y < height; y++) {
+    for (int x = 0; x < width; x++) {
+      std::memcpy(&level.data[TexelIndex(level, x, y) * texel_size],
+                  texel_data + (size_t(y) * width + x) * texel_size,
+                  texel_size);
+    }
+  }
+  GenerateMipmaps();
 }
 
 void Texture::Resize(uint32_t width, uint32_t height) {
   std::vector<glm::vec4> new_buffer(width * height);
-  for (int i = 0; i < std::min(height, height_); i++) {
-    std::memcpy(new_buffer.data() + width * i, buffer_.data() + width_ * i,
-                sizeof(glm::vec4) * std::min(width, width_));
+  for (int y = 0; y < std::min(height, GetHeight()); y++) {
+    for (int x = 0; x < std::min(width, GetWidth()); x++) {
+      new_buffer[y * width + x] = operator()(x, y);
+    }
   }
-  width_ = width;
-  height_ = height;
-  buffer_ = new_buffer;
+  stream_.reset();
+  SetLevel(0, width, height, new_buffer.data());
+  GenerateMipmaps();
 }
 
 bool Texture::Load(const std::string &file_path, Texture &texture) {
+  std::vector<uint8_t> file_data;
+  return ReadFile(file_path, file_data) && Load(file_path, file_data, texture);
+}
+
+bool Texture::Load(const std::string &file_path,
+                   const std::vector<uint8_t> &file_data,
+                   Texture &texture) {
   int x, y, c;
+  auto data = file_data.data();
+  int size = int(file_data.size());
   if (absl::EndsWithIgnoreCase(file_path, ".hdr")) {
-    auto result = stbi_loadf(file_path.c_str(), &x, &y, &c, 4);
+    auto result = stbi_loadf_from_memory(data, size, &x, &y, &c, 4);
     if (result) {
-      texture = Texture(x, y, reinterpret_cast<glm::vec4 *>(result),
-                        SAMPLE_TYPE_LINEAR);
+      auto buffer = reinterpret_cast<glm::vec4 *>(result);
+      texture = Texture(x, y, buffer, SAMPLE_TYPE_LINEAR,
+                        SelectHdrFormat(buffer, size_t(x) * y));
       stbi_image_free(result);
     } else {
       return false;
     }
+  } else if (TextureCache::GetInstance().GetMemoryBudget()) {
+    if (!stbi_info_from_memory(data, size, &x, &y, &c)) {
+      return false;
+    }
+    texture = Texture();
+    texture.InitStream(file_path, x, y);
   } else {
-    auto result = stbi_load(file_path.c_str(), &x, &y, &c, 4);
+    auto result = stbi_load_from_memory(data, size, &x, &y, &c, 4);
     if (result) {
-      std::vector<glm::vec4> convert_buffer(x * y);
-      const float inv_255 = 1.0f / 255.0f;
-      for (int i = 0; i < x * y; i++) {
-        convert_buffer[i] = glm::vec4{result[i * 4], result[i * 4 + 1],
-                                      result[i * 4 + 2], result[i * 4 + 3]} *
-                            inv_255;
-      }
-      texture = Texture(x, y, convert_buffer.data(), SAMPLE_TYPE_LINEAR);
+      texture = Texture(x, y, result, SAMPLE_TYPE_LINEAR, TEXEL_FORMAT_RGBA8);
       stbi_image_free(result);
     } else {
       return false;
@@ -72,29 +271,26 @@ bool Texture::Load(const std::string &file_path, Texture &texture) {
 }
 
 void Texture::Store(const std::string &file_path) {
+  const uint32_t width = GetWidth();
+  const uint32_t height = GetHeight();
+  auto buffer = GetBuffer();
   if (absl::EndsWithIgnoreCase(file_path, ".hdr")) {
-    stbi_write_hdr(file_path.c_str(), width_, height_, 4,
-                   reinterpret_cast<float *>(buffer_.data()));
+    stbi_write_hdr(file_path.c_str(), width, height, 4,
+                   reinterpret_cast<float *>(buffer.data()));
   } else {
-    std::vector<uint8_t> convert_buffer(width_ * height_ * 4);
-    auto float_to_uint8 = [](float x) {
-      return std::min(std::max(std::lround(x * 255.0f), 0l), 255l);
-    };
-    for (int i = 0; i < width_ * height_; i++) {
-      convert_buffer[i * 4] = float_to_uint8(buffer_[i].x);
-      convert_buffer[i * 4 + 1] = float_to_uint8(buffer_[i].y);
-      convert_buffer[i * 4 + 2] = float_to_uint8(buffer_[i].z);
-      convert_buffer[i * 4 + 3] = float_to_uint8(buffer_[i].w);
+    std::vector<uint8_t> convert_buffer(width * height * 4);
+    for (int i = 0; i < width * height; i++) {
+      EncodeTexel(TEXEL_FORMAT_RGBA8, buffer[i], &convert_buffer[i * 4]);
     }
     if (absl::EndsWithIgnoreCase(file_path, ".png")) {
-      stbi_write_png(file_path.c_str(), width_, height_, 4,
-                     convert_buffer.data(), width_ * 4);
+      stbi_write_png(file_path.c_str(), width, height, 4,
+                     convert_buffer.data(), width * 4);
     } else if (absl::EndsWithIgnoreCase(file_path, ".bmp")) {
-      stbi_write_bmp(file_path.c_str(), width_, height_, 4,
+      stbi_write_bmp(file_path.c_str(), width, height, 4,
                      convert_buffer.data());
     } else if (absl::EndsWithIgnoreCase(file_path, ".jpg") ||
                absl::EndsWithIgnoreCase(file_path, ".jpeg")) {
-      stbi_write_jpg(file_path.c_str(), width_, height_, 4,
+      stbi_write_jpg(file_path.c_str(), width, height, 4,
                      convert_buffer.data(), 100);
     } else {
       LAND_ERROR("Unknown file format \"{}\"", file_path.c_str());
@@ -110,49 +306,539 @@ SampleType Texture::GetSampleType() const {
   return sample_type_;
 }
 
-glm::vec4 &Texture::operator()(int x, int y) {
-  x = std::min(int(width_ - 1), std::max(x, 0));
-  y = std::min(int(height_ - 1), std::max(y, 0));
-  return buffer_[y * width_ + x];
+TexelFormat Texture::GetFormat() const {
+  return format_;
+}
+
+void Texture::SetLayout(TexelLayout layout) {
+  // The spill file of streamed textures is always tiled.
+  if (layout == layout_ || stream_) {
+    return;
+  }
+  std::vector<std::vector<glm::vec4>> buffers;
+  for (auto &level : levels_) {
+    std::vector<glm::vec4> buffer(level.width * level.height);
+    for (int y = 0; y < level.height; y++) {
+      for (int x = 0; x < level.width; x++) {
+        buffer[y * level.width + x] = Fetch(level, x, y);
+      }
+    }
+    buffers.push_back(std::move(buffer));
+  }
+  layout_ = layout;
+  for (int i = 0; i < buffers.size(); i++) {
+    SetLevel(i, levels_[i].width, levels_[i].height, buffers[i].data());
+  }
+}
+
+TexelLayout Texture::GetLayout() const {
+  return layout_;
 }
 
-const glm::vec4 &Texture::operator()(int x, int y) const {
-  x = std::min(int(width_ - 1), std::max(x, 0));
-  y = std::min(int(height_ - 1), std::max(y, 0));
-  return buffer_[y * width_ + x];
+glm::vec4 Texture::operator()(int x, int y) const {
+  return Fetch(levels_[0], x, y);
 }
 
 glm::vec4 Texture::Sample(glm::vec2 tex_coord) const {
-  tex_coord = tex_coord - glm::floor(tex_coord);
-  tex_coord *= glm::vec2{width_, height_};
-  if (sample_type_ == SAMPLE_TYPE_LINEAR) {
-    int x = std::lround(tex_coord.x - 0.5f);
-    int y = std::lround(tex_coord.y - 0.5f);
-    float fx = tex_coord.x - float(x);
-    float fy = tex_coord.y - float(y);
-    return operator()(x, y) * (1.0f - fx) * (1.0f - fy) +
-           operator()(x + 1, y) * (fx) * (1.0f - fy) +
-           operator()(x, y + 1) * (1.0f - fx) * (fy) +
-           operator()(x + 1, y + 1) * (fx) * (fy);
-  } else {
-    return operator()(std::lround(tex_coord.x), std::lround(tex_coord.y));
+  return SampleLevel(levels_[0], tex_coord, nullptr);
+}
+
+glm::vec4 Texture::Sample(glm::vec2 tex_coord, float lod) const {
+  return SampleLod(tex_coord, lod, nullptr);
+}
+
+glm::vec4 Texture::Sample(glm::vec2 tex_coord,
+                          glm::vec2 duv_dx,
+                          glm::vec2 duv_dy,
+                          TextureFilter filter) const {
+  return SampleFootprint(tex_coord, duv_dx, duv_dy, filter, nullptr);
+}
+
+glm::vec4 Texture::Sample(glm::vec2 tex_coord,
+                          glm::vec2 duv_dx,
+                          glm::vec2 duv_dy,
+                          TextureFilter filter,
+                          glm::vec2 random) const {
+  return SampleFootprint(
+      tex_coord, duv_dx, duv_dy, filter,
+      sample_type_ == SAMPLE_TYPE_STOCHASTIC ? &random : nullptr);
+}
+
+void Texture::GenerateMipmaps() {
+  levels_.resize(1);
+  std::vector<glm::vec4> buffer;
+  while (levels_.back().width > 1 || levels_.back().height > 1) {
+    const auto &previous = levels_.back();
+    uint32_t width = std::max(previous.width / 2, 1u);
+    uint32_t height = std::max(previous.height / 2, 1u);
+    buffer.resize(width * height);
+    for (int y = 0; y < height; y++) {
+      for (int x = 0; x < width; x++) {
+        buffer[y * width + x] =
+            (Fetch(previous, x * 2, y * 2) + Fetch(previous, x * 2 + 1, y * 2) +
+             Fetch(previous, x * 2, y * 2 + 1) +
+             Fetch(previous, x * 2 + 1, y * 2 + 1)) *
+            0.25f;
+      }
+    }
+    SetLevel(int(levels_.size()), width, height, buffer.data());
   }
 }
 
 uint32_t Texture::GetWidth() const {
-  return width_;
+  return levels_[0].width;
 }
 
 uint32_t Texture::GetHeight() const {
-  return height_;
+  return levels_[0].height;
+}
+
+int Texture::GetNumLevels() const {
+  return int(levels_.size());
 }
 
-glm::vec4 *Texture::GetBuffer() {
-  return buffer_.data();
+std::vector<glm::vec4> Texture::GetBuffer() const {
+  std::vector<glm::vec4> buffer(GetWidth() * GetHeight());
+  if (stream_) {
+    // Reads the spill file directly, going through the tiles would evict
+    // everything the renderer has cached.
+    auto &stream = *stream_;
+    std::call_once(stream.decode_flag, [this]() { DecodeStream(); });
+    auto &level = levels_[0];
+    std::vector<uint8_t> band((size_t(level.num_tiles_x) * TexelSize(format_))
+                              << level.tile_texel_shift);
+    for (uint32_t band_y = 0; band_y < level.height;
+         band_y += level.band_height) {
+      {
+        std::lock_guard<std::mutex> lock(stream.file_mutex);
+        if (!stream.file ||
+            !SeekFile(stream.file,
+                      level.file_offset +
+                          uint64_t(band_y / level.band_height) * band.size()) ||
+            std::fread(band.data(), 1, band.size(), stream.file) !=
+                band.size()) {
+          break;
+        }
+      }
+      size_t band_offset = TexelIndex(level, 0, int(band_y));
+      uint32_t band_end = std::min(band_y + level.band_height, level.height);
+      for (uint32_t y = band_y; y < band_end; y++) {
+        for (uint32_t x = 0; x < level.width; x++) {
+          buffer[size_t(y) * level.width + x] =
+              DecodeTexel<TEXEL_FORMAT_RGBA8>(
+                  &band[(TexelIndex(level, int(x), int(y)) - band_offset) *
+                        TexelSize(format_)]);
+        }
+      }
+    }
+    return buffer;
+  }
+  for (int y = 0; y < GetHeight(); y++) {
+    for (int x = 0; x < GetWidth(); x++) {
+      buffer[y * GetWidth() + x] = operator()(x, y);
+    }
+  }
+  return buffer;
+}
+
+bool Texture::IsStreamed() const {
+  return bool(stream_);
+}
+
+size_t Texture::GetMemoryUsage() const {
+  size_t memory_usage = 0;
+  for (auto &level : levels_) {
+    memory_usage += level.data.size();
+  }
+  return memory_usage;
+}
+
+void Texture::InitLevel(int level, uint32_t width, uint32_t height) {
+  if (levels_.size() <= level) {
+    levels_.resize(level + 1);
+  }
+  auto &mip_level = levels_[level];
+  mip_level.width = width;
+  mip_level.height = height;
+  size_t num_texels = size_t(width) * height;
+  if (layout_ == TEXEL_LAYOUT_TILED) {
+    // Tiles are fitted to each side of the level on their own, so thin
+    // levels are padded to at most a block. Levels thinner than a block are
+    // stored row-major in runs of up to 64x64 texels.
+    if (std::min(width, height) < 4) {
+      mip_level.tile_shift_x = 0;
+      mip_level.tile_shift_y = 0;
+      mip_level.tile_texel_shift = FitShift(num_texels, 0, 12);
+      size_t tile_texels = size_t(1) << mip_level.tile_texel_shift;
+      mip_level.num_tiles_x =
+          uint32_t((num_texels + tile_texels - 1) / tile_texels);
+      mip_level.band_height = height;
+    } else {
+      mip_level.tile_shift_x = FitShift(width, 2, 6);
+      mip_level.tile_shift_y = FitShift(height, 2, 6);
+      mip_level.tile_texel_shift =
+          mip_level.tile_shift_x + mip_level.tile_shift_y;
+      mip_level.num_tiles_x = (width + (1u << mip_level.tile_shift_x) - 1) >>
+                              mip_level.tile_shift_x;
+      mip_level.band_height = 1u << mip_level.tile_shift_y;
+      num_texels = (size_t(mip_level.num_tiles_x) *
+                    ((height + mip_level.band_height - 1) >>
+                     mip_level.tile_shift_y))
+                   << mip_level.tile_texel_shift;
+    }
+  }
+  if (!stream_) {
+    mip_level.data.assign(num_texels * TexelSize(format_), 0);
+  }
+}
+
+size_t Texture::TexelIndex(const MipLevel &level, int x, int y) const {
+  if (layout_ == TEXEL_LAYOUT_LINEAR || !level.tile_shift_x) {
+    return size_t(y) * level.width + x;
+  }
+  uint32_t tile = (uint32_t(y) >> level.tile_shift_y) * level.num_tiles_x +
+                  (uint32_t(x) >> level.tile_shift_x);
+  uint32_t block_x = (uint32_t(x) & ((1u << level.tile_shift_x) - 1)) >> 2;
+  uint32_t block_y = (uint32_t(y) & ((1u << level.tile_shift_y) - 1)) >> 2;
+  // Non-square tiles are a row or column of square runs of blocks, each
+  // ordered along its own Z-curve.
+  int square_shift = std::min(level.tile_shift_x, level.tile_shift_y) - 2;
+  uint32_t square_mask = (1u << square_shift) - 1;
+  uint32_t block =
+      (((block_x | block_y) >> square_shift) << (2 * square_shift)) +
+      Morton2D(block_x & square_mask, block_y & square_mask);
+  return (size_t(tile) << level.tile_texel_shift) + block * 16 +
+         (y & 3) * 4 + (x & 3);
 }
 
-const glm::vec4 *Texture::GetBuffer() const {
-  return buffer_.data();
+void Texture::InitStream(const std::string &file_path,
+                         uint32_t width,
+                         uint32_t height) {
+  stream_ = std::make_shared<Stream>();
+  stream_->file_path = file_path;
+  stream_->texture_id = TextureCache::GetInstance().NewTextureId();
+  format_ = TEXEL_FORMAT_RGBA8;
+  layout_ = TEXEL_LAYOUT_TILED;
+  levels_.clear();
+  uint32_t first_tile = 0;
+  size_t file_offset = 0;
+  for (int i = 0;; i++) {
+    InitLevel(i, width, height);
+    auto &level = levels_[i];
+    uint32_t num_tiles =
+        level.num_tiles_x *
+        ((height + level.band_height - 1) / level.band_height);
+    level.first_tile = first_tile;
+    level.file_offset = file_offset;
+    first_tile += num_tiles;
+    file_offset += (size_t(num_tiles) * TexelSize(format_))
+                   << level.tile_texel_shift;
+    if (width == 1 && height == 1) {
+      break;
+    }
+    width = std::max(width / 2, 1u);
+    height = std::max(height / 2, 1u);
+  }
+}
+
+void Texture::DecodeStream() const {
+  auto &stream = *stream_;
+  StreamDecodeSlot decode_slot;
+  int x, y, c;
+  std::unique_ptr<uint8_t, void (*)(void *)> decoded(
+      stbi_load(stream.file_path.c_str(), &x, &y, &c, 4), stbi_image_free);
+  if (!decoded || x != GetWidth() || y != GetHeight()) {
+    LAND_WARN("Failed to decode streamed texture \"{}\"",
+              stream.file_path.c_str());
+    return;
+  }
+  stream.file = std::tmpfile();
+  if (!stream.file) {
+    LAND_WARN("Failed to create the spill file of texture \"{}\"",
+              stream.file_path.c_str());
+    return;
+  }
+
+  // Only the decoded image, the level below it and one row of tiles are held
+  // at a time. Levels average their parents like GenerateMipmaps.
+  constexpr size_t texel_size = TexelSize(TEXEL_FORMAT_RGBA8);
+  const uint8_t *texels = decoded.get();
+  std::vector<uint8_t> parent;
+  std::vector<uint8_t> child;
+  std::vector<uint8_t> band;
+  for (size_t i = 0; i < levels_.size(); i++) {
+    auto &level = levels_[i];
+    if (i) {
+      auto &previous = levels_[i - 1];
+      auto fetch = [&](uint32_t fetch_x, uint32_t fetch_y) {
+        fetch_x = std::min(fetch_x, previous.width - 1);
+        fetch_y = std::min(fetch_y, previous.height - 1);
+        return DecodeTexel<TEXEL_FORMAT_RGBA8>(
+            texels + (size_t(fetch_y) * previous.width + fetch_x) * texel_size);
+      };
+      child.resize(size_t(level.width) * level.height * texel_size);
+      for (uint32_t level_y = 0; level_y < level.height; level_y++) {
+        for (uint32_t level_x = 0; level_x < level.width; level_x++) {
+          auto color =
+              (fetch(level_x * 2, level_y * 2) +
+               fetch(level_x * 2 + 1, level_y * 2) +
+               fetch(level_x * 2, level_y * 2 + 1) +
+               fetch(level_x * 2 + 1, level_y * 2 + 1)) *
+              0.25f;
+          EncodeTexel(
+              TEXEL_FORMAT_RGBA8, color,
+              &child[(size_t(level_y) * level.width + level_x) * texel_size]);
+        }
+      }
+      decoded.reset();
+      parent.swap(child);
+      texels = parent.data();
+    }
+    band.resize((size_t(level.num_tiles_x) * texel_size)
+                << level.tile_texel_shift);
+    for (uint32_t band_y = 0; band_y < level.height;
+         band_y += level.band_height) {
+      std::fill(band.begin(), band.end(), 0);
+      size_t band_offset = TexelIndex(level, 0, int(band_y));
+      uint32_t band_end = std::min(band_y + level.band_height, level.height);
+      for (uint32_t level_y = band_y; level_y < band_end; level_y++) {
+        for (uint32_t level_x = 0; level_x < level.width; level_x++) {
+          std::memcpy(
+              &band[(TexelIndex(level, int(level_x), int(level_y)) -
+                     band_offset) *
+                    texel_size],
+              texels + (size_t(level_y) * level.width + level_x) * texel_size,
+              texel_size);
+        }
+      }
+      std::fwrite(band.data(), 1, band.size(), stream.file);
+    }
+  }
+}
+
+TextureCache::Tile Texture::LoadTile(const MipLevel &level,
+                                     uint32_t tile) const {
+  auto &stream = *stream_;
+  return TextureCache::GetInstance().GetTile(
+      stream.texture_id, level.first_tile + tile, [&]() {
+        std::call_once(stream.decode_flag, [this]() { DecodeStream(); });
+        size_t tile_bytes = TexelSize(format_) << level.tile_texel_shift;
+        std::vector<uint8_t> data(tile_bytes);
+        std::lock_guard<std::mutex> lock(stream.file_mutex);
+        if (stream.file &&
+            SeekFile(stream.file, level.file_offset + tile * tile_bytes)) {
+          std::fread(data.data(), 1, tile_bytes, stream.file);
+        }
+        return data;
+      });
+}
+
+template <TexelFormat format>
+void Texture::Gather(const MipLevel &level,
+                     const int *xs,
+                     const int *ys,
+                     int count,
+                     glm::vec4 *texels) const {
+  constexpr size_t texel_size = TexelSize(format);
+  if (!stream_) {
+    const uint8_t *data = level.data.data();
+    for (int i = 0; i < count; i++) {
+      texels[i] = DecodeTexel<format>(
+          data + TexelIndex(level, xs[i], ys[i]) * texel_size);
+    }
+    return;
+  }
+  // Neighbouring taps mostly share a tile, only look it up when it changes.
+  size_t tile_mask = (size_t(1) << level.tile_texel_shift) - 1;
+  size_t current_tile = ~size_t(0);
+  TextureCache::Tile tile;
+  for (int i = 0; i < count; i++) {
+    size_t index = TexelIndex(level, xs[i], ys[i]);
+    size_t tile_index = index >> level.tile_texel_shift;
+    if (tile_index != current_tile) {
+      tile = LoadTile(level, uint32_t(tile_index));
+      current_tile = tile_index;
+    }
+    texels[i] = DecodeTexel<format>(tile->data() +
+                                    (index & tile_mask) * texel_size);
+  }
+}
+
+glm::vec4 Texture::SampleLod(glm::vec2 tex_coord,
+                             float lod,
+                             glm::vec2 *random) const {
+  int max_level = int(levels_.size()) - 1;
+  lod = std::min(std::max(lod, 0.0f), float(max_level));
+  if (sample_type_ == SAMPLE_TYPE_NEAREST) {
+    return SampleLevel(levels_[std::lround(lod)], tex_coord, random);
+  }
+  int level = std::min(int(lod), max_level);
+  float fraction = lod - float(level);
+  if (random) {
+    if (random->x < fraction) {
+      random->x = std::min(random->x / fraction, 0.99999994f);
+      level = std::min(level + 1, max_level);
+    } else {
+      random->x = std::min((random->x - fraction) / (1.0f - fraction),
+                           0.99999994f);
+    }
+    return SampleLevel(levels_[level], tex_coord, random);
+  }
+  auto result = SampleLevel(levels_[level], tex_coord, nullptr);
+  if (fraction > 0.0f && level < max_level) {
+    result = result * (1.0f - fraction) +
+             SampleLevel(levels_[level + 1], tex_coord, nullptr) * fraction;
+  }
+  return result;
+}
+
+glm::vec4 Texture::SampleFootprint(glm::vec2 tex_coord,
+                                   glm::vec2 duv_dx,
+                                   glm::vec2 duv_dy,
+                                   TextureFilter filter,
+                                   glm::vec2 *random) const {
+  constexpr int kMaxAnisotropy = 16;
+  if (filter == TEXTURE_FILTER_NONE) {
+    return SampleLevel(levels_[0], tex_coord, random);
+  }
+  glm::vec2 size{GetWidth(), GetHeight()};
+  float length_x = glm::length(duv_dx * size);
+  float length_y = glm::length(duv_dy * size);
+  float major_length = std::max(length_x, length_y);
+  if (filter == TEXTURE_FILTER_TRILINEAR) {
+    return SampleLod(tex_coord, std::log2(std::max(major_length, 1e-8f)),
+                     random);
+  }
+
+  // Anisotropic filtering probes along the major axis of the footprint with
+  // the level matching the minor axis, as done by GPU samplers.
+  float minor_length = std::max(std::min(length_x, length_y), 1e-8f);
+  int num_probes = std::min(
+      std::max(int(std::ceil(major_length / minor_length)), 1),
+      kMaxAnisotropy);
+  float lod = std::log2(std::max(major_length / float(num_probes), 1e-8f));
+  if (num_probes == 1) {
+    return SampleLod(tex_coord, lod, random);
+  }
+  auto major_axis = length_x > length_y ? duv_dx : duv_dy;
+  auto probe_offset = [num_probes](int i) {
+    return (float(i) + 0.5f) / float(num_probes) - 0.5f;
+  };
+  if (random) {
+    float scaled = random->y * float(num_probes);
+    int probe = std::min(int(scaled), num_probes - 1);
+    random->y = std::min(scaled - float(probe), 0.99999994f);
+    return SampleLod(tex_coord + major_axis * probe_offset(probe), lod,
+                     random);
+  }
+  glm::vec4 result{0.0f};
+  for (int i = 0; i < num_probes; i++) {
+    result += SampleLod(tex_coord + major_axis * probe_offset(i), lod, nullptr);
+  }
+  return result * (1.0f / float(num_probes));
+}
+
+void Texture::SetLevel(int level,
+                       uint32_t width,
+                       uint32_t height,
+                       const glm::vec4 *color_buffer) {
+  InitLevel(level, width, height);
+  auto &mip_level = levels_[level];
+  size_t texel_size = TexelSize(format_);
+  for (int y = 0; y < height; y++) {
+    for (int x = 0; x < width; x++) {
+      EncodeTexel(format_, color_buffer[y * width + x],
+                  &mip_level.data[TexelIndex(mip_level, x, y) * texel_size]);
+    }
+  }
+}
+
+template <TexelFormat format>
+glm::vec4 Texture::Fetch(const MipLevel &level, int x, int y) const {
+  x = std::min(int(level.width - 1), std::max(x, 0));
+  y = std::min(int(level.height - 1), std::max(y, 0));
+  glm::vec4 texel;
+  Gather<format>(level, &x, &y, 1, &texel);
+  return texel;
+}
+
+glm::vec4 Texture::Fetch(const MipLevel &level, int x, int y) const {
+  switch (format_) {
+    case TEXEL_FORMAT_RGBA16F:
+      return Fetch<TEXEL_FORMAT_RGBA16F>(level, x, y);
+    case TEXEL_FORMAT_RGBA8:
+      return Fetch<TEXEL_FORMAT_RGBA8>(level, x, y);
+    case TEXEL_FORMAT_RGB9E5:
+      return Fetch<TEXEL_FORMAT_RGB9E5>(level, x, y);
+    default:
+      return Fetch<TEXEL_FORMAT_RGBA32F>(level, x, y);
+  }
+}
+
+template <TexelFormat format>
+glm::vec4 Texture::SampleLevel(const MipLevel &level,
+                               glm::vec2 tex_coord,
+                               glm::vec2 *random) const {
+  tex_coord = tex_coord - glm::floor(tex_coord);
+  tex_coord *= glm::vec2{level.width, level.height};
+  if (sample_type_ != SAMPLE_TYPE_NEAREST) {
+    int x = std::lround(tex_coord.x - 0.5f);
+    int y = std::lround(tex_coord.y - 0.5f);
+    float fx = tex_coord.x - float(x);
+    float fy = tex_coord.y - float(y);
+    // The four taps share their clamped coordinates and are blended with
+    // whole vector lerps.
+    int max_x = int(level.width) - 1;
+    int max_y = int(level.height) - 1;
+    int x0 = std::min(std::max(x, 0), max_x);
+    int x1 = std::min(std::max(x + 1, 0), max_x);
+    int y0 = std::min(std::max(y, 0), max_y);
+    int y1 = std::min(std::max(y + 1, 0), max_y);
+    if (random) {
+      // Picks one of the four taps with its bilinear weight.
+      int tap_x = x0;
+      int tap_y = y0;
+      if (random->x < fx) {
+        random->x = std::min(random->x / fx, 0.99999994f);
+        tap_x = x1;
+      } else {
+        random->x = std::min((random->x - fx) / (1.0f - fx), 0.99999994f);
+      }
+      if (random->y < fy) {
+        random->y = std::min(random->y / fy, 0.99999994f);
+        tap_y = y1;
+      } else {
+        random->y = std::min((random->y - fy) / (1.0f - fy), 0.99999994f);
+      }
+      glm::vec4 texel;
+      Gather<format>(level, &tap_x, &tap_y, 1, &texel);
+      return texel;
+    }
+    const int xs[4] = {x0, x1, x0, x1};
+    const int ys[4] = {y0, y0, y1, y1};
+    glm::vec4 texels[4];
+    Gather<format>(level, xs, ys, 4, texels);
+    return glm::mix(glm::mix(texels[0], texels[1], fx),
+                    glm::mix(texels[2], texels[3], fx), fy);
+  } else {
+    return Fetch<format>(level, std::lround(tex_coord.x),
+                         std::lround(tex_coord.y));
+  }
+}
+
+glm::vec4 Texture::SampleLevel(const MipLevel &level,
+                               glm::vec2 tex_coord,
+                               glm::vec2 *random) const {
+  switch (format_) {
+    case TEXEL_FORMAT_RGBA16F:
+      return SampleLevel<TEXEL_FORMAT_RGBA16F>(level, tex_coord, random);
+    case TEXEL_FORMAT_RGBA8:
+      return SampleLevel<TEXEL_FORMAT_RGBA8>(level, tex_coord, random);
+    case TEXEL_FORMAT_RGB9E5:
+      return SampleLevel<TEXEL_FORMAT_RGB9E5>(level, tex_coord, random);
+    default:
+      return SampleLevel<TEXEL_FORMAT_RGBA32F>(level, tex_coord, random);
+  }
 }
 
 }  // namespace sparks
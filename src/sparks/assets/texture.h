@@ -1,39 +1,174 @@
 #pragma once
 #include "glm/glm.hpp"
+#include "memory"
+#include "sparks/assets/texture_cache.h"
 #include "string"
 #include "vector"
 
 namespace sparks {
 
-enum SampleType { SAMPLE_TYPE_LINEAR = 0, SAMPLE_TYPE_NEAREST = 1 };
+// Stochastic sampling picks a single texel with probability equal to its
+// bilinear weight, and likewise a single mip level and anisotropic probe,
+// when random numbers are supplied. It converges to linear filtering.
+enum SampleType {
+  SAMPLE_TYPE_LINEAR = 0,
+  SAMPLE_TYPE_NEAREST = 1,
+  SAMPLE_TYPE_STOCHASTIC = 2
+};
+
+// Storage format of the texels. 8-bit images are kept as loaded and decoded
+// as unorm values, HDR images use a shared exponent or half floats.
+enum TexelFormat {
+  TEXEL_FORMAT_RGBA32F = 0,
+  TEXEL_FORMAT_RGBA16F = 1,
+  TEXEL_FORMAT_RGBA8 = 2,
+  TEXEL_FORMAT_RGB9E5 = 3
+};
+
+// Order of the texels in memory. The tiled layout stores 4x4 texel blocks
+// contiguously and orders the blocks along a Z-curve inside tiles of up to
+// 64x64 texels, so bilinear footprints rarely straddle cache lines. Tiles
+// shrink to fit thin levels, levels thinner than a block stay row-major.
+enum TexelLayout { TEXEL_LAYOUT_LINEAR = 0, TEXEL_LAYOUT_TILED = 1 };
+
+// How footprint lookups combine the mip levels.
+enum TextureFilter {
+  TEXTURE_FILTER_NONE = 0,
+  TEXTURE_FILTER_TRILINEAR = 1,
+  TEXTURE_FILTER_ANISOTROPIC = 2
+};
 
 class Texture {
  public:
   Texture(uint32_t width = 1,
           uint32_t height = 1,
           const glm::vec4 &color = glm::vec4{1.0f},
-          SampleType sample_type = SAMPLE_TYPE_LINEAR);
+          SampleType sample_type = SAMPLE_TYPE_LINEAR,
+          TexelFormat format = TEXEL_FORMAT_RGBA32F);
   Texture(uint32_t width,
           uint32_t height,
           const glm::vec4 *color_buffer,
-          SampleType sample_type);
+          SampleType sample_type,
+          TexelFormat format = TEXEL_FORMAT_RGBA32F);
+  // Takes texels already encoded in format.
+  Texture(uint32_t width,
+          uint32_t height,
+          const uint8_t *texel_data,
+          SampleType sample_type,
+          TexelFormat format);
   void Resize(uint32_t width, uint32_t height);
+  // With a TextureCache budget set, 8-bit images are streamed: only the
+  // header is read here and tiles are decoded on first access.
   static bool Load(const std::string &file_path, Texture &texture);
+  // Decodes the contents file_data of the file at file_path.
+  static bool Load(const std::string &file_path,
+                   const std::vector<uint8_t> &file_data,
+                   Texture &texture);
   void Store(const std::string &file_path);
   void SetSampleType(SampleType sample_type);
   [[nodiscard]] SampleType GetSampleType() const;
-  glm::vec4 &operator()(int x, int y);
-  const glm::vec4 &operator()(int x, int y) const;
+  [[nodiscard]] TexelFormat GetFormat() const;
+  // Rearranges the stored texels of every level.
+  void SetLayout(TexelLayout layout);
+  [[nodiscard]] TexelLayout GetLayout() const;
+  // Decoded texel of the full resolution level.
+  glm::vec4 operator()(int x, int y) const;
   [[nodiscard]] glm::vec4 Sample(glm::vec2 tex_coord) const;
+  // Filters level lod, fractional levels are blended linearly.
+  [[nodiscard]] glm::vec4 Sample(glm::vec2 tex_coord, float lod) const;
+  // Filters the footprint spanned by the texture coordinate differentials
+  // duv_dx and duv_dy, following the semantics of GLSL textureGrad.
+  [[nodiscard]] glm::vec4 Sample(glm::vec2 tex_coord,
+                                 glm::vec2 duv_dx,
+                                 glm::vec2 duv_dy,
+                                 TextureFilter filter) const;
+  // Same as above, stochastic textures consume the two random numbers.
+  [[nodiscard]] glm::vec4 Sample(glm::vec2 tex_coord,
+                                 glm::vec2 duv_dx,
+                                 glm::vec2 duv_dy,
+                                 TextureFilter filter,
+                                 glm::vec2 random) const;
+  void GenerateMipmaps();
   [[nodiscard]] uint32_t GetWidth() const;
   [[nodiscard]] uint32_t GetHeight() const;
-  glm::vec4 *GetBuffer();
-  [[nodiscard]] const glm::vec4 *GetBuffer() const;
+  [[nodiscard]] int GetNumLevels() const;
+  // Decodes the full resolution level.
+  [[nodiscard]] std::vector<glm::vec4> GetBuffer() const;
+  // Resident bytes, tiles of streamed textures are accounted by the cache.
+  [[nodiscard]] size_t GetMemoryUsage() const;
+  [[nodiscard]] bool IsStreamed() const;
 
  private:
-  uint32_t width_{};
-  uint32_t height_{};
-  std::vector<glm::vec4> buffer_;
+  struct Stream;
+
+  struct MipLevel {
+    uint32_t width{};
+    uint32_t height{};
+    // Width and height of the tiles as powers of two, zero for row-major
+    // levels.
+    int tile_shift_x{0};
+    int tile_shift_y{0};
+    // Texels per tile as a power of two, the tiles of row-major levels are
+    // runs of texels.
+    int tile_texel_shift{0};
+    // Tiles per row of tiles and the texel rows they cover, row-major levels
+    // are a single row of tiles.
+    uint32_t num_tiles_x{1};
+    uint32_t band_height{1};
+    // Streamed textures only, index of the first tile over all levels and
+    // offset of the level in the spill file.
+    uint32_t first_tile{0};
+    size_t file_offset{0};
+    std::vector<uint8_t> data;
+  };
+
+  void InitLevel(int level, uint32_t width, uint32_t height);
+  [[nodiscard]] size_t TexelIndex(const MipLevel &level, int x, int y) const;
+  void InitStream(const std::string &file_path,
+                  uint32_t width,
+                  uint32_t height);
+  void DecodeStream() const;
+  [[nodiscard]] TextureCache::Tile LoadTile(const MipLevel &level,
+                                            uint32_t tile) const;
+  // Decodes the texels at (xs[i], ys[i]), resolving streamed tiles.
+  template <TexelFormat format>
+  void Gather(const MipLevel &level,
+              const int *xs,
+              const int *ys,
+              int count,
+              glm::vec4 *texels) const;
+  void SetLevel(int level,
+                uint32_t width,
+                uint32_t height,
+                const glm::vec4 *color_buffer);
+  template <TexelFormat format>
+  [[nodiscard]] glm::vec4 Fetch(const MipLevel &level, int x, int y) const;
+  [[nodiscard]] glm::vec4 Fetch(const MipLevel &level, int x, int y) const;
+  // random is null for deterministic filtering, otherwise it is consumed and
+  // remapped to fresh uniform numbers.
+  template <TexelFormat format>
+  [[nodiscard]] glm::vec4 SampleLevel(const MipLevel &level,
+                                      glm::vec2 tex_coord,
+                                      glm::vec2 *random) const;
+  [[nodiscard]] glm::vec4 SampleLevel(const MipLevel &level,
+                                      glm::vec2 tex_coord,
+                                      glm::vec2 *random) const;
+  [[nodiscard]] glm::vec4 SampleLod(glm::vec2 tex_coord,
+                                    float lod,
+                                    glm::vec2 *random) const;
+  [[nodiscard]] glm::vec4 SampleFootprint(glm::vec2 tex_coord,
+                                          glm::vec2 duv_dx,
+                                          glm::vec2 duv_dy,
+                                          TextureFilter filter,
+                                          glm::vec2 *random) const;
+
+  // Level 0 is the full resolution image, every further level halves both
+  // dimensions down to 1x1.
+  std::vector<MipLevel> levels_;
   SampleType sample_type_{SAMPLE_TYPE_LINEAR};
+  TexelFormat format_{TEXEL_FORMAT_RGBA32F};
+  TexelLayout layout_{TEXEL_LAYOUT_TILED};
+  // Shared by copies of a streamed texture, null for resident textures.
+  std::shared_ptr<Stream> stream_;
 };
 }  // namespace sparks
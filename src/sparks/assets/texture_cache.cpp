@@ -0,0 +1,92 @@
+#include "sparks/assets/texture_cache.h"
+
+namespace sparks {
+
+TextureCache &TextureCache::GetInstance() {
+  static TextureCache texture_cache;
+  return texture_cache;
+}
+
+void TextureCache::SetMemoryBudget(size_t max_bytes) {
+  memory_budget_ = max_bytes;
+  for (auto &shard : shards_) {
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    Evict(shard, ~0ull);
+  }
+}
+
+size_t TextureCache::GetMemoryBudget() const {
+  return memory_budget_;
+}
+
+size_t TextureCache::GetMemoryUsage() const {
+  size_t memory_usage = 0;
+  for (auto &shard : shards_) {
+    memory_usage += shard.memory_usage;
+  }
+  return memory_usage;
+}
+
+uint32_t TextureCache::NewTextureId() {
+  return next_texture_id_++;
+}
+
+TextureCache::Tile TextureCache::GetTile(
+    uint32_t texture_id,
+    uint32_t tile_index,
+    const std::function<std::vector<uint8_t>()> &load) {
+  uint64_t key = (uint64_t(texture_id) << 32) | tile_index;
+  auto &shard = shards_[(texture_id * 31u + tile_index) % kNumShards];
+  {
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto it = shard.tiles.find(key);
+    if (it != shard.tiles.end()) {
+      shard.lru.splice(shard.lru.begin(), shard.lru, it->second.second);
+      return it->second.first;
+    }
+  }
+
+  // Loading happens outside the lock, concurrent misses on the same tile
+  // may both load it and the first insertion wins.
+  auto tile = std::make_shared<const std::vector<uint8_t>>(load());
+  std::lock_guard<std::mutex> lock(shard.mutex);
+  auto it = shard.tiles.find(key);
+  if (it != shard.tiles.end()) {
+    shard.lru.splice(shard.lru.begin(), shard.lru, it->second.second);
+    return it->second.first;
+  }
+  shard.lru.push_front(key);
+  shard.tiles.emplace(key, std::make_pair(tile, shard.lru.begin()));
+  shard.memory_usage += tile->size();
+  Evict(shard, key);
+  return tile;
+}
+
+void TextureCache::Release(uint32_t texture_id) {
+  for (auto &shard : shards_) {
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    for (auto it = shard.lru.begin(); it != shard.lru.end();) {
+      if (uint32_t(*it >> 32) != texture_id) {
+        ++it;
+        continue;
+      }
+      auto tile = shard.tiles.find(*it);
+      shard.memory_usage -= tile->second.first->size();
+      shard.tiles.erase(tile);
+      it = shard.lru.erase(it);
+    }
+  }
+}
+
+void TextureCache::Evict(Shard &shard, uint64_t keep_key) {
+  size_t shard_budget = memory_budget_ / kNumShards;
+  while (shard.memory_usage > shard_budget && !shard.lru.empty() &&
+         shard.lru.back() != keep_key) {
+    auto tile = shard.tiles.find(shard.lru.back());
+    shard.memory_usage -= tile->second.first->size();
+    shard.tiles.erase(tile);
+    shard.lru.pop_back();
+  }
+}
+
+}  // namespace sparks
@@ -0,0 +1,55 @@
+#pragma once
+#include "atomic"
+#include "functional"
+#include "list"
+#include "memory"
+#include "mutex"
+#include "unordered_map"
+#include "vector"
+
+namespace sparks {
+
+// Process wide least recently used cache of streamed texture tiles. Keys
+// combine the id of the owning texture with the index of the tile inside it.
+// The cache is split into independently locked shards so that the render
+// workers rarely contend, each shard holds an equal part of the budget.
+class TextureCache {
+ public:
+  using Tile = std::shared_ptr<const std::vector<uint8_t>>;
+
+  static TextureCache &GetInstance();
+
+  // 0 disables streaming, textures are then fully decoded when loaded.
+  void SetMemoryBudget(size_t max_bytes);
+  [[nodiscard]] size_t GetMemoryBudget() const;
+  [[nodiscard]] size_t GetMemoryUsage() const;
+
+  [[nodiscard]] uint32_t NewTextureId();
+  // Returns the resident tile, or calls load and inserts its result on a
+  // miss. Evicted tiles stay valid as long as they are referenced.
+  Tile GetTile(uint32_t texture_id,
+               uint32_t tile_index,
+               const std::function<std::vector<uint8_t>()> &load);
+  // Drops every tile of the texture.
+  void Release(uint32_t texture_id);
+
+ private:
+  static constexpr int kNumShards = 16;
+
+  struct Shard {
+    std::mutex mutex;
+    std::list<uint64_t> lru;
+    std::unordered_map<uint64_t,
+                       std::pair<Tile, std::list<uint64_t>::iterator>>
+        tiles;
+    std::atomic<size_t> memory_usage{0};
+  };
+
+  void Evict(Shard &shard, uint64_t keep_key);
+
+  Shard shards_[kNumShards];
+  std::atomic<size_t> memory_budget_{0};
+  std::atomic<uint32_t> next_texture_id_{0};
+};
+
+}  // namespace sparks
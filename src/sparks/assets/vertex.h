@@ -1,4 +1,5 @@
 #pragma once
+#include "cstring"
 #include "glm/glm.hpp"
 
 namespace sparks {
@@ -21,19 +22,36 @@ struct Vertex {
 
   bool operator==(const Vertex &vertex) const {
     return position == vertex.position && normal == vertex.normal &&
-           tangent == vertex.tangent && tex_coord == tex_coord &&
+           tangent == vertex.tangent && tex_coord == vertex.tex_coord &&
            signal == vertex.signal;
   }
 };
 
+// Mixes the bit patterns of every component, so that vertices differing
+// only by a permutation or a sign of their coordinates get unrelated hashes.
 struct VertexHash {
   std::size_t operator()(const Vertex &v) const {
-    auto hash_eng = std::hash<float>();
-    return hash_eng(v.position.x) ^ hash_eng(v.position.y) ^
-           hash_eng(v.position.z) ^ hash_eng(v.normal.x) ^
-           hash_eng(v.normal.y) ^ hash_eng(v.normal.z) ^ hash_eng(v.tangent.x) ^
-           hash_eng(v.tangent.y) ^ hash_eng(v.tangent.z) ^
-           hash_eng(v.tex_coord.x) ^ hash_eng(v.tex_coord.y);
+    uint64_t hash = 0x9e3779b97f4a7c15ull;
+    auto mix = [&hash](float value) {
+      // -0.0f compares equal to 0.0f and has to hash equally.
+      value = value == 0.0f ? 0.0f : value;
+      uint32_t bits;
+      std::memcpy(&bits, &value, sizeof(bits));
+      hash = (hash ^ bits) * 0xff51afd7ed558ccdull;
+      hash ^= hash >> 32;
+    };
+    for (int i = 0; i < 3; i++) {
+      mix(v.position[i]);
+      mix(v.normal[i]);
+      mix(v.tangent[i]);
+    }
+    mix(v.tex_coord.x);
+    mix(v.tex_coord.y);
+    mix(v.signal);
+    hash ^= hash >> 33;
+    hash *= 0xc4ceb9fe1a85ec53ull;
+    hash ^= hash >> 33;
+    return std::size_t(hash);
   }
 };
 }  // namespace sparks
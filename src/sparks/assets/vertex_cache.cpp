@@ -0,0 +1,93 @@
+#include "sparks/assets/vertex_cache.h"
+
+namespace sparks {
+
+std::vector<uint32_t> OptimizeVertexCache(Span<const uint32_t> indices,
+                                          size_t vertex_count,
+                                          int cache_size) {
+  size_t triangle_count = indices.size() / 3;
+  // Triangles around each vertex, in compressed rows.
+  std::vector<uint32_t> offsets(vertex_count + 1, 0);
+  for (size_t i = 0; i < triangle_count * 3; i++) {
+    offsets[indices[i] + 1]++;
+  }
+  for (size_t i = 0; i < vertex_count; i++) {
+    offsets[i + 1] += offsets[i];
+  }
+  std::vector<uint32_t> adjacency(offsets.back());
+  std::vector<uint32_t> live_count(vertex_count);
+  for (size_t i = 0; i < triangle_count * 3; i++) {
+    auto vertex = indices[i];
+    adjacency[offsets[vertex] + live_count[vertex]++] = uint32_t(i / 3);
+  }
+
+  std::vector<int64_t> cache_time(vertex_count, 0);
+  int64_t time = cache_size + 1;
+  std::vector<bool> emitted(triangle_count, false);
+  std::vector<uint32_t> dead_end;
+  std::vector<uint32_t> candidates;
+  std::vector<uint32_t> result;
+  result.reserve(triangle_count * 3);
+  size_t cursor = 0;
+
+  auto next_vertex = [&]() -> int64_t {
+    // The candidate staying in the cache the longest after its remaining
+    // triangles were emitted, preferring the oldest one.
+    int64_t best = -1;
+    int64_t best_priority = -1;
+    for (auto vertex : candidates) {
+      if (!live_count[vertex]) {
+        continue;
+      }
+      int64_t priority = 0;
+      if (time - cache_time[vertex] + 2 * live_count[vertex] <= cache_size) {
+        priority = time - cache_time[vertex];
+      }
+      if (priority > best_priority) {
+        best = vertex;
+        best_priority = priority;
+      }
+    }
+    if (best >= 0) {
+      return best;
+    }
+    while (!dead_end.empty()) {
+      auto vertex = dead_end.back();
+      dead_end.pop_back();
+      if (live_count[vertex]) {
+        return vertex;
+      }
+    }
+    while (cursor < vertex_count) {
+      if (live_count[cursor]) {
+        return int64_t(cursor);
+      }
+      cursor++;
+    }
+    return -1;
+  };
+
+  for (int64_t fan = next_vertex(); fan >= 0; fan = next_vertex()) {
+    candidates.clear();
+    for (auto i = offsets[fan]; i < offsets[fan + 1]; i++) {
+      auto triangle = adjacency[i];
+      if (emitted[triangle]) {
+        continue;
+      }
+      emitted[triangle] = true;
+      for (int j = 0; j < 3; j++) {
+        auto vertex = indices[triangle * 3 + j];
+        result.push_back(vertex);
+        dead_end.push_back(vertex);
+        candidates.push_back(vertex);
+        live_count[vertex]--;
+        if (time - cache_time[vertex] > cache_size) {
+          cache_time[vertex] = time++;
+        }
+      }
+    }
+  }
+  return result;
+}
+
+}  // namespace sparks
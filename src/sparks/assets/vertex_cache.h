@@ -0,0 +1,17 @@
+#pragma once
+#include "cstdint"
+#include "sparks/util/span.h"
+#include "vector"
+
+namespace sparks {
+
+// Reorders the triangles of an index list for the post-transform vertex
+// cache of the rasterizer with Tipsify of Sander et al., "Fast
+// Triangle Reordering for Vertex Locality and Reduced Overdraw". Fans around
+// one vertex at a time and moves on to the most recently cached vertex that
+// still has triangles left. Vertices are not renumbered.
+std::vector<uint32_t> OptimizeVertexCache(Span<const uint32_t> indices,
+                                          size_t vertex_count,
+                                          int cache_size = 16);
+
+}  // namespace sparks
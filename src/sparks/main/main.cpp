@@ -18,12 +18,25 @@ ABSL_FLAG(std::string,
           scene,
           "../../scenes/cornell.xml",
           "Path to initial scene file");
+ABSL_FLAG(uint32_t,
+          texture_cache_mb,
+          0,
+          "Stream 8-bit textures through a tile cache of the given size in "
+          "MB, 0 loads textures fully");
+ABSL_FLAG(std::string,
+          mesh_cache_dir,
+          sparks::MeshCache::GetInstance().GetDirectory(),
+          "Directory of the binary cache of loaded meshes, empty disables it");
 
 void RunApp(sparks::Renderer *renderer);
 
 int main(int argc, char *argv[]) {
   absl::SetProgramUsageMessage("Usage");
   absl::ParseCommandLine(argc, argv);
+  sparks::TextureCache::GetInstance().SetMemoryBudget(
+      size_t(absl::GetFlag(FLAGS_texture_cache_mb)) << 20);
+  sparks::MeshCache::GetInstance().SetDirectory(
+      absl::GetFlag(FLAGS_mesh_cache_dir));
   sparks::RendererSettings renderer_settings;
   sparks::Renderer renderer(absl::GetFlag(FLAGS_scene), renderer_settings);
   RunApp(&renderer);
@@ -3,50 +3,275 @@
 #include "sparks/util/util.h"
 
 namespace sparks {
+
+namespace {
+constexpr float kDiffuseConeSpread = 0.2f;
+
+float PowerHeuristic(float pdf, float other_pdf) {
+  pdf *= pdf;
+  other_pdf *= other_pdf;
+  return pdf / (pdf + other_pdf);
+}
+
+float Luminance(const glm::vec3 &color) {
+  return (color.r + color.g + color.b) * (1.0f / 3.0f);
+}
+
+glm::vec3 SampleCosineHemisphere(const glm::vec3 &normal, float r1, float r2) {
+  glm::vec3 tangent = std::abs(normal.x) > 0.5f ? glm::vec3{0.0f, 1.0f, 0.0f}
+                                                : glm::vec3{1.0f, 0.0f, 0.0f};
+  tangent = glm::normalize(glm::cross(tangent, normal));
+  auto bitangent = glm::cross(normal, tangent);
+  float radius = std::sqrt(r1);
+  float phi = r2 * 2.0f * PI;
+  return tangent * (radius * std::cos(phi)) +
+         bitangent * (radius * std::sin(phi)) +
+         normal * std::sqrt(std::max(1.0f - r1, 0.0f));
+}
+
+// Filters the texture over the footprint of a ray cone of the given width.
+// The footprint is the cone cross section stretched along the ray by the
+// inverse cosine of the incident angle, mapped to texture space through the
+// position derivatives of the surface. Stochastic textures consume random.
+glm::vec4 SampleTextureFootprint(const Texture &texture,
+                                 const HitRecord &hit_record,
+                                 const glm::vec3 &direction,
+                                 float cone_width,
+                                 TextureFilter filter,
+                                 glm::vec2 random) {
+  const auto &dpdu = hit_record.dpdu;
+  const auto &dpdv = hit_record.dpdv;
+  float a11 = glm::dot(dpdu, dpdu);
+  float a12 = glm::dot(dpdu, dpdv);
+  float a22 = glm::dot(dpdv, dpdv);
+  float det = a11 * a22 - a12 * a12;
+  if (filter == TEXTURE_FILTER_NONE || cone_width <= 0.0f ||
+      det <= a11 * a22 * 1e-6f) {
+    return texture.Sample(hit_record.tex_coord, glm::vec2{0.0f},
+                          glm::vec2{0.0f}, TEXTURE_FILTER_NONE, random);
+  }
+
+  auto normal = hit_record.geometry_normal;
+  float cos_theta = std::max(std::abs(glm::dot(normal, direction)), 1e-2f);
+  auto major_axis = direction - normal * glm::dot(direction, normal);
+  if (glm::length(major_axis) < 1e-6f) {
+    major_axis = std::abs(normal.x) > 0.5f ? glm::vec3{0.0f, 1.0f, 0.0f}
+                                           : glm::vec3{1.0f, 0.0f, 0.0f};
+    major_axis -= normal * glm::dot(major_axis, normal);
+  }
+  major_axis = glm::normalize(major_axis);
+  auto minor_axis = glm::cross(normal, major_axis) * cone_width;
+  major_axis *= cone_width / cos_theta;
+
+  // Least squares solution of dpdu * du + dpdv * dv = axis.
+  auto to_tex_coord = [&](const glm::vec3 &axis) {
+    float b1 = glm::dot(dpdu, axis);
+    float b2 = glm::dot(dpdv, axis);
+    return glm::vec2{a22 * b1 - a12 * b2, a11 * b2 - a12 * b1} / det;
+  };
+  return texture.Sample(hit_record.tex_coord, to_tex_coord(major_axis),
+                        to_tex_coord(minor_axis), filter, random);
+}
+
+// A scattering vertex whose incident radiance is recorded into the SD-tree.
+struct GuidingVertex {
+  glm::vec3 position;
+  glm::vec3 direction;
+  float pdf;
+  glm::vec3 throughput{1.0f};
+  glm::vec3 radiance{0.0f};
+};
+}  // namespace
+
 PathTracer::PathTracer(const RendererSettings *render_settings,
-                       const Scene *scene) {
+                       const Scene *scene,
+                       SDTree *sd_tree) {
   render_settings_ = render_settings;
   scene_ = scene;
+  sd_tree_ = sd_tree;
 }
 
 glm::vec3 PathTracer::SampleRay(glm::vec3 origin,
                                 glm::vec3 direction,
                                 int x,
                                 int y,
-                                int sample) const {
+                                int sample,
+                                float spread_angle) const {
   glm::vec3 throughput{1.0f};
   glm::vec3 radiance{0.0f};
   HitRecord hit_record;
   const int max_bounce = render_settings_->num_bounces;
   std::mt19937 rd(sample ^ x ^ y);
+  std::uniform_real_distribution<float> uniform(0.0f, 1.0f);
+  auto &light_sampler = scene_->GetLightSampler();
+  const bool enable_mis = render_settings_->enable_mis;
+  const bool enable_guiding =
+      sd_tree_ && render_settings_->enable_path_guiding;
+  const bool record_guiding = enable_guiding && sd_tree_->IsRecording();
+  std::vector<GuidingVertex> guiding_vertices;
+  const bool enable_envmap_cubemap = render_settings_->enable_envmap_cubemap;
+  const float envmap_scale = render_settings_->envmap_scale;
+  auto envmap_radiance = [&](const glm::vec3 &omega) {
+    return (enable_envmap_cubemap
+                ? scene_->SampleEnvmapCubemap(omega)
+                : glm::vec3{scene_->SampleEnvmap(omega)}) *
+           envmap_scale;
+  };
+
+  // contribution arrives at the current vertex, it also arrives at every
+  // recorded vertex scaled by the throughput in between.
+  auto add_radiance = [&](const glm::vec3 &contribution) {
+    radiance += throughput * contribution;
+    for (auto &vertex : guiding_vertices) {
+      vertex.radiance += vertex.throughput * contribution;
+    }
+  };
+
+  // Ray cone of Akenine-Moller et al., "Texture Level of Detail Strategies
+  // for Real-Time Ray Tracing", selecting the texture level of each hit.
+  float cone_width = 0.0f;
+  float cone_spread = spread_angle;
+
+  float scatter_pdf = 0.0f;
+  glm::vec3 scatter_position{0.0f};
+  glm::vec3 scatter_normal{0.0f};
   for (int i = 0; i < max_bounce; i++) {
-    auto t = scene_->TraceRay(origin, direction, 1e-3f, 1e4f, &hit_record);
-    if (t > 0.0f) {
-      auto &material =
-          scene_->GetEntity(hit_record.hit_entity_id).GetMaterial();
-      if (material.material_type == MATERIAL_TYPE_EMISSION) {
-        radiance += throughput * material.emission * material.emission_strength;
-        break;
-      } else {
-        throughput *=
-            material.base_color *
-            glm::vec3{
-                scene_->GetTextures()[material.base_color_texture_id].Sample(
-                    hit_record.tex_coord)};
-        origin = hit_record.position;
-        direction = scene_->GetEnvmapLightDirection();
-        radiance += throughput * scene_->GetEnvmapMinorColor();
-        throughput *=
-            std::max(glm::dot(direction, hit_record.normal), 0.0f) * 2.0f;
-        if (scene_->TraceRay(origin, direction, 1e-3f, 1e4f, nullptr) < 0.0f) {
-          radiance += throughput * scene_->GetEnvmapMajorColor();
+    auto t = scene_->TraceRay(Ray(origin, direction, 1e-3f, 1e4f), &hit_record);
+    if (t < 0.0f) {
+      float weight = 1.0f;
+      if (enable_mis && i) {
+        weight =
+            PowerHeuristic(scatter_pdf, scene_->GetEnvmapLightPdf(direction));
+      }
+      add_radiance(envmap_radiance(direction) * weight);
+      break;
+    }
+    cone_width += cone_spread * t;
+
+    auto &material = scene_->GetEntity(hit_record.hit_entity_id).GetMaterial();
+    if (material.emission_strength > 1e-4f) {
+      float weight = 1.0f;
+      if (enable_mis && i) {
+        float cos_light = std::abs(glm::dot(
+            glm::normalize(hit_record.geometry_normal), direction));
+        float area_pdf =
+            render_settings_->enable_light_bvh
+                ? light_sampler.GetPdf(hit_record.hit_entity_id,
+                                       hit_record.primitive_id,
+                                       scatter_position, scatter_normal)
+                : light_sampler.GetPdf(hit_record.hit_entity_id);
+        weight = PowerHeuristic(scatter_pdf,
+                                area_pdf * t * t / std::max(cos_light, 1e-6f));
+      }
+      add_radiance(material.emission * material.emission_strength * weight);
+    }
+    if (material.material_type == MATERIAL_TYPE_EMISSION) {
+      break;
+    }
+
+    // Every other material is shaded as Lambertian by the CPU renderer.
+    auto albedo =
+        material.base_color *
+        glm::vec3{SampleTextureFootprint(
+            scene_->GetTextures()[material.base_color_texture_id], hit_record,
+            direction, cone_width, render_settings_->texture_filter,
+            glm::vec2{uniform(rd), uniform(rd)})};
+    auto normal = glm::normalize(hit_record.normal);
+    if (glm::dot(normal, direction) > 0.0f) {
+      normal = -normal;
+    }
+    origin = hit_record.position;
+
+    const DirectionalTree *guiding_tree =
+        enable_guiding ? sd_tree_->GetSamplingTree(origin) : nullptr;
+    const float bsdf_fraction = guiding_tree ? 0.5f : 1.0f;
+    // One-sample MIS density of the BSDF and guiding mixture.
+    auto scatter_density = [&](const glm::vec3 &omega) {
+      float pdf =
+          bsdf_fraction * std::max(glm::dot(omega, normal), 0.0f) * INV_PI;
+      if (guiding_tree) {
+        pdf += (1.0f - bsdf_fraction) * guiding_tree->GetPdf(omega);
+      }
+      return pdf;
+    };
+
+    if (enable_mis) {
+      LightSample light_sample;
+      bool light_sampled =
+          render_settings_->enable_light_bvh
+              ? light_sampler.Sample(origin, normal, uniform(rd), uniform(rd),
+                                     uniform(rd), &light_sample)
+              : light_sampler.Sample(uniform(rd), uniform(rd), uniform(rd),
+                                     &light_sample);
+      if (light_sampled) {
+        auto omega_in = light_sample.position - origin;
+        auto dist = glm::length(omega_in);
+        omega_in /= dist;
+        auto cos_surface = glm::dot(omega_in, normal);
+        auto cos_light = std::abs(glm::dot(omega_in, light_sample.normal));
+        if (cos_surface > 0.0f && cos_light > 1e-6f && dist > 1e-3f &&
+            scene_->TraceRay(Ray(origin, omega_in, 1e-3f, dist * 0.999f),
+                             nullptr) < 0.0f) {
+          float light_pdf = light_sample.pdf * dist * dist / cos_light;
+          add_radiance(albedo * light_sample.emission *
+                       (cos_surface * INV_PI / light_pdf *
+                        PowerHeuristic(light_pdf, scatter_density(omega_in))));
+        }
+      }
+
+      glm::vec3 omega_in;
+      float envmap_pdf =
+          scene_->SampleEnvmapLight(uniform(rd), uniform(rd), &omega_in);
+      if (envmap_pdf > 0.0f) {
+        auto cos_surface = glm::dot(omega_in, normal);
+        if (cos_surface > 0.0f &&
+            scene_->TraceRay(Ray(origin, omega_in, 1e-3f, 1e4f), nullptr) <
+                0.0f) {
+          add_radiance(albedo * envmap_radiance(omega_in) *
+                       (cos_surface * INV_PI / envmap_pdf *
+                        PowerHeuristic(envmap_pdf, scatter_density(omega_in))));
         }
-        break;
       }
+    }
+
+    if (uniform(rd) < bsdf_fraction) {
+      direction = SampleCosineHemisphere(normal, uniform(rd), uniform(rd));
     } else {
-      radiance += throughput * glm::vec3{scene_->SampleEnvmap(direction)};
+      direction = guiding_tree->Sample(uniform(rd), uniform(rd));
+    }
+    auto cos_surface = glm::dot(direction, normal);
+    scatter_pdf = scatter_density(direction);
+    if (cos_surface <= 0.0f || scatter_pdf <= 0.0f) {
+      break;
+    }
+    auto weight = albedo * (cos_surface * INV_PI / scatter_pdf);
+    throughput *= weight;
+    for (auto &vertex : guiding_vertices) {
+      vertex.throughput *= weight;
+    }
+    if (record_guiding) {
+      guiding_vertices.push_back({origin, direction, scatter_pdf});
+    }
+    scatter_position = origin;
+    scatter_normal = normal;
+    // Diffuse scattering blurs the footprint of the following hits.
+    cone_spread += kDiffuseConeSpread;
+
+    float survive = std::min(std::max(throughput.x, std::max(throughput.y,
+                                                             throughput.z)),
+                             1.0f);
+    if (uniform(rd) > survive) {
       break;
     }
+    throughput /= survive;
+    for (auto &vertex : guiding_vertices) {
+      vertex.throughput /= survive;
+    }
+  }
+
+  for (auto &vertex : guiding_vertices) {
+    sd_tree_->Record(vertex.position, vertex.direction,
+                     Luminance(vertex.radiance) / vertex.pdf);
   }
   return radiance;
 }
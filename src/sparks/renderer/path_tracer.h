@@ -2,19 +2,24 @@
 #include "random"
 #include "sparks/assets/scene.h"
 #include "sparks/renderer/renderer_settings.h"
+#include "sparks/renderer/sd_tree.h"
 
 namespace sparks {
 class PathTracer {
  public:
-  PathTracer(const RendererSettings *render_settings, const Scene *scene);
+  PathTracer(const RendererSettings *render_settings,
+             const Scene *scene,
+             SDTree *sd_tree = nullptr);
   [[nodiscard]] glm::vec3 SampleRay(glm::vec3 origin,
                                     glm::vec3 direction,
                                     int x,
                                     int y,
-                                    int sample) const;
+                                    int sample,
+                                    float spread_angle = 0.0f) const;
 
  private:
   const RendererSettings *render_settings_{};
   const Scene *scene_{};
+  SDTree *sd_tree_{};
 };
 }  // namespace sparks
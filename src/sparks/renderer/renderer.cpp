@@ -9,6 +9,7 @@ Renderer::Renderer(const std::string &scene_file_path,
                    const RendererSettings &renderer_settings)
     : scene_(scene_file_path) {
   renderer_settings_ = renderer_settings;
+  scene_.UpdateLightSampler(renderer_settings_.enable_light_bvh);
 }
 
 Scene &Renderer::GetScene() {
@@ -70,12 +71,12 @@ void Renderer::WorkerThread() {
   std::unique_lock<std::mutex> lock(task_queue_mutex_);
   lock.unlock();
   std::vector<glm::vec3> sample_result;
-  PathTracer path_tracer(&renderer_settings_, &scene_);
+  PathTracer path_tracer(&renderer_settings_, &scene_, &sd_tree_);
   while (true) {
     lock.lock();
     while (true) {
       if (render_state_signal_ == RENDER_STATE_SIGNAL_RUN) {
-        if (task_queue_.empty()) {
+        if (task_queue_.empty() || guiding_refine_pending_) {
           LAND_TRACE("Wait for task.");
           wait_for_queue_cv_.wait(lock);
         } else {
@@ -84,6 +85,7 @@ void Renderer::WorkerThread() {
           auto push_task = my_task;
           push_task.sample += renderer_settings_.num_samples;
           task_queue_.push(push_task);
+          num_rendering_thread_++;
           break;
         }
       } else if (render_state_signal_ == RENDER_STATE_SIGNAL_PAUSE) {
@@ -122,6 +124,7 @@ void Renderer::WorkerThread() {
     }
 
     lock.lock();
+    num_rendering_thread_--;
     for (uint32_t i = 0; i < my_task.height; i++) {
       for (uint32_t j = 0; j < my_task.width; j++) {
         uint32_t id = i * my_task.width + j;
@@ -132,8 +135,53 @@ void Renderer::WorkerThread() {
             float(renderer_settings_.num_samples);
       }
     }
+    // Training iteration k of the SD-tree records 2^k passes.
+    if (sd_tree_.IsRecording() && !guiding_refine_pending_) {
+      uint64_t pass_samples = uint64_t(width_) * uint64_t(height_) *
+                              uint64_t(renderer_settings_.num_samples);
+      guiding_iteration_samples_ += uint64_t(my_task.width) *
+                                    uint64_t(my_task.height) *
+                                    uint64_t(renderer_settings_.num_samples);
+      if (guiding_iteration_samples_ >=
+          (pass_samples << sd_tree_.GetIteration())) {
+        guiding_iteration_samples_ = 0;
+        guiding_refine_pending_ = true;
+      }
+    }
+    // No task starts while a refinement is pending, so only one worker sees
+    // the last task finish.
+    bool refine_guiding = guiding_refine_pending_ && !num_rendering_thread_;
     lock.unlock();
+
+    if (refine_guiding) {
+      sd_tree_.Refine(
+          uint32_t(12000.0f * std::sqrt(float(1 << sd_tree_.GetIteration()))));
+      sd_tree_.SetRecording(sd_tree_.GetIteration() <
+                            renderer_settings_.guiding_training_iterations);
+      LAND_INFO("SD-tree iteration {} finished, {} KB.",
+                sd_tree_.GetIteration(), sd_tree_.GetMemoryUsage() >> 10);
+      lock.lock();
+      guiding_refine_pending_ = false;
+      wait_for_queue_cv_.notify_all();
+      lock.unlock();
+    }
+  }
+}
+
+void Renderer::ResetGuiding() {
+  AxisAlignedBoundingBox bounds;
+  auto &entities = scene_.GetEntities();
+  for (size_t i = 0; i < entities.size(); i++) {
+    auto aabb =
+        entities[i].GetModel()->GetAABB(entities[i].GetTransformMatrix());
+    bounds = i ? bounds | aabb : aabb;
   }
+  sd_tree_.Reset(bounds,
+                 size_t(renderer_settings_.guiding_max_memory_mb) << 20);
+  sd_tree_.SetRecording(renderer_settings_.enable_path_guiding &&
+                        renderer_settings_.guiding_training_iterations > 0);
+  guiding_iteration_samples_ = 0;
+  guiding_refine_pending_ = false;
 }
 
 RenderStateSignal Renderer::GetRenderStateSignal() const {
@@ -173,6 +221,7 @@ void Renderer::Resize(uint32_t width, uint32_t height) {
     for (auto &task : task_list) {
       task_queue_.push(task);
     }
+    ResetGuiding();
   });
 }
 
@@ -190,6 +239,8 @@ void Renderer::ResetAccumulation() {
         task_queue_.push(task);
       }
     }
+    ResetGuiding();
+    scene_.UpdateEnvmapRotation();
   });
 }
 
@@ -217,7 +268,9 @@ void Renderer::RayGeneration(int x,
   auto camera_to_world = scene_.GetCameraToWorld();
   origin = camera_to_world * glm::vec4(origin, 1.0f);
   direction = camera_to_world * glm::vec4(direction, 0.0f);
-  color_result = path_tracer.SampleRay(origin, direction, x, y, sample);
+  color_result =
+      path_tracer.SampleRay(origin, direction, x, y, sample,
+                            scene_.GetCamera().GetPixelSpreadAngle(height_));
 }
 
 void Renderer::RetrieveAccumulationResult(
@@ -239,7 +292,11 @@ int Renderer::LoadTexture(const std::string &file_path) {
 }
 
 int Renderer::LoadObjMesh(const std::string &file_path) {
-  return SafeOperation<int>([&]() { return scene_.LoadObjMesh(file_path); });
+  return SafeOperation<int>([&]() {
+    int entity_id = scene_.LoadObjMesh(file_path);
+    scene_.UpdateLightSampler(renderer_settings_.enable_light_bvh);
+    return entity_id;
+  });
 }
 
 int Renderer::GetAccumulatedSamples() {
@@ -248,7 +305,14 @@ int Renderer::GetAccumulatedSamples() {
 }
 
 void Renderer::LoadScene(const std::string &file_path) {
-  SafeOperation<void>([&]() { scene_ = Scene(file_path); });
+  SafeOperation<void>([&]() {
+    // Releases the current geometry before the new scene is loaded, instead
+    // of holding both until the assignment.
+    scene_.Clear();
+    scene_ = Scene(file_path);
+    scene_.UpdateLightSampler(renderer_settings_.enable_light_bvh);
+    ResetGuiding();
+  });
 }
 
 std::vector<glm::vec4> Renderer::CaptureRenderedImage() {
@@ -67,6 +67,7 @@ class Renderer {
 
  private:
   void WorkerThread();
+  void ResetGuiding();
 
   RendererSettings renderer_settings_;
   Scene scene_{};
@@ -89,6 +90,14 @@ class Renderer {
 
   uint32_t width_{0};
   uint32_t height_{0};
+
+  /* Path Guiding */
+  SDTree sd_tree_;
+  uint64_t guiding_iteration_samples_{0};
+  // Once an iteration has its samples no new task is issued, the last
+  // worker to finish its task refines and then resumes the others.
+  bool guiding_refine_pending_{false};
+  uint32_t num_rendering_thread_{0};
 };
 
 template <>
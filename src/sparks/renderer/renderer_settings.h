@@ -1,4 +1,5 @@
 #pragma once
+#include "sparks/assets/texture.h"
 
 namespace sparks {
 struct RendererSettings {
@@ -7,6 +8,16 @@ struct RendererSettings {
   float envmap_scale{1.0f};
   bool enable_mis{true};
   bool enable_alpha_shadow{true};
+  bool enable_light_bvh{true};
+  // Path guiding of the CPU renderer, the SD-tree is trained over the first
+  // guiding_training_iterations iterations of doubling sample counts.
+  bool enable_path_guiding{false};
+  int guiding_training_iterations{6};
+  int guiding_max_memory_mb{256};
+  // Mip filtering of the ray cone footprints in the CPU renderer.
+  TextureFilter texture_filter{TEXTURE_FILTER_TRILINEAR};
+  // Shades escaped rays of the CPU renderer from the envmap cube map.
+  bool enable_envmap_cubemap{true};
   int output_selection{0};
 };
 }  // namespace sparks
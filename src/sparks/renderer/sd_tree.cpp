@@ -0,0 +1,356 @@
+#include "sparks/renderer/sd_tree.h"
+
+#include "algorithm"
+#include "queue"
+#include "sparks/util/util.h"
+
+namespace sparks {
+
+namespace {
+constexpr int kMaxDirectionalDepth = 20;
+constexpr float kSubdivisionThreshold = 0.01f;
+
+void AtomicAdd(std::atomic<float> &target, float value) {
+  float current = target.load(std::memory_order_relaxed);
+  while (!target.compare_exchange_weak(current, current + value,
+                                       std::memory_order_relaxed)) {
+  }
+}
+
+glm::vec2 DirectionToCanonical(const glm::vec3 &direction) {
+  float cos_theta = std::min(std::max(direction.z, -1.0f), 1.0f);
+  float phi = std::atan2(direction.y, direction.x);
+  if (phi < 0.0f) {
+    phi += 2.0f * PI;
+  }
+  return {std::min((cos_theta + 1.0f) * 0.5f, 0.99999994f),
+          std::min(phi * (0.5f * INV_PI), 0.99999994f)};
+}
+
+glm::vec3 CanonicalToDirection(const glm::vec2 &canonical) {
+  float cos_theta = canonical.x * 2.0f - 1.0f;
+  float sin_theta = std::sqrt(std::max(1.0f - cos_theta * cos_theta, 0.0f));
+  float phi = canonical.y * 2.0f * PI;
+  return {sin_theta * std::cos(phi), sin_theta * std::sin(phi), cos_theta};
+}
+
+// Returns the quadrant containing p and rescales p into it.
+int Quadrant(glm::vec2 *p) {
+  int quadrant = 0;
+  for (int i = 0; i < 2; i++) {
+    if ((*p)[i] >= 0.5f) {
+      quadrant |= 1 << i;
+      (*p)[i] -= 0.5f;
+    }
+    (*p)[i] *= 2.0f;
+  }
+  return quadrant;
+}
+
+// Picks the first of two options with probability a / (a + b) and remaps r.
+int PickHalf(float a, float b, float *r) {
+  float prob = a / (a + b);
+  if (*r < prob) {
+    *r = std::min(*r / prob, 0.99999994f);
+    return 0;
+  }
+  *r = std::min((*r - prob) / (1.0f - prob), 0.99999994f);
+  return 1;
+}
+}  // namespace
+
+DirectionalTree::Node::Node(const Node &node) {
+  *this = node;
+}
+
+DirectionalTree::Node &DirectionalTree::Node::operator=(const Node &node) {
+  for (int i = 0; i < 4; i++) {
+    sums[i].store(node.sums[i].load(std::memory_order_relaxed),
+                  std::memory_order_relaxed);
+    children[i] = node.children[i];
+  }
+  return *this;
+}
+
+float DirectionalTree::Node::GetSum() const {
+  float sum = 0.0f;
+  for (auto &s : sums) {
+    sum += s.load(std::memory_order_relaxed);
+  }
+  return sum;
+}
+
+DirectionalTree::DirectionalTree() {
+  nodes_.emplace_back();
+}
+
+DirectionalTree::DirectionalTree(const DirectionalTree &tree) {
+  *this = tree;
+}
+
+DirectionalTree &DirectionalTree::operator=(const DirectionalTree &tree) {
+  nodes_ = tree.nodes_;
+  sum_ = tree.sum_;
+  sample_count_ = tree.sample_count_.load();
+  return *this;
+}
+
+void DirectionalTree::Record(const glm::vec3 &direction, float value) {
+  auto p = DirectionToCanonical(direction);
+  int node_index = 0;
+  while (true) {
+    auto &node = nodes_[node_index];
+    int quadrant = Quadrant(&p);
+    if (!node.children[quadrant]) {
+      AtomicAdd(node.sums[quadrant], value);
+      break;
+    }
+    node_index = node.children[quadrant];
+  }
+  sample_count_++;
+}
+
+void DirectionalTree::Build() {
+  // Children are always stored after their parents.
+  for (int i = int(nodes_.size()) - 1; i >= 0; i--) {
+    auto &node = nodes_[i];
+    for (int quadrant = 0; quadrant < 4; quadrant++) {
+      if (node.children[quadrant]) {
+        node.sums[quadrant] = nodes_[node.children[quadrant]].GetSum();
+      }
+    }
+  }
+  sum_ = nodes_[0].GetSum();
+}
+
+void DirectionalTree::Refine(const DirectionalTree &previous,
+                             int max_depth,
+                             float threshold,
+                             size_t max_bytes) {
+  struct Item {
+    int node;
+    int previous_node;
+    int depth;
+    float fraction;
+  };
+  size_t max_nodes = std::max(max_bytes / sizeof(Node), size_t(1));
+  nodes_.clear();
+  nodes_.emplace_back();
+  std::queue<Item> queue;
+  queue.push({0, 0, 1, 1.0f});
+  while (!queue.empty()) {
+    auto item = queue.front();
+    queue.pop();
+    for (int quadrant = 0; quadrant < 4; quadrant++) {
+      float fraction = item.fraction * 0.25f;
+      int previous_child = -1;
+      if (item.previous_node >= 0) {
+        auto &previous_node = previous.nodes_[item.previous_node];
+        fraction = previous.sum_ > 0.0f
+                       ? previous_node.sums[quadrant].load() / previous.sum_
+                       : 0.0f;
+        if (previous_node.children[quadrant]) {
+          previous_child = previous_node.children[quadrant];
+        }
+      }
+      if (item.depth < max_depth && fraction > threshold &&
+          nodes_.size() < max_nodes) {
+        int child = int(nodes_.size());
+        nodes_.emplace_back();
+        nodes_[item.node].children[quadrant] = child;
+        queue.push({child, previous_child, item.depth + 1, fraction});
+      }
+    }
+  }
+  sum_ = 0.0f;
+  sample_count_ = 0;
+}
+
+glm::vec3 DirectionalTree::Sample(float r1, float r2) const {
+  if (sum_ <= 0.0f) {
+    return CanonicalToDirection({r1, r2});
+  }
+  glm::vec2 origin{0.0f};
+  float size = 1.0f;
+  int node_index = 0;
+  while (true) {
+    auto &node = nodes_[node_index];
+    float sums[4];
+    for (int i = 0; i < 4; i++) {
+      sums[i] = node.sums[i].load(std::memory_order_relaxed);
+    }
+    int x = PickHalf(sums[0] + sums[2], sums[1] + sums[3], &r1);
+    int y = PickHalf(sums[x], sums[x + 2], &r2);
+    size *= 0.5f;
+    origin += glm::vec2{float(x), float(y)} * size;
+    int child = node.children[x + y * 2];
+    if (!child) {
+      return CanonicalToDirection(origin + glm::vec2{r1, r2} * size);
+    }
+    node_index = child;
+  }
+}
+
+float DirectionalTree::GetPdf(const glm::vec3 &direction) const {
+  if (sum_ <= 0.0f) {
+    return 0.25f * INV_PI;
+  }
+  auto p = DirectionToCanonical(direction);
+  float pdf = 1.0f;
+  int node_index = 0;
+  while (true) {
+    auto &node = nodes_[node_index];
+    float total = node.GetSum();
+    if (total <= 0.0f) {
+      return 0.0f;
+    }
+    int quadrant = Quadrant(&p);
+    pdf *= 4.0f * node.sums[quadrant].load(std::memory_order_relaxed) / total;
+    if (!node.children[quadrant]) {
+      break;
+    }
+    node_index = node.children[quadrant];
+  }
+  return pdf * 0.25f * INV_PI;
+}
+
+float DirectionalTree::GetSum() const {
+  return sum_;
+}
+
+uint32_t DirectionalTree::GetSampleCount() const {
+  return sample_count_;
+}
+
+void DirectionalTree::SetSampleCount(uint32_t sample_count) {
+  sample_count_ = sample_count;
+}
+
+size_t DirectionalTree::GetMemoryUsage() const {
+  return nodes_.size() * sizeof(Node);
+}
+
+void SDTree::Reset(const AxisAlignedBoundingBox &bounds,
+                   size_t max_memory_bytes) {
+  nodes_.clear();
+  nodes_.emplace_back();
+  // Cubic cells keep the splits alternating over the axes isotropic.
+  glm::vec3 low{bounds.x_low, bounds.y_low, bounds.z_low};
+  glm::vec3 high{bounds.x_high, bounds.y_high, bounds.z_high};
+  float size = std::max(std::max(high.x - low.x, high.y - low.y),
+                        std::max(high.z - low.z, 1e-4f));
+  bounds_min_ = low - glm::vec3{size * 0.01f};
+  bounds_size_ = glm::vec3{size * 1.02f};
+  max_memory_bytes_ = max_memory_bytes;
+  iteration_ = 0;
+}
+
+void SDTree::Refine(uint32_t split_threshold) {
+  size_t memory_usage = GetMemoryUsage();
+  std::vector<int> stack;
+  for (int i = 0; i < int(nodes_.size()); i++) {
+    if (!nodes_[i].children[0]) {
+      stack.push_back(i);
+    }
+  }
+  while (!stack.empty()) {
+    int index = stack.back();
+    stack.pop_back();
+    auto building = nodes_[index].building;
+    size_t split_cost =
+        2 * (sizeof(SpatialNode) + 2 * building.GetMemoryUsage());
+    if (building.GetSampleCount() <= split_threshold ||
+        memory_usage + split_cost > max_memory_bytes_) {
+      continue;
+    }
+    building.SetSampleCount(building.GetSampleCount() / 2);
+    int axis = (nodes_[index].axis + 1) % 3;
+    for (int i = 0; i < 2; i++) {
+      int child = int(nodes_.size());
+      nodes_.emplace_back();
+      nodes_[child].axis = axis;
+      nodes_[child].building = building;
+      nodes_[index].children[i] = child;
+      stack.push_back(child);
+    }
+    memory_usage += split_cost;
+    nodes_[index].building = DirectionalTree{};
+    nodes_[index].sampling = DirectionalTree{};
+  }
+
+  size_t num_leaves = 0;
+  for (auto &node : nodes_) {
+    if (!node.children[0]) {
+      num_leaves++;
+    }
+  }
+  size_t tree_budget = 0;
+  size_t spatial_memory = nodes_.size() * sizeof(SpatialNode);
+  if (max_memory_bytes_ > spatial_memory) {
+    tree_budget = (max_memory_bytes_ - spatial_memory) / (num_leaves * 2);
+  }
+  for (auto &node : nodes_) {
+    if (node.children[0]) {
+      continue;
+    }
+    node.building.Build();
+    node.sampling = node.building;
+    node.building.Refine(node.sampling, kMaxDirectionalDepth,
+                         kSubdivisionThreshold, tree_budget);
+  }
+  iteration_++;
+}
+
+void SDTree::Record(const glm::vec3 &position,
+                    const glm::vec3 &direction,
+                    float value) {
+  nodes_[FindLeaf(position)].building.Record(direction, value);
+}
+
+const DirectionalTree *SDTree::GetSamplingTree(
+    const glm::vec3 &position) const {
+  if (!iteration_) {
+    return nullptr;
+  }
+  return &nodes_[FindLeaf(position)].sampling;
+}
+
+void SDTree::SetRecording(bool recording) {
+  recording_ = recording;
+}
+
+bool SDTree::IsRecording() const {
+  return recording_;
+}
+
+int SDTree::GetIteration() const {
+  return iteration_;
+}
+
+size_t SDTree::GetMemoryUsage() const {
+  size_t memory_usage = nodes_.size() * sizeof(SpatialNode);
+  for (auto &node : nodes_) {
+    memory_usage +=
+        node.sampling.GetMemoryUsage() + node.building.GetMemoryUsage();
+  }
+  return memory_usage;
+}
+
+int SDTree::FindLeaf(const glm::vec3 &position) const {
+  auto p = glm::clamp((position - bounds_min_) / bounds_size_, 0.0f, 1.0f);
+  int node_index = 0;
+  while (nodes_[node_index].children[0]) {
+    auto &node = nodes_[node_index];
+    auto &x = p[node.axis];
+    if (x < 0.5f) {
+      x *= 2.0f;
+      node_index = node.children[0];
+    } else {
+      x = x * 2.0f - 1.0f;
+      node_index = node.children[1];
+    }
+  }
+  return node_index;
+}
+
+}  // namespace sparks
@@ -0,0 +1,97 @@
+#pragma once
+#include "atomic"
+#include "glm/glm.hpp"
+#include "sparks/assets/aabb.h"
+#include "vector"
+
+namespace sparks {
+
+// Quadtree over the cylindrical (cos theta, phi) parametrization of the
+// sphere. The mapping preserves area, so densities over the unit square turn
+// into solid angle densities by a constant factor of 1 / (4 PI).
+class DirectionalTree {
+ public:
+  DirectionalTree();
+  DirectionalTree(const DirectionalTree &tree);
+  DirectionalTree &operator=(const DirectionalTree &tree);
+
+  // Thread safe, only touches the leaf containing the direction.
+  void Record(const glm::vec3 &direction, float value);
+  // Propagates the recorded leaf sums up to the interior nodes.
+  void Build();
+  // Restructures the tree after previous, subdividing the cells holding more
+  // than threshold of the total energy in breadth first order until max_depth
+  // or max_bytes is reached. All sums are cleared.
+  void Refine(const DirectionalTree &previous,
+              int max_depth,
+              float threshold,
+              size_t max_bytes);
+
+  [[nodiscard]] glm::vec3 Sample(float r1, float r2) const;
+  [[nodiscard]] float GetPdf(const glm::vec3 &direction) const;
+  [[nodiscard]] float GetSum() const;
+  [[nodiscard]] uint32_t GetSampleCount() const;
+  void SetSampleCount(uint32_t sample_count);
+  [[nodiscard]] size_t GetMemoryUsage() const;
+
+ private:
+  struct Node {
+    Node() = default;
+    Node(const Node &node);
+    Node &operator=(const Node &node);
+    [[nodiscard]] float GetSum() const;
+
+    std::atomic<float> sums[4]{};
+    // 0 marks a leaf quadrant, the root is never a child.
+    int children[4]{};
+  };
+
+  std::vector<Node> nodes_;
+  float sum_{0.0f};
+  std::atomic<uint32_t> sample_count_{0};
+};
+
+// Spatial-directional tree of Mueller et al., "Practical Path Guiding for
+// Efficient Light-Transport Simulation". A binary tree over the scene bounds
+// stores a directional tree pair in each leaf: the sampling tree learned in
+// the previous iteration and the building tree recording the current one.
+class SDTree {
+ public:
+  void Reset(const AxisAlignedBoundingBox &bounds, size_t max_memory_bytes);
+  // Ends a training iteration: leaves that recorded more than
+  // split_threshold samples are split, then the recorded distributions
+  // become the sampling trees and the building trees are refined.
+  void Refine(uint32_t split_threshold);
+
+  void Record(const glm::vec3 &position,
+              const glm::vec3 &direction,
+              float value);
+  // nullptr until the first iteration finished.
+  [[nodiscard]] const DirectionalTree *GetSamplingTree(
+      const glm::vec3 &position) const;
+
+  void SetRecording(bool recording);
+  [[nodiscard]] bool IsRecording() const;
+  [[nodiscard]] int GetIteration() const;
+  [[nodiscard]] size_t GetMemoryUsage() const;
+
+ private:
+  struct SpatialNode {
+    DirectionalTree sampling;
+    DirectionalTree building;
+    int axis{0};
+    // 0 marks a leaf, the root is never a child.
+    int children[2]{};
+  };
+
+  [[nodiscard]] int FindLeaf(const glm::vec3 &position) const;
+
+  std::vector<SpatialNode> nodes_;
+  glm::vec3 bounds_min_{0.0f};
+  glm::vec3 bounds_size_{1.0f};
+  size_t max_memory_bytes_{0};
+  int iteration_{0};
+  std::atomic_bool recording_{false};
+};
+
+}  // namespace sparks
@@ -1,24 +1,79 @@
 #ifndef DIRECT_LIGHTING_GLSL
 #define DIRECT_LIGHTING_GLSL
 #include "envmap.glsl"
+#include "light_bvh.glsl"
 #include "random.glsl"
 #include "shadow_ray.glsl"
 #include "trace_ray.glsl"
 #include "vertex.glsl"
 
+// Picks index or its alias with the fractional part u of a scaled random
+// number, u is remapped to a fresh uniform random number.
+int AliasSelect(AliasEntry entry, int index, inout float u) {
+  u = min(u, 0.99999994);
+  if (u < entry.prob) {
+    u /= entry.prob;
+    return index;
+  }
+  u = (u - entry.prob) / (1.0 - entry.prob);
+  return entry.alias;
+}
+
+float EnvmapLightPdf(vec3 direction) {
+  ivec2 envmap_size =
+      textureSize(texture_samplers[global_uniform_object.envmap_id], 0);
+  vec2 tex_coord = fract(DirectionToEnvmapCoord(direction));
+  ivec2 texel = min(ivec2(tex_coord * vec2(envmap_size)), envmap_size - 1);
+  vec3 color =
+      texelFetch(texture_samplers[global_uniform_object.envmap_id], texel, 0)
+          .xyz;
+  return max(color.r, max(color.g, color.b)) /
+         global_uniform_object.total_envmap_power;
+}
+
+// World space area of a primitive of an entity.
+float PrimitiveArea(int object_index, int primitive_index) {
+  ObjectInfo object_info = object_infos[object_index];
+  vec3 v0 = GetVertexPosition(
+      object_info.vertex_offset +
+      indices[object_info.index_offset + primitive_index * 3 + 0]);
+  vec3 v1 = GetVertexPosition(
+      object_info.vertex_offset +
+      indices[object_info.index_offset + primitive_index * 3 + 1]);
+  vec3 v2 = GetVertexPosition(
+      object_info.vertex_offset +
+      indices[object_info.index_offset + primitive_index * 3 + 2]);
+  mat3 object_to_world = mat3(entity_objects[object_index].object_to_world);
+  return 0.5 *
+         length(cross(object_to_world * (v1 - v0), object_to_world * (v2 - v0)));
+}
+
 float EstimateDirectLightingPdf() {
   float pdf = 0.0;
   if (global_uniform_object.total_power > 1e-4) {
     if (ray_payload.t != -1.0) {
-      pdf += entity_objects[ray_payload.object_id].sample_density *
-             ray_payload.t * ray_payload.t;
+      int object_index = int(ray_payload.object_id);
+      EntityUniformObject entity_object = entity_objects[object_index];
+      if (global_uniform_object.enable_light_bvh) {
+        if (entity_object.num_primitives > 0) {
+          int primitive_index = int(ray_payload.primitive_id);
+          int leaf = light_bvh_leaves[entity_object.primitive_offset +
+                                      primitive_index];
+          float leaf_pdf =
+              LightBvhPdf(leaf, hit_record.position, hit_record.normal);
+          float primitive_area = PrimitiveArea(object_index, primitive_index);
+          if (leaf_pdf > 0.0 && primitive_area > 0.0) {
+            pdf += leaf_pdf / primitive_area * ray_payload.t * ray_payload.t;
+          }
+        }
+      } else {
+        pdf += entity_object.sample_density * ray_payload.t * ray_payload.t;
+      }
     }
   }
   if (global_uniform_object.total_envmap_power > 1e-4) {
     if (ray_payload.t == -1.0) {
-      vec3 color = SampleEnvmap(trace_ray_direction);
-      float strength = max(color.r, max(color.g, color.b));
-      pdf += strength / global_uniform_object.total_envmap_power;
+      pdf += EnvmapLightPdf(trace_ray_direction);
     }
   }
   return pdf;
@@ -28,45 +83,49 @@ void SampleModelLighting(inout vec3 eval,
                          inout vec3 omega_in,
                          inout float pdf,
                          float r1) {
-  int L = 0, R = global_uniform_object.num_objects;
-  while (L < R) {
-    int m = (L + R) / 2;
-    if (r1 <= entity_objects[m].cdf) {
-      R = m;
-    } else {
-      L = m + 1;
+  int object_index;
+  int primitive_index;
+  float area_pdf;
+  if (global_uniform_object.enable_light_bvh) {
+    float leaf_pdf;
+    int leaf =
+        SampleLightBvh(hit_record.position, hit_record.normal, r1, leaf_pdf);
+    if (leaf < 0) {
+      return;
     }
-  }
-  int object_index = R;
-  if (object_index >= global_uniform_object.num_objects) {
-    return;
-  }
-  if (object_index > 0) {
-    r1 -= entity_objects[object_index - 1].cdf;
-  }
-  EntityUniformObject entity_object = entity_objects[object_index];
-  r1 /= entity_object.pdf;
-  L = 0;
-  R = entity_object.num_primitives + 1;
-  while (L < R) {
-    int m = (L + R) / 2;
-    if (r1 <= primitive_cdf[entity_object.primitive_offset + m]) {
-      R = m;
-    } else {
-      L = m + 1;
+    object_index = light_bvh_nodes[leaf].entity_id;
+    primitive_index = light_bvh_nodes[leaf].primitive_id;
+    float primitive_area = PrimitiveArea(object_index, primitive_index);
+    if (primitive_area <= 0.0) {
+      return;
     }
+    area_pdf = leaf_pdf / primitive_area;
+  } else {
+    int num_objects = global_uniform_object.num_objects;
+    if (num_objects == 0) {
+      return;
+    }
+    float x = r1 * float(num_objects);
+    object_index = min(int(x), num_objects - 1);
+    r1 = x - float(object_index);
+    object_index = AliasSelect(
+        AliasEntry(entity_objects[object_index].alias_prob,
+                   entity_objects[object_index].alias),
+        object_index, r1);
+    int num_primitives = entity_objects[object_index].num_primitives;
+    if (num_primitives == 0) {
+      return;
+    }
+    x = r1 * float(num_primitives);
+    primitive_index = min(int(x), num_primitives - 1);
+    r1 = x - float(primitive_index);
+    primitive_index = AliasSelect(
+        primitive_alias[entity_objects[object_index].primitive_offset +
+                        primitive_index],
+        primitive_index, r1);
+    area_pdf = entity_objects[object_index].sample_density;
   }
-  int primitive_index = L;
-  if (primitive_index == 0 ||
-      primitive_index == entity_object.num_primitives + 1) {
-    return;
-  }
-  primitive_index--;
-  float lbound =
-            primitive_cdf[entity_object.primitive_offset + primitive_index],
-        rbound =
-            primitive_cdf[entity_object.primitive_offset + primitive_index + 1];
-  r1 = (r1 - lbound) / (rbound - lbound);
+  EntityUniformObject entity_object = entity_objects[object_index];
   ObjectInfo object_info = object_infos[object_index];
   vec3 v0 = GetVertexPosition(
       object_info.vertex_offset +
@@ -102,10 +161,11 @@ void SampleModelLighting(inout vec3 eval,
   float shadow = ShadowRay(hit_record.position, omega_in, dist);
   if (shadow > 1e-4) {
     eval = shadow * dot(-omega_in, geometry_normal) *
-           global_uniform_object.total_power *
-           materials[object_index].emission / (dist * dist);
+           materials[object_index].emission *
+           materials[object_index].emission_strength /
+           (area_pdf * dist * dist);
 
-    pdf = entity_object.sample_density * dist * dist;
+    pdf = area_pdf * dist * dist;
   }
 }
 
@@ -115,31 +175,34 @@ void SampleEnvmapLighting(inout vec3 eval,
                           float r1) {
   ivec2 envmap_size =
       textureSize(texture_samplers[global_uniform_object.envmap_id], 0);
-  int L = 0, R = envmap_size.x * envmap_size.y;
-  while (L < R) {
-    int m = (L + R) / 2;
-    if (r1 <= envmap_cdf[m]) {
-      R = m;
-    } else {
-      L = m + 1;
-    }
-  }
-  if (L == envmap_size.x * envmap_size.y) {
+  if (envmap_size.x * envmap_size.y == 0) {
     return;
   }
-  int x, y = L / envmap_size.x;
-  x = L - y * envmap_size.x;
+  float x = r1 * float(envmap_size.y);
+  int row = min(int(x), envmap_size.y - 1);
+  r1 = x - float(row);
+  row = AliasSelect(envmap_alias[row], row, r1);
+  float r2 = RandomFloat();
+  x = r2 * float(envmap_size.x);
+  int column = min(int(x), envmap_size.x - 1);
+  r2 = x - float(column);
+  column = AliasSelect(
+      envmap_alias[envmap_size.y + row * envmap_size.x + column], column, r2);
   float inv_width = 1.0 / float(envmap_size.x);
   float inv_height = 1.0 / float(envmap_size.y);
-  float z_lbound = cos(y * inv_height * PI);
-  float z_rbound = cos((y + 1) * inv_height * PI);
-  vec2 tex_coord = vec2((x + RandomFloat()) * inv_width,
+  float z_lbound = cos(row * inv_height * PI);
+  float z_rbound = cos((row + 1) * inv_height * PI);
+  vec2 tex_coord = vec2((column + r2) * inv_width,
                         acos(r1 * (z_rbound - z_lbound) + z_lbound) * INV_PI);
   omega_in = EnvmapCoordToDirection(tex_coord);
   float shadow = ShadowRay(hit_record.position, omega_in, 1e4);
   if (shadow > 1e-4) {
     vec3 color = SampleEnvmapTexCoord(tex_coord);
-    pdf = max(color.r, max(color.g, color.b)) /
+    vec3 texel =
+        texelFetch(texture_samplers[global_uniform_object.envmap_id],
+                   ivec2(column, row), 0)
+            .xyz;
+    pdf = max(texel.r, max(texel.g, texel.b)) /
           global_uniform_object.total_envmap_power;
     eval = shadow * color * global_uniform_object.envmap_scale * 4 * PI / pdf;
   }
@@ -0,0 +1,86 @@
+#ifndef LIGHT_BVH_GLSL
+#define LIGHT_BVH_GLSL
+
+float LightBvhImportance(int node_index, vec3 position, vec3 normal) {
+  LightBvhNode node = light_bvh_nodes[node_index];
+  if (node.power <= 0.0) {
+    return 0.0;
+  }
+  vec3 center = (node.aabb_min + node.aabb_max) * 0.5;
+  float radius = length(node.aabb_max - node.aabb_min) * 0.5;
+  vec3 offset = center - position;
+  float dist2 = dot(offset, offset);
+  if (dist2 <= radius * radius) {
+    return node.power / max(radius * radius, 1e-8);
+  }
+  float dist = sqrt(dist2);
+  vec3 direction = offset / dist;
+  float theta_u = asin(radius / dist);
+  float theta = acos(min(abs(dot(node.axis, direction)), 1.0));
+  float theta_prime = max(theta - node.theta_o - theta_u, 0.0);
+  if (theta_prime >= PI * 0.5) {
+    return 0.0;
+  }
+  float theta_i = acos(min(abs(dot(normal, direction)), 1.0));
+  float theta_i_prime = max(theta_i - theta_u, 0.0);
+  return node.power * cos(theta_prime) * cos(theta_i_prime) / dist2;
+}
+
+// Descends the light BVH picking children by importance, returns the leaf
+// node index or -1 and writes the probability of the pick to pdf. r is
+// remapped to a fresh uniform random number.
+int SampleLightBvh(vec3 position, vec3 normal, inout float r, out float pdf) {
+  pdf = 0.0;
+  int node_index = 0;
+  float prob = 1.0;
+  while (light_bvh_nodes[node_index].child[0] != -1) {
+    int left = light_bvh_nodes[node_index].child[0];
+    int right = light_bvh_nodes[node_index].child[1];
+    float importance_left = LightBvhImportance(left, position, normal);
+    float importance_right = LightBvhImportance(right, position, normal);
+    float total_importance = importance_left + importance_right;
+    if (total_importance <= 0.0) {
+      return -1;
+    }
+    float prob_left = importance_left / total_importance;
+    if (r < prob_left) {
+      r = min(r / prob_left, 0.99999994);
+      prob *= prob_left;
+      node_index = left;
+    } else {
+      r = min((r - prob_left) / (1.0 - prob_left), 0.99999994);
+      prob *= 1.0 - prob_left;
+      node_index = right;
+    }
+  }
+  if (light_bvh_nodes[node_index].power <= 0.0) {
+    return -1;
+  }
+  pdf = prob;
+  return node_index;
+}
+
+float LightBvhPdf(int leaf, vec3 position, vec3 normal) {
+  if (leaf < 0 || light_bvh_nodes[leaf].power <= 0.0) {
+    return 0.0;
+  }
+  float prob = 1.0;
+  int node_index = leaf;
+  while (light_bvh_nodes[node_index].parent != -1) {
+    int parent = light_bvh_nodes[node_index].parent;
+    int left = light_bvh_nodes[parent].child[0];
+    int right = light_bvh_nodes[parent].child[1];
+    float importance_left = LightBvhImportance(left, position, normal);
+    float importance_right = LightBvhImportance(right, position, normal);
+    float total_importance = importance_left + importance_right;
+    if (total_importance <= 0.0) {
+      return 0.0;
+    }
+    prob *= (left == node_index ? importance_left : importance_right) /
+            total_importance;
+    node_index = parent;
+  }
+  return prob;
+}
+
+#endif
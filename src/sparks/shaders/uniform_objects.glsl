@@ -32,18 +32,36 @@ struct GlobalUniformObject {
   bool enable_alpha_shadow;
   int output_selection;
   float envmap_scale;
+  bool enable_light_bvh;
 };
 
 struct EntityUniformObject {
   mat4 object_to_world;
-  float cdf;
+  float alias_prob;
   float pdf;
   int primitive_offset;
   int num_primitives;
   float power;
   float area;
   float sample_density;
-  float reserve;
+  int alias;
+};
+
+struct AliasEntry {
+  float prob;
+  int alias;
+};
+
+struct LightBvhNode {
+  vec3 aabb_min;
+  float power;
+  vec3 aabb_max;
+  float theta_o;
+  vec3 axis;
+  int parent;
+  int child[2];
+  int entity_id;
+  int primitive_id;
 };
 
 struct ObjectInfo {
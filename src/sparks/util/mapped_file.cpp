@@ -0,0 +1,110 @@
+#include "sparks/util/mapped_file.h"
+
+#ifdef _WIN32
+#include "grassland/util/util.h"
+#include "windows.h"
+#else
+#include "fcntl.h"
+#include "sys/mman.h"
+#include "sys/stat.h"
+#include "unistd.h"
+#endif
+
+namespace sparks {
+
+#ifdef _WIN32
+MappedFile::MappedFile(const std::string &file_path,
+                       FileAccessPattern access_pattern) {
+  file_handle_ = CreateFileW(
+      grassland::util::U8StringToWideString(file_path).c_str(), GENERIC_READ,
+      FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+      access_pattern == FILE_ACCESS_PATTERN_SEQUENTIAL
+          ? FILE_FLAG_SEQUENTIAL_SCAN
+          : FILE_ATTRIBUTE_NORMAL,
+      nullptr);
+  if (file_handle_ == INVALID_HANDLE_VALUE) {
+    file_handle_ = nullptr;
+    return;
+  }
+  LARGE_INTEGER file_size;
+  if (!GetFileSizeEx(file_handle_, &file_size)) {
+    return;
+  }
+  size_ = size_t(file_size.QuadPart);
+  open_ = true;
+  // Empty files cannot be mapped.
+  if (!size_) {
+    return;
+  }
+  mapping_handle_ =
+      CreateFileMappingW(file_handle_, nullptr, PAGE_READONLY, 0, 0, nullptr);
+  if (mapping_handle_) {
+    data_ = static_cast<const char *>(
+        MapViewOfFile(mapping_handle_, FILE_MAP_READ, 0, 0, 0));
+  }
+  open_ = data_ != nullptr;
+}
+
+MappedFile::~MappedFile() {
+  if (data_) {
+    UnmapViewOfFile(data_);
+  }
+  if (mapping_handle_) {
+    CloseHandle(mapping_handle_);
+  }
+  if (file_handle_) {
+    CloseHandle(file_handle_);
+  }
+}
+#else
+MappedFile::MappedFile(const std::string &file_path,
+                       FileAccessPattern access_pattern) {
+  file_descriptor_ = open(file_path.c_str(), O_RDONLY);
+  if (file_descriptor_ < 0) {
+    return;
+  }
+  struct stat file_stat {};
+  if (fstat(file_descriptor_, &file_stat)) {
+    return;
+  }
+  size_ = size_t(file_stat.st_size);
+  open_ = true;
+  // Empty files cannot be mapped.
+  if (!size_) {
+    return;
+  }
+  void *data =
+      mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, file_descriptor_, 0);
+  if (data == MAP_FAILED) {
+    open_ = false;
+    return;
+  }
+  madvise(data, size_,
+          access_pattern == FILE_ACCESS_PATTERN_SEQUENTIAL ? MADV_SEQUENTIAL
+                                                           : MADV_NORMAL);
+  data_ = static_cast<const char *>(data);
+}
+
+MappedFile::~MappedFile() {
+  if (data_) {
+    munmap(const_cast<char *>(data_), size_);
+  }
+  if (file_descriptor_ >= 0) {
+    close(file_descriptor_);
+  }
+}
+#endif
+
+bool MappedFile::IsOpen() const {
+  return open_;
+}
+
+const char *MappedFile::GetData() const {
+  return data_;
+}
+
+size_t MappedFile::GetSize() const {
+  return size_;
+}
+
+}  // namespace sparks
@@ -0,0 +1,43 @@
+#pragma once
+#include "string"
+
+namespace sparks {
+
+// How the mapped pages are going to be read, passed on to the OS to tune its
+// read ahead.
+enum FileAccessPattern {
+  // Front to back in one pass, pages are read well ahead and dropped early.
+  FILE_ACCESS_PATTERN_SEQUENTIAL = 0,
+  // Anything else, left to the defaults of the OS.
+  FILE_ACCESS_PATTERN_NORMAL = 1
+};
+
+// Read only memory mapping of a whole file. Pages are faulted in by the OS on
+// access and can be dropped again under memory pressure, so files larger than
+// the physical memory can be scanned.
+class MappedFile {
+ public:
+  explicit MappedFile(
+      const std::string &file_path,
+      FileAccessPattern access_pattern = FILE_ACCESS_PATTERN_SEQUENTIAL);
+  ~MappedFile();
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+
+  [[nodiscard]] bool IsOpen() const;
+  [[nodiscard]] const char *GetData() const;
+  [[nodiscard]] size_t GetSize() const;
+
+ private:
+  const char *data_{nullptr};
+  size_t size_{0};
+  bool open_{false};
+#ifdef _WIN32
+  void *file_handle_{nullptr};
+  void *mapping_handle_{nullptr};
+#else
+  int file_descriptor_{-1};
+#endif
+};
+
+}  // namespace sparks
@@ -0,0 +1,56 @@
+#pragma once
+#include "cstddef"
+#include "type_traits"
+#include "vector"
+
+namespace sparks {
+
+// Non-owning view of a contiguous array, the subset of C++20 std::span used
+// by the renderer. Follows the standard naming so it drops into range-for
+// loops and algorithms.
+template <class T>
+class Span {
+ public:
+  using element_type = T;
+  using value_type = std::remove_cv_t<T>;
+  using iterator = T *;
+
+  Span() = default;
+  Span(T *data, size_t size) : data_(data), size_(size) {
+  }
+  Span(std::vector<value_type> &vector)
+      : data_(vector.data()), size_(vector.size()) {
+  }
+  template <class U = T, class = std::enable_if_t<std::is_const<U>::value>>
+  Span(const std::vector<value_type> &vector)
+      : data_(vector.data()), size_(vector.size()) {
+  }
+
+  [[nodiscard]] T *data() const {
+    return data_;
+  }
+  [[nodiscard]] size_t size() const {
+    return size_;
+  }
+  [[nodiscard]] bool empty() const {
+    return !size_;
+  }
+  [[nodiscard]] T *begin() const {
+    return data_;
+  }
+  [[nodiscard]] T *end() const {
+    return data_ + size_;
+  }
+  T &operator[](size_t index) const {
+    return data_[index];
+  }
+  [[nodiscard]] Span subspan(size_t offset, size_t count) const {
+    return {data_ + offset, count};
+  }
+
+ private:
+  T *data_{nullptr};
+  size_t size_{0};
+};
+
+}  // namespace sparks
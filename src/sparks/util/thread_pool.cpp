@@ -0,0 +1,48 @@
+#include "sparks/util/thread_pool.h"
+
+namespace sparks {
+
+ThreadPool::ThreadPool(int num_threads) {
+  num_threads = std::max(num_threads, 1);
+  for (int i = 0; i < num_threads; i++) {
+    threads_.emplace_back(&ThreadPool::WorkerThread, this);
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  condition_.notify_all();
+  for (auto &thread : threads_) {
+    thread.join();
+  }
+}
+
+ThreadPool &ThreadPool::GetInstance() {
+  static ThreadPool thread_pool(int(std::thread::hardware_concurrency()));
+  return thread_pool;
+}
+
+int ThreadPool::GetNumThreads() const {
+  return int(threads_.size());
+}
+
+void ThreadPool::WorkerThread() {
+  while (true) {
+    std::function<void()> task;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      condition_.wait(lock, [this]() { return stop_ || !tasks_.empty(); });
+      if (tasks_.empty()) {
+        return;
+      }
+      task = std::move(tasks_.front());
+      tasks_.pop();
+    }
+    task();
+  }
+}
+
+}  // namespace sparks
@@ -0,0 +1,49 @@
+#pragma once
+#include "condition_variable"
+#include "functional"
+#include "future"
+#include "memory"
+#include "mutex"
+#include "queue"
+#include "thread"
+#include "vector"
+
+namespace sparks {
+
+// Fixed set of worker threads running submitted tasks in FIFO order.
+class ThreadPool {
+ public:
+  explicit ThreadPool(int num_threads);
+  ~ThreadPool();
+
+  // Process wide pool with one worker per hardware thread, shared by the
+  // asset loaders.
+  static ThreadPool &GetInstance();
+
+  template <class Func>
+  auto Submit(Func &&func) -> std::future<decltype(func())> {
+    using Result = decltype(func());
+    auto task = std::make_shared<std::packaged_task<Result()>>(
+        std::forward<Func>(func));
+    auto future = task->get_future();
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      tasks_.emplace([task]() { (*task)(); });
+    }
+    condition_.notify_one();
+    return future;
+  }
+
+  [[nodiscard]] int GetNumThreads() const;
+
+ private:
+  void WorkerThread();
+
+  std::vector<std::thread> threads_;
+  std::queue<std::function<void()>> tasks_;
+  std::mutex mutex_;
+  std::condition_variable condition_;
+  bool stop_{false};
+};
+
+}  // namespace sparks
@@ -1,6 +1,9 @@
 #include "sparks/util/util.h"
 
+#include "atomic"
+#include "fstream"
 #include "grassland/grassland.h"
+#include "sparks/util/thread_pool.h"
 
 namespace sparks {
 std::string PathToFilename(const std::string &file_path) {
@@ -16,4 +19,64 @@ std::string PathToFilename(const std::string &file_path) {
   }
   return grassland::util::WideStringToU8String(short_name);
 }
+
+bool ReadFile(const std::string &file_path, std::vector<uint8_t> &data) {
+  std::ifstream file(file_path, std::ios::binary | std::ios::ate);
+  if (!file) {
+    return false;
+  }
+  data.resize(size_t(file.tellg()));
+  file.seekg(0);
+  return bool(file.read(reinterpret_cast<char *>(data.data()),
+                        std::streamsize(data.size())));
+}
+
+void ParallelFor(int begin,
+                 int end,
+                 const std::function<void(int)> &func,
+                 int grain_size) {
+  if (begin >= end) {
+    return;
+  }
+  grain_size = std::max(grain_size, 1);
+  int num_chunks = (end - begin + grain_size - 1) / grain_size;
+  auto &thread_pool = ThreadPool::GetInstance();
+  int num_helpers = std::min(thread_pool.GetNumThreads(), num_chunks - 1);
+  // Shared with the helpers, which may only start after the call returned
+  // and then find no chunk left.
+  struct State {
+    std::atomic_int next_chunk{0};
+    int num_finished{0};
+    std::mutex mutex;
+    std::condition_variable condition;
+  };
+  auto state = std::make_shared<State>();
+  auto worker = [state, begin, end, grain_size, num_chunks, &func]() {
+    int num_finished = 0;
+    for (int chunk = state->next_chunk++; chunk < num_chunks;
+         chunk = state->next_chunk++) {
+      int chunk_begin = begin + chunk * grain_size;
+      int chunk_end = std::min(chunk_begin + grain_size, end);
+      for (int i = chunk_begin; i < chunk_end; i++) {
+        func(i);
+      }
+      num_finished++;
+    }
+    if (num_finished) {
+      std::lock_guard<std::mutex> lock(state->mutex);
+      state->num_finished += num_finished;
+      if (state->num_finished == num_chunks) {
+        state->condition.notify_all();
+      }
+    }
+  };
+  for (int i = 0; i < num_helpers; i++) {
+    thread_pool.Submit(worker);
+  }
+  worker();
+  std::unique_lock<std::mutex> lock(state->mutex);
+  state->condition.wait(lock, [&state, num_chunks]() {
+    return state->num_finished == num_chunks;
+  });
+}
 }  // namespace sparks
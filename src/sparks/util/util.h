@@ -1,9 +1,22 @@
 #pragma once
+#include "functional"
 #include "grassland/util/util.h"
+#include "vector"
 
 namespace sparks {
 constexpr float PI = 3.14159265358979323f;
 constexpr float INV_PI = 0.31830988618379067f;
 
 std::string PathToFilename(const std::string &file_path);
+
+bool ReadFile(const std::string &file_path, std::vector<uint8_t> &data);
+
+// Calls func(i) for every i in [begin, end) on the ThreadPool. Indices are
+// handed out in chunks of grain_size, returns when every call finished. The
+// calling thread takes chunks as well, so calls from pool tasks make progress
+// even when every worker is busy.
+void ParallelFor(int begin,
+                 int end,
+                 const std::function<void(int)> &func,
+                 int grain_size = 1);
 }  // namespace sparks